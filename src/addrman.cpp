@@ -85,6 +85,7 @@ CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, in
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    m_size = vRandom.size();
     if (pnId)
         *pnId = nId;
     return &mapInfo[nId];
@@ -119,6 +120,7 @@ void CAddrMan::Delete(int nId)
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
+    m_size = vRandom.size();
     mapAddr.erase(info);
     mapInfo.erase(nId);
     nNew--;
@@ -253,7 +255,7 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     }
 }
 
-bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty)
+bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimePenalty, const std::pair<int, int>* pNewPos)
 {
     if (!addr.IsRoutable())
         return false;
@@ -302,8 +304,15 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    int nUBucket, nUBucketPos;
+    if (pNewPos && CService(*pinfo) == CService(addr)) {
+        // An existing entry of the same IP with another port has a position of its own
+        nUBucket = pNewPos->first;
+        nUBucketPos = pNewPos->second;
+    } else {
+        nUBucket = pinfo->GetNewBucket(nKey, source);
+        nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    }
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
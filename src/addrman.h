@@ -13,9 +13,11 @@
 #include <timedata.h>
 #include <util/system.h>
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <utility>
 #include <vector>
 
 /**
@@ -209,6 +211,9 @@ private:
     //! Holds addrs inserted into tried table that collide with existing entries. Test-before-evict discipline used to resolve these collisions.
     std::set<int> m_tried_collisions;
 
+    //! size of vRandom, readable without cs
+    std::atomic<size_t> m_size{0};
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -238,8 +243,8 @@ protected:
     //! Mark an entry "good", possibly moving it from "new" to "tried".
     void Good_(const CService &addr, bool test_before_evict, int64_t time) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
-    //! Add an entry to the "new" table.
-    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Add an entry to the "new" table. pNewPos optionally holds its bucket and position there, computed beforehand.
+    bool Add_(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty, const std::pair<int, int>* pNewPos = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -383,6 +388,7 @@ public:
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
+            m_size = vRandom.size();
             if (nVersion != 1 || nUBuckets != ADDRMAN_NEW_BUCKET_COUNT) {
                 // In case the new table data cannot be used (nVersion unknown, or bucket count wrong),
                 // immediately try to give them a reference based on their primary source address.
@@ -407,6 +413,7 @@ public:
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
                 vRandom.push_back(nIdCount);
+                m_size = vRandom.size();
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
                 vvTried[nKBucket][nKBucketPos] = nIdCount;
@@ -475,6 +482,7 @@ public:
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        m_size = 0;
     }
 
     CAddrMan()
@@ -490,8 +498,7 @@ public:
     //! Return the number of (unique) addresses in all tables.
     size_t size() const
     {
-        LOCK(cs); // TODO: Cache this in an atomic to avoid this overhead
-        return vRandom.size();
+        return m_size;
     }
 
     //! Consistency check
@@ -524,11 +531,29 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        // Hash the addresses to their place in the new table before taking cs, so
+        // that large addr messages don't keep connection attempts and getaddr waiting.
+        uint256 nKeyUsed;
+        {
+            LOCK(cs);
+            nKeyUsed = nKey;
+        }
+        std::vector<std::pair<int, int>> vNewPos(vAddr.size());
+        for (size_t i = 0; i < vAddr.size(); i++) {
+            if (vAddr[i].IsRoutable()) {
+                const CAddrInfo info(vAddr[i], source);
+                vNewPos[i].first = info.GetNewBucket(nKeyUsed, source);
+                vNewPos[i].second = info.GetBucketPosition(nKeyUsed, true, vNewPos[i].first);
+            }
+        }
+
         LOCK(cs);
+        // The key only changes when the tables are cleared or reloaded
+        const bool fKeyUnchanged = nKeyUsed == nKey;
         int nAdd = 0;
         Check();
-        for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-            nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+        for (size_t i = 0; i < vAddr.size(); i++)
+            nAdd += Add_(vAddr[i], source, nTimePenalty, fKeyUnchanged ? &vNewPos[i] : nullptr) ? 1 : 0;
         Check();
         if (nAdd) {
             LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <streams.h>
+#include <version.h>
+
+void CRecentBlockCache::SetMaxBlocks(size_t nMaxBlocksIn)
+{
+    LOCK(cs);
+    nMaxBlocks = nMaxBlocksIn;
+    Trim();
+}
+
+void CRecentBlockCache::Trim()
+{
+    while (listBlocks.size() > nMaxBlocks) {
+        mapBlocks.erase(listBlocks.back().hash);
+        listBlocks.pop_back();
+    }
+}
+
+void CRecentBlockCache::Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs);
+    if (nMaxBlocks == 0 || !pblock) {
+        return;
+    }
+    auto it = mapBlocks.find(hash);
+    if (it != mapBlocks.end()) {
+        listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+        return;
+    }
+    listBlocks.push_front(Entry{hash, pblock, nullptr});
+    mapBlocks.emplace(hash, listBlocks.begin());
+    Trim();
+}
+
+std::shared_ptr<const CBlock> CRecentBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end()) {
+        return nullptr;
+    }
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+    return it->second->block;
+}
+
+std::shared_ptr<const std::vector<unsigned char>> CRecentBlockCache::GetSerialized(const uint256& hash)
+{
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs);
+        auto it = mapBlocks.find(hash);
+        if (it == mapBlocks.end()) {
+            return nullptr;
+        }
+        listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+        if (it->second->serialized) {
+            return it->second->serialized;
+        }
+        pblock = it->second->block;
+    }
+
+    // Serialize outside the lock; concurrent first requests may both do the
+    // work, but only one result is kept.
+    auto serialized = std::make_shared<std::vector<unsigned char>>();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *serialized, 0, *pblock);
+
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it != mapBlocks.end()) {
+        if (!it->second->serialized) {
+            it->second->serialized = serialized;
+        }
+        return it->second->serialized;
+    }
+    return serialized;
+}
+
+void CRecentBlockCache::Clear()
+{
+    LOCK(cs);
+    mapBlocks.clear();
+    listBlocks.clear();
+}
+
+size_t CRecentBlockCache::size() const
+{
+    LOCK(cs);
+    return listBlocks.size();
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <primitives/block.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+/**
+ * LRU cache of recently connected blocks and their serialization.
+ *
+ * A new block is requested by many peers and local clients at once; serving
+ * it from here avoids repeating the disk read and the header hash check for
+ * every request.
+ */
+class CRecentBlockCache
+{
+public:
+    explicit CRecentBlockCache(size_t nMaxBlocksIn = 0) : nMaxBlocks(nMaxBlocksIn) {}
+
+    /** Set the number of blocks kept (0 disables the cache). */
+    void SetMaxBlocks(size_t nMaxBlocksIn);
+
+    /** Add a block; hash must be the block's hash, passed in to avoid rehashing. */
+    void Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock);
+
+    /** Return the cached block, or nullptr. */
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+
+    /**
+     * Return the serialization of a cached block including witness data
+     * (which matches the on-disk format), or nullptr. The serialization is
+     * computed on first use and shared by later callers.
+     */
+    std::shared_ptr<const std::vector<unsigned char>> GetSerialized(const uint256& hash);
+
+    void Clear();
+    size_t size() const;
+
+private:
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        std::shared_ptr<const std::vector<unsigned char>> serialized;
+    };
+    typedef std::list<Entry> list_type;
+
+    mutable CCriticalSection cs;
+    size_t nMaxBlocks GUARDED_BY(cs);
+    //! Most recently used block first
+    list_type listBlocks GUARDED_BY(cs);
+    std::map<uint256, list_type::iterator> mapBlocks GUARDED_BY(cs);
+
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(cs);
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
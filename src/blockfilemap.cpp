@@ -0,0 +1,122 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <logging.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    if (m_size > 0) {
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+    }
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CMappedBlockFile::Map(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LogPrintf("Unable to map block file %s\n", path.string());
+        return nullptr;
+    }
+    return std::make_shared<const CMappedBlockFile>(static_cast<const unsigned char*>(addr), size);
+#else
+    return nullptr;
+#endif
+}
+
+void CBlockFileMapCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (listMaps.size() > nMaxFiles) {
+        EraseLocked(listMaps.back().first);
+    }
+}
+
+bool CBlockFileMapCache::IsEnabled() const
+{
+    LOCK(cs);
+    return nMaxFiles > 0;
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMapCache::Get(int nFile, const fs::path& path, size_t nMinSize)
+{
+    LOCK(cs);
+    if (nMaxFiles == 0) {
+        return nullptr;
+    }
+
+    auto it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        if (it->second->second->size() >= nMinSize) {
+            listMaps.splice(listMaps.begin(), listMaps, it->second);
+            return it->second->second;
+        }
+        // The file has grown since it was mapped
+        EraseLocked(nFile);
+    }
+
+    std::shared_ptr<const CMappedBlockFile> file = CMappedBlockFile::Map(path);
+    if (!file || file->size() < nMinSize) {
+        return nullptr;
+    }
+    listMaps.emplace_front(nFile, file);
+    mapFiles.emplace(nFile, listMaps.begin());
+    while (listMaps.size() > nMaxFiles) {
+        EraseLocked(listMaps.back().first);
+    }
+    return file;
+}
+
+void CBlockFileMapCache::Erase(int nFile)
+{
+    LOCK(cs);
+    EraseLocked(nFile);
+}
+
+void CBlockFileMapCache::EraseLocked(int nFile)
+{
+    auto it = mapFiles.find(nFile);
+    if (it == mapFiles.end()) {
+        return;
+    }
+    listMaps.erase(it->second);
+    mapFiles.erase(it);
+}
+
+void CBlockFileMapCache::Clear()
+{
+    LOCK(cs);
+    mapFiles.clear();
+    listMaps.clear();
+}
+
+size_t CBlockFileMapCache::size() const
+{
+    LOCK(cs);
+    return listMaps.size();
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <span.h>
+#include <sync.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+
+/** A read-only memory mapping of a whole blk?????.dat file. */
+class CMappedBlockFile
+{
+public:
+    CMappedBlockFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~CMappedBlockFile();
+
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+
+    Span<const unsigned char> GetSpan() const { return Span<const unsigned char>(m_data, m_size); }
+    size_t size() const { return m_size; }
+
+    /** Map the file at path, returning nullptr if it can't be mapped. */
+    static std::shared_ptr<const CMappedBlockFile> Map(const fs::path& path);
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+};
+
+/**
+ * Bounded LRU cache of block file mappings.
+ *
+ * Mappings are handed out as shared pointers, so a file evicted or erased
+ * while a reader still deserializes from it stays mapped until that reader
+ * drops its reference.
+ */
+class CBlockFileMapCache
+{
+public:
+    explicit CBlockFileMapCache(size_t nMaxFilesIn = 0) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Set the number of files kept mapped (0 disables the cache). */
+    void SetMaxFiles(size_t nMaxFilesIn);
+    bool IsEnabled() const;
+
+    /**
+     * Return a mapping of file nFile covering at least nMinSize bytes,
+     * remapping it if the file has grown since it was mapped. Returns nullptr
+     * if the cache is disabled or the file is missing or too short.
+     */
+    std::shared_ptr<const CMappedBlockFile> Get(int nFile, const fs::path& path, size_t nMinSize);
+
+    /** Drop the mapping of a file that is about to be truncated or deleted. */
+    void Erase(int nFile);
+    void Clear();
+    size_t size() const;
+
+private:
+    typedef std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile>>> list_type;
+
+    mutable CCriticalSection cs;
+    size_t nMaxFiles GUARDED_BY(cs);
+    //! Most recently used mapping first
+    list_type listMaps GUARDED_BY(cs);
+    std::map<int, list_type::iterator> mapFiles GUARDED_BY(cs);
+
+    void EraseLocked(int nFile) EXCLUSIVE_LOCKS_REQUIRED(cs);
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
@@ -12,6 +12,10 @@
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 /**
@@ -448,6 +452,48 @@ public:
     }
 };
 
+/**
+ * Owns CBlockIndex entries, allocating them in large contiguous chunks
+ * rather than one heap allocation each. Entries are never freed one by one;
+ * they all go away together on Clear(), which is how the block index is
+ * unloaded anyway.
+ */
+class CBlockIndexArena
+{
+public:
+    static constexpr size_t CHUNK_ENTRIES = 16384;
+
+    CBlockIndexArena() = default;
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    template <typename... Args>
+    CBlockIndex* Allocate(Args&&... args)
+    {
+        if (m_used == CHUNK_ENTRIES) {
+            m_chunks.emplace_back(new Slot[CHUNK_ENTRIES]);
+            m_used = 0;
+        }
+        return new (&m_chunks.back()[m_used++]) CBlockIndex(std::forward<Args>(args)...);
+    }
+
+    void Clear()
+    {
+        m_chunks.clear();
+        m_used = CHUNK_ENTRIES;
+    }
+
+    size_t size() const { return m_chunks.empty() ? 0 : (m_chunks.size() - 1) * CHUNK_ENTRIES + m_used; }
+
+private:
+    // Clear() releases the memory without running destructors
+    static_assert(std::is_trivially_destructible<CBlockIndex>::value, "CBlockIndex must be trivially destructible");
+    typedef std::aligned_storage<sizeof(CBlockIndex), alignof(CBlockIndex)>::type Slot;
+
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    size_t m_used{CHUNK_ENTRIES};
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
@@ -6,8 +6,12 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <sync.h>
+#include <util/time.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +20,31 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Per-thread counters of a CCheckQueue. Slot 0 is the master. */
+struct CCheckQueueWorkerStats
+{
+    uint64_t nChecks{0};
+    uint64_t nBatches{0};
+    uint64_t nSteals{0};
+    int64_t nBusyMicros{0};
+    int64_t nIdleMicros{0};
+};
+
+/** Snapshot of the timing counters of a CCheckQueue. */
+struct CCheckQueueStats
+{
+    bool fWorkStealing{false};
+    unsigned int nBatchSize{0};
+    //! Number of completed CCheckQueueControl sessions (one per connected block)
+    uint64_t nBlocks{0};
+    uint64_t nChecks{0};
+    uint64_t nLastBlockChecks{0};
+    //! Time the master spent blocked waiting for workers to finish
+    int64_t nMasterWaitMicros{0};
+    int64_t nLastMasterWaitMicros{0};
+    std::vector<CCheckQueueWorkerStats> vWorkers;
+};
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,6 +54,12 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * By default all workers share one mutex-protected vector. With
+  * EnableWorkStealing() every worker owns a deque instead: the master
+  * spreads added checks over the deques, workers take batches from the
+  * back of their own deque and steal from the front of the others, so the
+  * shared mutex is only touched to go to sleep or to wake up.
   */
 template <typename T>
 class CCheckQueue
@@ -62,9 +97,87 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Per-worker deque used in work-stealing mode
+    struct WorkerDeque {
+        boost::mutex mutex;
+        std::deque<T> items;
+    };
+
+    //! Per-thread counters, updated lock-free by the owning thread
+    struct WorkerCounters {
+        std::atomic<uint64_t> nChecks{0};
+        std::atomic<uint64_t> nBatches{0};
+        std::atomic<uint64_t> nSteals{0};
+        std::atomic<int64_t> nBusyMicros{0};
+        std::atomic<int64_t> nIdleMicros{0};
+    };
+
+    //! Whether EnableWorkStealing() was called
+    bool fWorkStealing;
+
+    //! The deques of the workers (slot 0 belongs to the master)
+    std::vector<std::unique_ptr<WorkerDeque>> vDeques;
+
+    //! Deque the next Add() starts distributing at
+    std::atomic<unsigned int> nNextDeque;
+
+    //! Work-stealing mode: checks sitting in a deque, not yet taken by a worker
+    std::atomic<int> nQueued;
+
+    //! Work-stealing mode: checks that haven't completed yet
+    std::atomic<int> nUnfinished;
+
+    //! Work-stealing mode: the temporary evaluation result
+    std::atomic<bool> fAllOkStealing;
+
+    //! Mutex to protect the statistics below and the worker registration
+    mutable boost::mutex statsMutex;
+
+    //! Counters per thread; a std::deque so references stay valid on growth
+    std::deque<WorkerCounters> vCounters;
+
+    //! Checks added since the last Wait() of the master
+    std::atomic<uint64_t> nSessionChecks;
+
+    uint64_t nStatBlocks;
+    uint64_t nStatChecks;
+    uint64_t nStatLastBlockChecks;
+    int64_t nStatMasterWaitMicros;
+    int64_t nStatLastMasterWaitMicros;
+
+    //! Register a worker thread, returning its slot
+    size_t RegisterWorker()
+    {
+        boost::unique_lock<boost::mutex> lock(statsMutex);
+        vCounters.emplace_back();
+        return vCounters.size() - 1;
+    }
+
+    WorkerCounters& GetCounters(size_t nSlot)
+    {
+        boost::unique_lock<boost::mutex> lock(statsMutex);
+        return vCounters[nSlot];
+    }
+
+    //! Record the end of a master session
+    void FinishSession(int64_t nWaitMicros)
+    {
+        boost::unique_lock<boost::mutex> lock(statsMutex);
+        uint64_t nChecks = nSessionChecks.exchange(0);
+        nStatBlocks++;
+        nStatChecks += nChecks;
+        nStatLastBlockChecks = nChecks;
+        nStatMasterWaitMicros += nWaitMicros;
+        nStatLastMasterWaitMicros = nWaitMicros;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(bool fMaster, size_t nSlot)
     {
+        if (fWorkStealing)
+            return LoopStealing(fMaster, nSlot);
+        WorkerCounters& counters = GetCounters(nSlot);
+        int64_t nMasterWait = 0;
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
@@ -92,11 +205,18 @@ private:
                         // reset the status for new work later
                         if (fMaster)
                             fAllOk = true;
+                        lock.unlock();
+                        FinishSession(nMasterWait);
                         // return the current status
                         return fRet;
                     }
                     nIdle++;
+                    int64_t nWaitStart = GetTimeMicros();
                     cond.wait(lock); // wait
+                    int64_t nWaited = GetTimeMicros() - nWaitStart;
+                    counters.nIdleMicros.fetch_add(nWaited, std::memory_order_relaxed);
+                    if (fMaster)
+                        nMasterWait += nWaited;
                     nIdle--;
                 }
                 // Decide how many work units to process now.
@@ -116,10 +236,100 @@ private:
                 fOk = fAllOk;
             }
             // execute work
+            int64_t nBusyStart = GetTimeMicros();
+            for (T& check : vChecks)
+                if (fOk)
+                    fOk = check();
+            counters.nBusyMicros.fetch_add(GetTimeMicros() - nBusyStart, std::memory_order_relaxed);
+            counters.nChecks.fetch_add(vChecks.size(), std::memory_order_relaxed);
+            counters.nBatches.fetch_add(1, std::memory_order_relaxed);
+            vChecks.clear();
+        } while (true);
+    }
+
+    /** Move up to half of a deque (but at most nBatchSize) into vChecks. */
+    size_t TakeFrom(WorkerDeque& deq, bool fFront, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(deq.mutex);
+        size_t nNow = std::min<size_t>(nBatchSize, (deq.items.size() + 1) / 2);
+        for (size_t i = 0; i < nNow; i++) {
+            vChecks.emplace_back();
+            if (fFront) {
+                vChecks.back().swap(deq.items.front());
+                deq.items.pop_front();
+            } else {
+                vChecks.back().swap(deq.items.back());
+                deq.items.pop_back();
+            }
+        }
+        return nNow;
+    }
+
+    /** Fill vChecks from our own deque, or steal from another worker's. */
+    bool TakeBatch(size_t nSlot, std::vector<T>& vChecks, WorkerCounters& counters)
+    {
+        const size_t nDeques = vDeques.size();
+        const size_t nOwn = nSlot % nDeques;
+        size_t nNow = TakeFrom(*vDeques[nOwn], false, vChecks);
+        for (size_t i = 1; nNow == 0 && i < nDeques; i++) {
+            nNow = TakeFrom(*vDeques[(nOwn + i) % nDeques], true, vChecks);
+            if (nNow)
+                counters.nSteals.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (nNow == 0)
+            return false;
+        nQueued.fetch_sub(nNow);
+        return true;
+    }
+
+    /** Work-stealing counterpart of Loop(). */
+    bool LoopStealing(bool fMaster, size_t nSlot)
+    {
+        WorkerCounters& counters = GetCounters(nSlot);
+        int64_t nMasterWait = 0;
+        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        do {
+            if (!TakeBatch(nSlot, vChecks, counters)) {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                // Adders bump nQueued before notifying under this mutex, and
+                // workers that finish the last check notify the master under
+                // it, so checking both here can not miss a wakeup.
+                if (nQueued.load() > 0)
+                    continue;
+                if (fMaster && nUnfinished.load() == 0) {
+                    bool fRet = fAllOkStealing.exchange(true);
+                    lock.unlock();
+                    FinishSession(nMasterWait);
+                    return fRet;
+                }
+                int64_t nWaitStart = GetTimeMicros();
+                cond.wait(lock);
+                int64_t nWaited = GetTimeMicros() - nWaitStart;
+                counters.nIdleMicros.fetch_add(nWaited, std::memory_order_relaxed);
+                if (fMaster)
+                    nMasterWait += nWaited;
+                continue;
+            }
+            // Check whether we need to do work at all
+            bool fOk = fAllOkStealing.load(std::memory_order_relaxed);
+            int64_t nBusyStart = GetTimeMicros();
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            if (!fOk)
+                fAllOkStealing.store(false);
+            counters.nBusyMicros.fetch_add(GetTimeMicros() - nBusyStart, std::memory_order_relaxed);
+            counters.nChecks.fetch_add(vChecks.size(), std::memory_order_relaxed);
+            counters.nBatches.fetch_add(1, std::memory_order_relaxed);
+            const int nDone = vChecks.size();
             vChecks.clear();
+            if (nUnfinished.fetch_sub(nDone) == nDone && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -128,23 +338,70 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn),
+        fWorkStealing(false), nNextDeque(0), nQueued(0), nUnfinished(0), fAllOkStealing(true), nSessionChecks(0),
+        nStatBlocks(0), nStatChecks(0), nStatLastBlockChecks(0), nStatMasterWaitMicros(0), nStatLastMasterWaitMicros(0)
+    {
+        // slot 0 is used by whichever thread acts as the master
+        vCounters.emplace_back();
+    }
+
+    /**
+     * Give each of nThreads threads (including the master) its own deque.
+     * Must be called before any worker thread is started.
+     */
+    void EnableWorkStealing(unsigned int nThreads)
+    {
+        vDeques.clear();
+        for (unsigned int i = 0; i < std::max(1U, nThreads); i++)
+            vDeques.emplace_back(new WorkerDeque());
+        fWorkStealing = true;
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(false, RegisterWorker());
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(true, 0);
+    }
+
+    //! Return a snapshot of the timing counters
+    CCheckQueueStats GetStats() const
+    {
+        CCheckQueueStats stats;
+        boost::unique_lock<boost::mutex> lock(statsMutex);
+        stats.fWorkStealing = fWorkStealing;
+        stats.nBatchSize = nBatchSize;
+        stats.nBlocks = nStatBlocks;
+        stats.nChecks = nStatChecks;
+        stats.nLastBlockChecks = nStatLastBlockChecks;
+        stats.nMasterWaitMicros = nStatMasterWaitMicros;
+        stats.nLastMasterWaitMicros = nStatLastMasterWaitMicros;
+        for (const WorkerCounters& counters : vCounters) {
+            CCheckQueueWorkerStats worker;
+            worker.nChecks = counters.nChecks.load(std::memory_order_relaxed);
+            worker.nBatches = counters.nBatches.load(std::memory_order_relaxed);
+            worker.nSteals = counters.nSteals.load(std::memory_order_relaxed);
+            worker.nBusyMicros = counters.nBusyMicros.load(std::memory_order_relaxed);
+            worker.nIdleMicros = counters.nIdleMicros.load(std::memory_order_relaxed);
+            stats.vWorkers.push_back(worker);
+        }
+        return stats;
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
+        nSessionChecks.fetch_add(vChecks.size(), std::memory_order_relaxed);
+        if (fWorkStealing) {
+            AddStealing(vChecks);
+            return;
+        }
         boost::unique_lock<boost::mutex> lock(mutex);
         for (T& check : vChecks) {
             queue.push_back(T());
@@ -161,6 +418,34 @@ public:
     {
     }
 
+private:
+    //! Spread a batch of checks over the worker deques and wake up workers
+    void AddStealing(std::vector<T>& vChecks)
+    {
+        if (vChecks.empty())
+            return;
+        // Account for the checks before they become visible, so a worker
+        // finishing them can never see nUnfinished drop below zero.
+        nUnfinished.fetch_add(vChecks.size());
+        const size_t nDeques = vDeques.size();
+        const size_t nChunk = (vChecks.size() + nDeques - 1) / nDeques;
+        size_t nDeque = nNextDeque.fetch_add(1) % nDeques;
+        for (size_t nPos = 0; nPos < vChecks.size(); nDeque = (nDeque + 1) % nDeques) {
+            WorkerDeque& deq = *vDeques[nDeque];
+            boost::unique_lock<boost::mutex> lock(deq.mutex);
+            for (size_t nEnd = std::min(vChecks.size(), nPos + nChunk); nPos < nEnd; nPos++) {
+                deq.items.emplace_back();
+                vChecks[nPos].swap(deq.items.back());
+            }
+        }
+        nQueued.fetch_add(vChecks.size());
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else
+            condWorker.notify_all();
+    }
+
 };
 
 /**
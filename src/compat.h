@@ -95,6 +95,11 @@ typedef char* sockopt_arg_type;
 #define USE_POLL
 #endif
 
+// epoll lets sockets stay registered across iterations of the socket handler
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #if defined(USE_POLL) || defined(WIN32)
     return true;
@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <httpserver.h>
 #include <key_io.h>
+#include <rpc/jsonstream.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <random.h>
@@ -189,7 +190,39 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
+            // Results written to the stream are sent in chunks as they come
+            bool fStreaming = false;
+            JSONStreamWriter stream([&](const std::string& strChunk) {
+                if (!fStreaming) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->StartReplyChunks(HTTP_OK);
+                    req->WriteReplyChunk("{\"result\":");
+                    fStreaming = true;
+                }
+                if (!req->WriteReplyChunk(strChunk)) {
+                    throw std::runtime_error("client disconnected");
+                }
+            });
+            jreq.stream = &stream;
+
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+                if (stream.IsUsed()) {
+                    stream.Flush();
+                }
+            } catch (...) {
+                if (!fStreaming) throw;
+                // Too late for an error reply, cut the result short instead
+                LogPrint(BCLog::RPC, "%s: %s failed while its result was being sent\n", __func__, jreq.strMethod);
+                req->EndReplyChunks();
+                return false;
+            }
+            if (fStreaming) {
+                req->WriteReplyChunk(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                req->EndReplyChunks();
+                return true;
+            }
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
@@ -13,7 +13,12 @@
 #include <shutdown.h>
 #include <sync.h>
 #include <ui_interface.h>
+#include <workqueue.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,17 +46,58 @@
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+/** Bytes of a chunked reply that may wait to be sent before WriteReplyChunk blocks */
+static const size_t MAX_CHUNKED_REPLY_PENDING = 1024 * 1024;
+
+/** Histogram of durations in power-of-two buckets of microseconds, updated without locking */
+class LatencyHistogram
+{
+private:
+    std::atomic<uint64_t> buckets[32];
+
+public:
+    LatencyHistogram()
+    {
+        for (auto& bucket : buckets) bucket = 0;
+    }
+    void Add(int64_t nMicros)
+    {
+        int i = 0;
+        while (nMicros > 0 && i < 31) {
+            nMicros >>= 1;
+            i++;
+        }
+        buckets[i].fetch_add(1, std::memory_order_relaxed);
+    }
+    /** The counts up to the last non-empty bucket */
+    std::vector<uint64_t> Get() const
+    {
+        std::vector<uint64_t> counts;
+        for (const auto& bucket : buckets) counts.push_back(bucket.load(std::memory_order_relaxed));
+        while (!counts.empty() && counts.back() == 0) counts.pop_back();
+        return counts;
+    }
+};
+
+//! Time requests wait for a worker thread
+static LatencyHistogram g_http_queue_time;
+//! Time worker threads take to handle requests
+static LatencyHistogram g_http_service_time;
+
 /** HTTP request work item */
 class HTTPWorkItem final : public HTTPClosure
 {
 public:
     HTTPWorkItem(std::unique_ptr<HTTPRequest> _req, const std::string &_path, const HTTPRequestHandler& _func):
-        req(std::move(_req)), path(_path), func(_func)
+        req(std::move(_req)), path(_path), func(_func), nTimeQueued(GetTimeMicros())
     {
     }
     void operator()() override
     {
+        const int64_t nTimeStart = GetTimeMicros();
+        g_http_queue_time.Add(nTimeStart - nTimeQueued);
         func(req.get(), path);
+        g_http_service_time.Add(GetTimeMicros() - nTimeStart);
     }
 
     std::unique_ptr<HTTPRequest> req;
@@ -59,67 +105,7 @@ public:
 private:
     std::string path;
     HTTPRequestHandler func;
-};
-
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
- */
-template <typename WorkItem>
-class WorkQueue
-{
-private:
-    /** Mutex protects entire object */
-    Mutex cs;
-    std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
-    bool running;
-    size_t maxDepth;
-
-public:
-    explicit WorkQueue(size_t _maxDepth) : running(true),
-                                 maxDepth(_maxDepth)
-    {
-    }
-    /** Precondition: worker threads have all stopped (they have been joined).
-     */
-    ~WorkQueue()
-    {
-    }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
-    {
-        LOCK(cs);
-        if (queue.size() >= maxDepth) {
-            return false;
-        }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
-        cond.notify_one();
-        return true;
-    }
-    /** Thread function */
-    void Run()
-    {
-        while (true) {
-            std::unique_ptr<WorkItem> i;
-            {
-                WAIT_LOCK(cs, lock);
-                while (running && queue.empty())
-                    cond.wait(lock);
-                if (!running)
-                    break;
-                i = std::move(queue.front());
-                queue.pop_front();
-            }
-            (*i)();
-        }
-    }
-    /** Interrupt and exit loops */
-    void Interrupt()
-    {
-        LOCK(cs);
-        running = false;
-        cond.notify_all();
-    }
+    int64_t nTimeQueued;
 };
 
 struct HTTPPathHandler
@@ -143,6 +129,8 @@ struct evhttp* eventHTTP = nullptr;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Number of worker threads taking from workQueue
+static int g_http_worker_threads = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -405,6 +393,80 @@ bool InitHTTPServer()
     return true;
 }
 
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats)
+{
+    if (!workQueue) return false;
+    stats.nDepth = workQueue->Depth();
+    stats.nMaxDepth = workQueue->MaxDepth();
+    stats.nRejected = workQueue->Rejected();
+    stats.vQueueTime = g_http_queue_time.Get();
+    stats.vServiceTime = g_http_service_time.Get();
+    return true;
+}
+
+/** Calls shared by HTTPRunParallel and the helpers it queues */
+struct HTTPParallelJob
+{
+    const std::function<void(size_t)> func;
+    const size_t nCount;
+    std::atomic<size_t> nNext{0};
+    Mutex cs;
+    std::condition_variable cond;
+    size_t nDone GUARDED_BY(cs){0};
+
+    HTTPParallelJob(const std::function<void(size_t)>& _func, size_t _nCount) : func(_func), nCount(_nCount) {}
+
+    /** Make calls until none are left to claim */
+    void Work()
+    {
+        size_t nRan = 0;
+        for (size_t i = nNext++; i < nCount; i = nNext++) {
+            func(i);
+            nRan++;
+        }
+        if (nRan > 0) {
+            LOCK(cs);
+            nDone += nRan;
+            if (nDone == nCount) cond.notify_all();
+        }
+    }
+};
+
+/** Work queue item lending a worker thread to an HTTPParallelJob. The job
+ * may be finished before the item runs, in which case it does nothing. */
+class HTTPParallelHelper final : public HTTPClosure
+{
+public:
+    explicit HTTPParallelHelper(std::shared_ptr<HTTPParallelJob> _job) : job(std::move(_job)) {}
+    void operator()() override { job->Work(); }
+
+private:
+    std::shared_ptr<HTTPParallelJob> job;
+};
+
+void HTTPRunParallel(size_t nCount, const std::function<void(size_t)>& func)
+{
+    auto job = std::make_shared<HTTPParallelJob>(func, nCount);
+    if (workQueue && nCount > 1) {
+        // The calling worker takes part itself, so only borrow workers that
+        // are idle, and keep at least half of the queue for new requests
+        const size_t nHelpers = std::min({nCount - 1, (size_t)std::max(workQueue->Idle(), 0), (size_t)std::max(g_http_worker_threads - 1, 0)});
+        for (size_t i = 0; i < nHelpers; i++) {
+            if (workQueue->Depth() >= workQueue->MaxDepth() / 2) break;
+            std::unique_ptr<HTTPParallelHelper> helper(new HTTPParallelHelper(job));
+            if (!workQueue->Enqueue(helper.get())) break;
+            helper.release(); // the queue took ownership
+        }
+    }
+    job->Work();
+    // Calls are claimed before they are made, so whatever is left was
+    // claimed by a helper that is making it now
+    WAIT_LOCK(job->cs, lock);
+    while (job->nDone < nCount) {
+        job->cond.wait(lock);
+    }
+}
+
 bool UpdateHTTPServerLogging(bool enable) {
 #if LIBEVENT_VERSION_NUMBER >= 0x02010100
     if (enable) {
@@ -427,6 +489,7 @@ void StartHTTPServer()
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
     int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
     LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    g_http_worker_threads = rpcThreads;
     threadHTTP = std::thread(ThreadHTTP, eventBase);
 
     for (int i = 0; i < rpcThreads; i++) {
@@ -454,6 +517,7 @@ void StopHTTPServer()
             thread.join();
         }
         g_thread_http_workers.clear();
+        g_http_worker_threads = 0;
         delete workQueue;
         workQueue = nullptr;
     }
@@ -509,13 +573,77 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/** State of a chunked reply shared between the worker writing it and the main thread sending it */
+struct HTTPChunkedReply
+{
+    //! Set in the main thread when the connection goes away, after which the request is gone too
+    std::atomic<bool> fClosed{false};
+    //! The argument registered with the connection's close callback, main thread only
+    std::shared_ptr<HTTPChunkedReply>* pCloseArg{nullptr};
+
+    Mutex cs;
+    std::condition_variable cond;
+    //! Bytes of chunks written but not yet sent out to the client
+    size_t nPending GUARDED_BY(cs){0};
+    //! Bytes handed to libevent since its output buffer was last empty, main thread only
+    size_t nSending{0};
+
+    /** Main thread: everything handed to libevent has been sent */
+    void Sent()
+    {
+        LOCK(cs);
+        nPending -= nSending;
+        nSending = 0;
+        cond.notify_all();
+    }
+};
+
+static void http_chunked_reply_close_cb(struct evhttp_connection* conn, void* arg)
+{
+    std::shared_ptr<HTTPChunkedReply>* chunked = static_cast<std::shared_ptr<HTTPChunkedReply>*>(arg);
+    (*chunked)->fClosed = true;
+    (*chunked)->pCloseArg = nullptr;
+    {
+        // Wake up a worker waiting to write
+        LOCK((*chunked)->cs);
+        (*chunked)->cond.notify_all();
+    }
+    delete chunked;
+}
+
+/** Called once the connection's output buffer has been sent out. The reply
+ *  is kept alive until EndReplyChunks replaces this callback, or the
+ *  connection goes away, after which it isn't called anymore. */
+static void http_chunk_written_cb(struct evhttp_connection* conn, void* arg)
+{
+    static_cast<HTTPChunkedReply*>(arg)->Sent();
+}
+
+/** Re-enable reading from the socket. This is the second part of the libevent
+ *  workaround in http_request_cb. */
+static void ReenableReading(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
                                                        replySent(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && chunkedReply) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndReplyChunks();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -579,17 +707,88 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        ReenableReading(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::StartReplyChunks(int nStatus)
+{
+    assert(!replySent && !chunkedReply && req);
+    if (ShutdownRequested()) {
+        WriteHeader("Connection", "close");
+    }
+    chunkedReply = std::make_shared<HTTPChunkedReply>();
+    auto req_copy = req;
+    auto chunked = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, chunked, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+        // Learn when the client goes away, as libevent frees the request then
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) {
+            chunked->pCloseArg = new std::shared_ptr<HTTPChunkedReply>(chunked);
+            evhttp_connection_set_closecb(conn, http_chunked_reply_close_cb, chunked->pCloseArg);
+        }
+    });
+    ev->trigger(nullptr);
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && chunkedReply && req);
+    if (chunkedReply->fClosed) {
+        return false;
+    }
+    {
+        // Don't run ahead of a slow client, which would buffer the whole reply
+        WAIT_LOCK(chunkedReply->cs, lock);
+        while (chunkedReply->nPending >= MAX_CHUNKED_REPLY_PENDING && !chunkedReply->fClosed && !ShutdownRequested()) {
+            chunkedReply->cond.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (chunkedReply->nPending >= MAX_CHUNKED_REPLY_PENDING) {
+            return false;
+        }
+        chunkedReply->nPending += strChunk.size();
+    }
+    struct evbuffer* evb = evbuffer_new();
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    auto req_copy = req;
+    auto chunked = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, chunked, evb]{
+        if (!chunked->fClosed) {
+            chunked->nSending += evbuffer_get_length(evb);
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+            evhttp_send_reply_chunk_with_cb(req_copy, evb, http_chunk_written_cb, chunked.get());
+#else
+            // No way to learn when it is sent, so only the main thread's pace is kept
+            evhttp_send_reply_chunk(req_copy, evb);
+            chunked->Sent();
+#endif
+        }
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+    return true;
+}
+
+void HTTPRequest::EndReplyChunks()
+{
+    assert(!replySent && chunkedReply && req);
+    auto req_copy = req;
+    auto chunked = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, chunked]{
+        if (chunked->fClosed) {
+            return;
+        }
+        if (chunked->pCloseArg) {
+            evhttp_connection_set_closecb(evhttp_request_get_connection(req_copy), nullptr, nullptr);
+            delete chunked->pCloseArg;
+            chunked->pCloseArg = nullptr;
         }
+        evhttp_send_reply_end(req_copy);
+        ReenableReading(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
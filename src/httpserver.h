@@ -8,15 +8,18 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS=4;
-static const int DEFAULT_HTTP_WORKQUEUE=16;
+static const int DEFAULT_HTTP_WORKQUEUE=64;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReply;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -32,6 +35,31 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Statistics of the HTTP work queue */
+struct HTTPWorkQueueStats
+{
+    //! Requests waiting for a worker thread
+    size_t nDepth;
+    size_t nMaxDepth;
+    //! Requests rejected because the queue was full
+    uint64_t nRejected;
+    //! Histograms of the time requests waited and were handled in: entry i
+    //! counts those that took less than 2^i microseconds, but not less than half that
+    std::vector<uint64_t> vQueueTime;
+    std::vector<uint64_t> vServiceTime;
+};
+
+/** Get statistics of the HTTP work queue. Returns false if the server is not running. */
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats);
+
+/**
+ * Call func(0) .. func(nCount - 1), spreading the calls over the idle HTTP
+ * worker threads as well as the calling one, and return once all are done.
+ * Calls run one after another if the server is not running or no worker
+ * threads are idle.
+ */
+void HTTPRunParallel(size_t nCount, const std::function<void(size_t)>& func);
+
 /** Change logging level for libevent. Removes BCLog::LIBEVENT from log categories if
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
@@ -59,6 +87,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    std::shared_ptr<HTTPChunkedReply> chunkedReply;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -114,6 +143,22 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start an HTTP reply whose body is sent in chunks as it is written with
+     * WriteReplyChunk, instead of all at once with WriteReply.
+     *
+     * @note Write the headers before, and finish with EndReplyChunks.
+     */
+    void StartReplyChunks(int nStatus);
+    /**
+     * Send a chunk of the body, first waiting for the client to receive most
+     * of what was sent before. Returns false once the client has gone away,
+     * or if it is still behind at shutdown.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+    /** Finish a chunked reply. Like WriteReply, this gives the request back to the main thread. */
+    void EndReplyChunks();
 };
 
 /** Event handler closure.
@@ -0,0 +1,146 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iblt.h>
+
+#include <crypto/siphash.h>
+#include <random.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+const int CIblt::NUM_HASH_FUNCS;
+const size_t CIblt::MIN_CELLS;
+const size_t CIblt::MAX_CELLS;
+
+/** Short ids are uniformly distributed already, so cheap mixing suffices to pick cells */
+static inline uint64_t Mix(uint64_t x)
+{
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    return x;
+}
+
+static inline uint32_t CheckSum(uint64_t nKey)
+{
+    return Mix(nKey ^ 0x94d049bb133111ebULL) >> 32;
+}
+
+CIblt::CIblt(size_t nCells) : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+    nCells = std::min(std::max(nCells, MIN_CELLS), MAX_CELLS);
+    vCells.resize(nCells - nCells % NUM_HASH_FUNCS);
+}
+
+CIblt CIblt::EmptyLike(const CIblt& other)
+{
+    CIblt iblt;
+    iblt.k0 = other.k0;
+    iblt.k1 = other.k1;
+    iblt.vCells.resize(other.vCells.size());
+    return iblt;
+}
+
+size_t CIblt::CellsForSetSize(size_t nItems)
+{
+    // Listing succeeds with high probability while the difference stays under
+    // about 2/3 of the cells with three hash functions
+    return nItems / 8 * 3 / 2 + MIN_CELLS;
+}
+
+uint64_t CIblt::GetShortID(const uint256& hash) const
+{
+    return SipHashUint256(k0, k1, hash);
+}
+
+size_t CIblt::GetCell(uint64_t nKey, int nHashNum) const
+{
+    const uint64_t nSubtableSize = vCells.size() / NUM_HASH_FUNCS;
+    const uint64_t nHash = Mix(nKey + nHashNum * 0x9e3779b97f4a7c15ULL) >> 32;
+    return nHashNum * nSubtableSize + ((nHash * nSubtableSize) >> 32);
+}
+
+void CIblt::Update(uint64_t nKey, int nDirection)
+{
+    if (vCells.empty()) return;
+    const uint32_t nCheckSum = CheckSum(nKey);
+    for (int i = 0; i < NUM_HASH_FUNCS; i++) {
+        CIbltCell& cell = vCells[GetCell(nKey, i)];
+        cell.nCount += nDirection;
+        cell.nKeySum ^= nKey;
+        cell.nCheckSum ^= nCheckSum;
+    }
+}
+
+bool CIblt::Subtract(const CIblt& other)
+{
+    if (k0 != other.k0 || k1 != other.k1 || vCells.size() != other.vCells.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < vCells.size(); i++) {
+        vCells[i].nCount -= other.vCells[i].nCount;
+        vCells[i].nKeySum ^= other.vCells[i].nKeySum;
+        vCells[i].nCheckSum ^= other.vCells[i].nCheckSum;
+    }
+    return true;
+}
+
+bool CIblt::Decode(std::set<uint64_t>& setPositiveRet, std::set<uint64_t>& setNegativeRet) const
+{
+    // Peel cells holding a single entry until none is left
+    CIblt work(*this);
+    std::vector<size_t> vPending(vCells.size());
+    for (size_t i = 0; i < vPending.size(); i++) {
+        vPending[i] = i;
+    }
+    size_t nPeeled = 0;
+    while (!vPending.empty()) {
+        const CIbltCell& cell = work.vCells[vPending.back()];
+        vPending.pop_back();
+        if ((cell.nCount != 1 && cell.nCount != -1) || cell.nCheckSum != CheckSum(cell.nKeySum)) {
+            continue;
+        }
+        const uint64_t nKey = cell.nKeySum;
+        const int nDirection = cell.nCount;
+        std::set<uint64_t>& setRet = nDirection > 0 ? setPositiveRet : setNegativeRet;
+        if (!setRet.insert(nKey).second || ++nPeeled > vCells.size()) {
+            // Only a corrupted table lists an entry twice
+            return false;
+        }
+        work.Update(nKey, -nDirection);
+        for (int i = 0; i < NUM_HASH_FUNCS; i++) {
+            vPending.push_back(work.GetCell(nKey, i));
+        }
+    }
+    return std::all_of(work.vCells.begin(), work.vCells.end(), [](const CIbltCell& cell) { return cell.IsEmpty(); });
+}
+
+bool CIblt::GetMissing(const std::vector<uint256>& vHashes, std::set<uint256>& setMissingRet) const
+{
+    CIblt ours = EmptyLike(*this);
+    std::map<uint64_t, const uint256*> mapShortIds;
+    for (const uint256& hash : vHashes) {
+        uint64_t nShortId = ours.GetShortID(hash);
+        if (mapShortIds.emplace(nShortId, &hash).second) {
+            ours.Update(nShortId, 1);
+        }
+    }
+    ours.Subtract(*this);
+
+    std::set<uint64_t> setOnlyOurs, setOnlyTheirs;
+    if (!ours.Decode(setOnlyOurs, setOnlyTheirs)) {
+        return false;
+    }
+    for (uint64_t nShortId : setOnlyOurs) {
+        auto it = mapShortIds.find(nShortId);
+        if (it == mapShortIds.end()) {
+            // The difference can't be right if it lists something we don't have
+            return false;
+        }
+        setMissingRet.insert(*it->second);
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_IBLT_H
+#define BITCOIN_IBLT_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <ios>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+/** One cell of an invertible bloom lookup table */
+struct CIbltCell
+{
+    int32_t nCount{0};
+    uint64_t nKeySum{0};
+    uint32_t nCheckSum{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nCount);
+        READWRITE(nKeySum);
+        READWRITE(nCheckSum);
+    }
+
+    bool IsEmpty() const { return nCount == 0 && nKeySum == 0 && nCheckSum == 0; }
+};
+
+/**
+ * Invertible bloom lookup table over salted 64-bit short ids of hashes, used
+ * to reconcile two sets that are mostly equal. A peer sends the table of its
+ * set; subtracting it from the table of our set leaves only the entries of
+ * the symmetric difference, which can be listed as long as the difference is
+ * small compared to the number of cells. Its size thus only depends on the
+ * expected difference, not on the size of the sets.
+ */
+class CIblt
+{
+private:
+    /** Salt of the short ids, chosen by the peer building the table */
+    uint64_t k0{0}, k1{0};
+    std::vector<CIbltCell> vCells;
+
+    void Update(uint64_t nKey, int nDirection);
+    size_t GetCell(uint64_t nKey, int nHashNum) const;
+
+public:
+    /** Each key is stored in one cell of each of this many equally sized subtables */
+    static const int NUM_HASH_FUNCS = 3;
+    static const size_t MIN_CELLS = 48;
+    /** Up to 1 MB on the wire */
+    static const size_t MAX_CELLS = 65535;
+
+    // Dummy for deserialization
+    CIblt() {}
+
+    /** Create a table of about nCells cells (rounded to the limits), salted with a random key */
+    explicit CIblt(size_t nCells);
+
+    /** Create an empty table with the size and salt of another one */
+    static CIblt EmptyLike(const CIblt& other);
+
+    /** Number of cells able to list a difference between two sets of up to nItems items, expected to be under an eighth of them */
+    static size_t CellsForSetSize(size_t nItems);
+
+    uint64_t GetShortID(const uint256& hash) const;
+
+    void Insert(const uint256& hash) { Update(GetShortID(hash), 1); }
+    void Erase(const uint256& hash) { Update(GetShortID(hash), -1); }
+
+    /** Subtract a table of the same size and salt, returns false if they don't match */
+    bool Subtract(const CIblt& other);
+
+    /**
+     * List the short ids inserted more often than erased (setPositiveRet) and
+     * the other way round (setNegativeRet). Returns false if the table holds
+     * too many entries to be listed completely.
+     */
+    bool Decode(std::set<uint64_t>& setPositiveRet, std::set<uint64_t>& setNegativeRet) const;
+
+    /**
+     * Find which of our hashes are missing from the set this table was built
+     * from. Returns false if the sets differ too much for this table.
+     */
+    bool GetMissing(const std::vector<uint256>& vHashes, std::set<uint256>& setMissingRet) const;
+
+    size_t size() const { return vCells.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(k0);
+        READWRITE(k1);
+        READWRITE(vCells);
+        if (ser_action.ForRead() && (vCells.size() > MAX_CELLS || vCells.size() % NUM_HASH_FUNCS != 0)) {
+            throw std::ios_base::failure("invalid iblt size");
+        }
+    }
+};
+
+#endif // BITCOIN_IBLT_H
@@ -58,6 +58,7 @@
 #include <netfulfilledman.h>
 
 #include <modules/masternode/activemasternode.h>
+#include <modules/masternode/masternode_compact.h>
 #include <modules/coinjoin/coinjoin_analyzer.h>
 #include <modules/masternode/masternode_payments.h>
 #include <modules/masternode/masternode_sync.h>
@@ -85,6 +86,7 @@
 #if ENABLE_ZMQ
 #include <zmq/zmqabstractnotifier.h>
 #include <zmq/zmqnotificationinterface.h>
+#include <zmq/zmqpublishnotifier.h>
 #include <zmq/zmqrpc.h>
 #endif
 
@@ -239,6 +241,10 @@ void Shutdown(InitInterfaces& interfaces)
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    if (g_block_template_cache) {
+        UnregisterValidationInterface(g_block_template_cache.get());
+        g_block_template_cache->Stop();
+    }
     if (g_connman) g_connman->Stop();
     if (g_txindex) g_txindex->Stop();
 
@@ -267,6 +273,7 @@ void Shutdown(InitInterfaces& interfaces)
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     peerLogic.reset();
+    g_block_template_cache.reset();
     g_connman.reset();
     g_banman.reset();
     g_txindex.reset();
@@ -416,6 +423,8 @@ void SetupServerArgs()
     gArgs.AddArg("-version", "Print version and exit", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcachesize=<n>", strprintf("Keep the last <n> connected blocks in memory to serve peer and RPC/REST requests (0 = disable, default: %u)", DEFAULT_RECENT_BLOCK_CACHE_SIZE), true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockmmap=<n>", strprintf("Read blocks from up to <n> memory-mapped block files instead of through stdio (0 = disable, default: %u)", DEFAULT_BLOCK_MMAP_FILES), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify blocks directory (default: <datadir>/blocks)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), false, OptionsCategory::OPTIONS);
@@ -434,6 +443,7 @@ void SetupServerArgs()
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parworkstealing", strprintf("Give every script verification thread its own work queue and let idle threads steal from the others (default: %u)", DEFAULT_SCRIPTCHECK_WORKSTEALING), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", CHAINCOIN_PID_FILENAME), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
@@ -448,6 +458,7 @@ void SetupServerArgs()
 #endif
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), false, OptionsCategory::OPTIONS);
 
+    gArgs.AddArg("-adaptivedownload", strprintf("Size the block download window and the blocks requested from each peer from measured peer speed (default: %u)", DEFAULT_ADAPTIVE_DOWNLOAD), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-addnode=<ip>", "Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info). This option can be specified multiple times to add multiple nodes.", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-banscore=<n>", strprintf("Threshold for disconnecting misbehaving peers (default: %u)", DEFAULT_BANSCORE_THRESHOLD), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-bantime=<n>", strprintf("Number of seconds to keep misbehaving peers from reconnecting (default: %u)", DEFAULT_MISBEHAVING_BANTIME), false, OptionsCategory::CONNECTION);
@@ -474,7 +485,9 @@ void SetupServerArgs()
     gArgs.AddArg("-proxy=<ip:port>", "Connect through SOCKS5 proxy, set -noproxy to disable (default: disabled)", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-proxyrandomize", strprintf("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)", DEFAULT_PROXYRANDOMIZE), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-seednode=<ip>", "Connect to a node to retrieve peer addresses, and disconnect. This option can be specified multiple times to connect to multiple nodes.", false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-socketevents=<mode>", strprintf("Socket events mode, which must be one of: %s (default: %s)", GetSupportedSocketEventsModes(), GetSocketEventsModeName(DEFAULT_SOCKETEVENTS)), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-timeout=<n>", strprintf("Specify connection timeout in milliseconds (minimum: 1, default: %d)", DEFAULT_CONNECT_TIMEOUT), false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-msghandlerthreads=<n>", strprintf("Number of threads processing peer messages. Each peer is always handled by the same thread (1 to %d, default: %d)", MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peertimeout=<n>", strprintf("Specify p2p connection timeout in seconds. This option determines the amount of time a peer may be inactive before the connection to it is dropped. (minimum: 1, default: %d)", DEFAULT_PEER_CONNECT_TIMEOUT), true, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torpassword=<pass>", "Tor control port password (default: empty)", false, OptionsCategory::CONNECTION);
@@ -500,12 +513,18 @@ void SetupServerArgs()
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashgovernancevote=<address>", "Enable publish hash of funding votes in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashgovernanceobject=<address>", "Enable publish hash of funding objects (like proposals) in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubbatchrawtx=<address>", "Enable publish raw transactions in batches in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubbatchrawtxsize=<n>", strprintf("Set the most transactions published in one batch (default: %d)", DEFAULT_ZMQ_BATCHRAWTX_SIZE), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubhashmasternodepaymentvote=<address>", "Enable publish hash of masternode payment votes in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawmasternodepaymentvote=<address>", "Enable publish raw masternode payment votes in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawmasternodelistdiff=<address>", "Enable publish masternode list changes in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashgovernancevotehwm=<n>", strprintf("Set publish hash of funding votes message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashgovernanceobjecthwm=<n>", strprintf("Set publish hash of funding objects (like proposals) message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubbatchrawtxhwm=<n>", strprintf("Set publish raw transactions in batches outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
@@ -513,12 +532,18 @@ void SetupServerArgs()
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
     hidden_args.emplace_back("-zmqpubhashgovernancevote=<address>");
     hidden_args.emplace_back("-zmqpubhashgovernanceobject=<address>");
+    hidden_args.emplace_back("-zmqpubbatchrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubbatchrawtxsize=<n>");
+    hidden_args.emplace_back("-zmqpubhashmasternodepaymentvote=<address>");
+    hidden_args.emplace_back("-zmqpubrawmasternodepaymentvote=<address>");
+    hidden_args.emplace_back("-zmqpubrawmasternodelistdiff=<address>");
     hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashgovernancevotehwm=<n>");
     hidden_args.emplace_back("-zmqpubhashgovernanceobjecthwm=<n>");
+    hidden_args.emplace_back("-zmqpubbatchrawtxhwm=<n>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
@@ -566,6 +591,8 @@ void SetupServerArgs()
     gArgs.AddArg("-mnconf=<file>", strprintf(_("Specify masternode configuration file (default: %s)"), "masternode.conf"), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), 1), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-masternodeprivkey=<n>", _("Set the masternode private key"), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-compactmnpings", strprintf("Exchange masternode pings in compact batches with peers supporting it (default: %u)", DEFAULT_COMPACT_MNPINGS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-syncrecon", strprintf("Sync the masternode list and governance data by reconciling ours with peers supporting it, rather than downloading their full inventory (default: %u)", DEFAULT_SYNC_RECON), false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-acceptnonstdtxn", strprintf("Relay and mine \"non-standard\" transactions (%sdefault: %u)", "testnet/regtest only; ", !testnetChainParams->RequireStandard()), true, OptionsCategory::NODE_RELAY);
     gArgs.AddArg("-incrementalrelayfee=<amt>", strprintf("Fee rate (in %s/kB) used to define cost of relay, used for mempool limiting and BIP 125 replacement. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_INCREMENTAL_RELAY_FEE)), true, OptionsCategory::NODE_RELAY);
@@ -582,6 +609,7 @@ void SetupServerArgs()
 
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-blocktemplatecache", strprintf("Keep a block template up to date in the background once getblocktemplate is used (default: %u)", DEFAULT_BLOCK_TEMPLATE_CACHE), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", true, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), false, OptionsCategory::RPC);
@@ -953,6 +981,7 @@ int nUserMaxConnections;
 int nFD;
 ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_NETWORK_LIMITED);
 int64_t peer_connect_timeout;
+SocketEventsMode socket_events_mode;
 
 } // namespace
 
@@ -1156,6 +1185,11 @@ bool AppInitParameterInteraction()
         return InitError("peertimeout cannot be configured with a negative value.");
     }
 
+    std::string strSocketEventsMode = gArgs.GetArg("-socketevents", GetSocketEventsModeName(DEFAULT_SOCKETEVENTS));
+    if (!ParseSocketEventsMode(strSocketEventsMode, socket_events_mode)) {
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), strSocketEventsMode, GetSupportedSocketEventsModes()));
+    }
+
     if (gArgs.IsArgSet("-minrelaytxfee")) {
         CAmount n = 0;
         if (!ParseMoney(gArgs.GetArg("-minrelaytxfee", ""), n)) {
@@ -1339,9 +1373,15 @@ bool AppInitMain(InitInterfaces& interfaces)
     InitScriptExecutionCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    if (nScriptCheckThreads && gArgs.GetBoolArg("-parworkstealing", DEFAULT_SCRIPTCHECK_WORKSTEALING)) {
+        LogPrintf("Using work stealing for script verification\n");
+        EnableScriptCheckWorkStealing(nScriptCheckThreads);
+    }
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<std::min(nScriptCheckThreads, MAX_HEADER_HASH_THREADS)-1; i++)
+            threadGroup.create_thread(&ThreadHeaderHash);
     }
 
     // Start the lightweight task scheduler thread
@@ -1401,9 +1441,15 @@ bool AppInitMain(InitInterfaces& interfaces)
     assert(!g_connman);
     g_connman = std::unique_ptr<CConnman>(new CConnman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())));
 
-    peerLogic.reset(new PeerLogicValidation(g_connman.get(), g_banman.get(), scheduler, gArgs.GetBoolArg("-enablebip61", DEFAULT_ENABLE_BIP61)));
+    peerLogic.reset(new PeerLogicValidation(g_connman.get(), g_banman.get(), scheduler, gArgs.GetBoolArg("-enablebip61", DEFAULT_ENABLE_BIP61), gArgs.GetBoolArg("-adaptivedownload", DEFAULT_ADAPTIVE_DOWNLOAD)));
     RegisterValidationInterface(peerLogic.get());
 
+    if (gArgs.GetBoolArg("-blocktemplatecache", DEFAULT_BLOCK_TEMPLATE_CACHE)) {
+        g_block_template_cache = MakeUnique<BlockTemplateCache>(chainparams);
+        g_block_template_cache->Start();
+        RegisterValidationInterface(g_block_template_cache.get());
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string& cmt : gArgs.GetArgs("-uacomment")) {
@@ -1536,6 +1582,18 @@ bool AppInitMain(InitInterfaces& interfaces)
     }
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    int64_t nBlockMapFiles = std::max<int64_t>(0, gArgs.GetArg("-blockmmap", DEFAULT_BLOCK_MMAP_FILES));
+#ifdef WIN32
+    if (nBlockMapFiles > 0) {
+        LogPrintf("Memory-mapped block reads are not supported on this platform, ignoring -blockmmap\n");
+        nBlockMapFiles = 0;
+    }
+#endif
+    if (nBlockMapFiles > 0) {
+        LogPrintf("* Keeping up to %d block files memory-mapped for reads\n", nBlockMapFiles);
+    }
+    SetBlockFileMapLimit(nBlockMapFiles);
+    SetRecentBlockCacheSize(std::max<int64_t>(0, gArgs.GetArg("-blockcachesize", DEFAULT_RECENT_BLOCK_CACHE_SIZE)));
 
     bool fLoaded = false;
 
@@ -1832,6 +1890,13 @@ bool AppInitMain(InitInterfaces& interfaces)
 
     LogPrintf("fLiteMode %d\n", fLiteMode);
 
+    if (!fLiteMode && gArgs.GetBoolArg("-compactmnpings", DEFAULT_COMPACT_MNPINGS)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_MNPING);
+    }
+    if (!fLiteMode && gArgs.GetBoolArg("-syncrecon", DEFAULT_SYNC_RECON)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_SYNC_RECON);
+    }
+
     // ********************************************************* Step 11b: Load cache data
 
     // LOAD SERIALIZED DAT FILES INTO DATA CACHES FOR INTERNAL USE
@@ -1939,6 +2004,8 @@ bool AppInitMain(InitInterfaces& interfaces)
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
+    connOptions.socketEventsMode = socket_events_mode;
+    connOptions.nMessageHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
 
     for (const std::string& strBind : gArgs.GetArgs("-bind")) {
         CService addrBind;
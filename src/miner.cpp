@@ -448,3 +448,147 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+std::unique_ptr<BlockTemplateCache> g_block_template_cache;
+
+static CAmount GetTemplateFees(const CBlockTemplate& blocktemplate)
+{
+    // The coinbase entry holds the negated sum of all fees
+    return blocktemplate.vTxFees.empty() ? 0 : -blocktemplate.vTxFees[0];
+}
+
+BlockTemplateCache::BlockTemplateCache(const CChainParams& params) : chainparams(params) {}
+
+BlockTemplateCache::~BlockTemplateCache()
+{
+    Stop();
+}
+
+void BlockTemplateCache::Start()
+{
+    m_thread = std::thread(&TraceThread<std::function<void()> >, "blktmpl", std::function<void()>(std::bind(&BlockTemplateCache::ThreadUpdate, this)));
+}
+
+void BlockTemplateCache::Stop()
+{
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void BlockTemplateCache::ScheduleUpdate(int64_t nDelayMilliSeconds, bool fForce)
+{
+    if (!m_active) return;
+    // A forced rebuild may move a pending one forward, other changes wait for it
+    const int64_t nTime = GetTimeMillis() + nDelayMilliSeconds;
+    if (m_update_time == 0 || (fForce && nTime < m_update_time)) {
+        m_update_time = nTime;
+        m_cond.notify_all();
+    }
+}
+
+void BlockTemplateCache::ThreadUpdate()
+{
+    while (true) {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            while (!m_stop && (m_update_time == 0 || GetTimeMillis() < m_update_time)) {
+                if (m_update_time == 0) {
+                    m_cond.wait(lock);
+                } else {
+                    m_cond.wait_for(lock, std::chrono::milliseconds(m_update_time - GetTimeMillis()));
+                }
+            }
+            if (m_stop) return;
+            m_update_time = 0;
+        }
+        Update();
+    }
+}
+
+void BlockTemplateCache::Update()
+{
+    if (IsInitialBlockDownload()) return;
+
+    // Read before selecting transactions, so changes made meanwhile make the template look outdated
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    std::shared_ptr<const CBlockTemplate> pblocktemplate;
+    try {
+        pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript() << OP_TRUE);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return;
+    }
+    if (!pblocktemplate) return;
+
+    bool fNotify;
+    {
+        LOCK(m_mutex);
+        m_template = pblocktemplate;
+        m_transactions_updated = nTransactionsUpdated;
+        fNotify = FeesImproved_(pblocktemplate->block.hashPrevBlock);
+    }
+    if (fNotify) {
+        // Wake up long polls
+        LOCK(g_best_block_mutex);
+        g_best_block_cv.notify_all();
+    }
+}
+
+void BlockTemplateCache::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload) return;
+    LOCK(m_mutex);
+    ScheduleUpdate(0, true);
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef &ptxn)
+{
+    LOCK(m_mutex);
+    ScheduleUpdate(BLOCK_TEMPLATE_UPDATE_INTERVAL, false);
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef &ptx)
+{
+    LOCK(m_mutex);
+    ScheduleUpdate(BLOCK_TEMPLATE_UPDATE_INTERVAL, false);
+}
+
+std::shared_ptr<const CBlockTemplate> BlockTemplateCache::Get(const CBlockIndex* pindexPrev, unsigned int& nTransactionsUpdatedRet)
+{
+    LOCK(m_mutex);
+    if (!m_active) {
+        m_active = true;
+        ScheduleUpdate(0, true);
+    }
+    if (!m_template || m_template->block.hashPrevBlock != pindexPrev->GetBlockHash()) {
+        return nullptr;
+    }
+    nTransactionsUpdatedRet = m_transactions_updated;
+    return m_template;
+}
+
+void BlockTemplateCache::SetServed(const CBlockTemplate& blocktemplate)
+{
+    LOCK(m_mutex);
+    m_served_prev_block = blocktemplate.block.hashPrevBlock;
+    m_served_fees = GetTemplateFees(blocktemplate);
+}
+
+bool BlockTemplateCache::FeesImproved_(const uint256& hashPrevBlock) const
+{
+    if (!m_template || m_template->block.hashPrevBlock != hashPrevBlock || m_served_prev_block != hashPrevBlock) {
+        return false;
+    }
+    const CAmount nFees = GetTemplateFees(*m_template);
+    return nFees > m_served_fees && (nFees - m_served_fees) * 100 >= m_served_fees * BLOCK_TEMPLATE_FEE_IMPROVEMENT_PERCENT;
+}
+
+bool BlockTemplateCache::FeesImproved(const uint256& hashPrevBlock) const
+{
+    LOCK(m_mutex);
+    return FeesImproved_(hashPrevBlock);
+}
@@ -8,11 +8,15 @@
 
 #include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
+#include <condition_variable>
 #include <memory>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -24,6 +28,12 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blocktemplatecache */
+static const bool DEFAULT_BLOCK_TEMPLATE_CACHE = true;
+/** Time (in milliseconds) mempool changes are collected before the cached block template is rebuilt */
+static const int64_t BLOCK_TEMPLATE_UPDATE_INTERVAL = 1000;
+/** Increase in fees (in percent) of the cached block template that ends getblocktemplate long polls */
+static const int BLOCK_TEMPLATE_FEE_IMPROVEMENT_PERCENT = 5;
 
 struct CBlockTemplate
 {
@@ -202,4 +212,65 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/**
+ * Keeps a block template for the current tip ready for getblocktemplate. Once
+ * asked for a template, it rebuilds it on its own thread when a new tip is
+ * connected and shortly after the mempool changes, so getblocktemplate
+ * doesn't have to select transactions and validate the block itself.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+private:
+    const CChainParams& chainparams;
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    std::shared_ptr<const CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    //! Mempool update count the template was built at
+    unsigned int m_transactions_updated GUARDED_BY(m_mutex){0};
+    //! Whether a template was asked for, templates are only maintained from then on
+    bool m_active GUARDED_BY(m_mutex){false};
+    //! When (in milliseconds) the next rebuild is due, 0 if none is
+    int64_t m_update_time GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    //! Parent and fees of the last template handed out
+    uint256 m_served_prev_block GUARDED_BY(m_mutex);
+    CAmount m_served_fees GUARDED_BY(m_mutex){0};
+
+    void ScheduleUpdate(int64_t nDelayMilliSeconds, bool fForce) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void ThreadUpdate();
+    bool FeesImproved_(const uint256& hashPrevBlock) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef &ptxn) override;
+    void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
+
+public:
+    explicit BlockTemplateCache(const CChainParams& params);
+    ~BlockTemplateCache();
+
+    /** Start and stop the thread rebuilding the template */
+    void Start();
+    void Stop();
+
+    /** Rebuild the template now, normally done by the thread */
+    void Update();
+
+    /**
+     * Get the latest template built on pindexPrev, along with the mempool update
+     * count it reflects, or nullptr if there is none yet.
+     */
+    std::shared_ptr<const CBlockTemplate> Get(const CBlockIndex* pindexPrev, unsigned int& nTransactionsUpdatedRet);
+
+    /** Remember the template handed out, to tell when later ones pay materially more fees */
+    void SetServed(const CBlockTemplate& blocktemplate);
+
+    /** Whether the latest template on hashPrevBlock pays materially more fees than the one handed out */
+    bool FeesImproved(const uint256& hashPrevBlock) const;
+};
+
+extern std::unique_ptr<BlockTemplateCache> g_block_template_cache;
+
 #endif // BITCOIN_MINER_H
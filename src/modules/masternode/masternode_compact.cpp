@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <modules/masternode/masternode_compact.h>
+
+#include <crypto/sha256.h>
+#include <crypto/siphash.h>
+#include <random.h>
+#include <streams.h>
+#include <version.h>
+
+#include <limits>
+
+CMasternodePingBatch::CMasternodePingBatch(const std::vector<std::pair<CMasternodePing, int>>& vPingsIn) :
+        CMasternodePingBatch(vPingsIn, GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+CMasternodePingBatch::CMasternodePingBatch(const std::vector<std::pair<CMasternodePing, int>>& vPingsIn, uint64_t nonceIn) :
+        nonce(nonceIn), vPings(vPingsIn.size())
+{
+    FillShortIDSelector();
+    for (size_t i = 0; i < vPingsIn.size(); i++) {
+        const CMasternodePing& mnp = vPingsIn[i].first;
+        CCompactMasternodePing& cmnp = vPings[i];
+        cmnp.nShortId = GetShortID(mnp.masternodeOutpoint);
+        cmnp.nBlockHeight = vPingsIn[i].second;
+        cmnp.sigTime = mnp.sigTime;
+        cmnp.vchSig = mnp.vchSig;
+        cmnp.fSentinelIsCurrent = mnp.fSentinelIsCurrent;
+        cmnp.nSentinelVersion = mnp.nSentinelVersion;
+        cmnp.nDaemonVersion = mnp.nDaemonVersion;
+    }
+}
+
+void CMasternodePingBatch::FillShortIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << nonce;
+    CSHA256 hasher;
+    hasher.Write((unsigned char*)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shortidhash;
+    hasher.Finalize(shortidhash.begin());
+    shortidk0 = shortidhash.GetUint64(0);
+    shortidk1 = shortidhash.GetUint64(1);
+}
+
+uint64_t CMasternodePingBatch::GetShortID(const COutPoint& outpoint) const
+{
+    static_assert(CCompactMasternodePing::SHORTID_LENGTH == 6, "short id calculation assumes 6-byte short ids");
+    return SipHashUint256Extra(shortidk0, shortidk1, outpoint.hash, outpoint.n) & 0xffffffffffffL;
+}
+
+CMasternodePing CMasternodePingBatch::GetPing(size_t nIndex, const COutPoint& outpoint, const uint256& blockHash) const
+{
+    const CCompactMasternodePing& cmnp = vPings.at(nIndex);
+    CMasternodePing mnp;
+    mnp.masternodeOutpoint = outpoint;
+    mnp.blockHash = blockHash;
+    mnp.sigTime = cmnp.sigTime;
+    mnp.vchSig = cmnp.vchSig;
+    mnp.fSentinelIsCurrent = cmnp.fSentinelIsCurrent;
+    mnp.nSentinelVersion = cmnp.nSentinelVersion;
+    mnp.nDaemonVersion = cmnp.nDaemonVersion;
+    return mnp;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MODULES_MASTERNODE_MASTERNODE_COMPACT_H
+#define BITCOIN_MODULES_MASTERNODE_MASTERNODE_COMPACT_H
+
+#include <modules/masternode/masternode.h>
+#include <serialize.h>
+
+#include <ios>
+#include <utility>
+#include <vector>
+
+/** Default for -compactmnpings, relaying pings in batches to peers advertising NODE_COMPACT_MNPING */
+static const bool DEFAULT_COMPACT_MNPINGS = true;
+
+/**
+ * A masternode ping with its masternode outpoint replaced by a short id and
+ * its block hash replaced by the block height, which the receiver resolves
+ * against its own masternode list and active chain.
+ */
+class CCompactMasternodePing
+{
+public:
+    static const int SHORTID_LENGTH = 6;
+
+    uint64_t nShortId{0};
+    int nBlockHeight{0};
+    int64_t sigTime{0};
+    std::vector<unsigned char> vchSig;
+    bool fSentinelIsCurrent{false};
+    uint32_t nSentinelVersion{0};
+    uint32_t nDaemonVersion{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        static_assert(SHORTID_LENGTH == 6, "short id serialization assumes 6-byte short ids");
+        uint32_t lsb = nShortId & 0xffffffff;
+        uint16_t msb = (nShortId >> 32) & 0xffff;
+        READWRITE(lsb);
+        READWRITE(msb);
+        if (ser_action.ForRead()) {
+            nShortId = (uint64_t(msb) << 32) | uint64_t(lsb);
+        }
+        READWRITE(VARINT(nBlockHeight, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(VARINT(sigTime, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(vchSig);
+        READWRITE(fSentinelIsCurrent);
+        READWRITE(VARINT(nSentinelVersion));
+        READWRITE(VARINT(nDaemonVersion));
+    }
+};
+
+/**
+ * A batch of masternode pings pushed to a peer in one "mnpings" message,
+ * instead of an inv/getdata round trip and a full "mnp" message per ping.
+ * Short ids are salted, like the short transaction ids of compact blocks, so
+ * collisions can't be precomputed. A sender reuses its salt for a while, so
+ * the receiver can resolve short ids with a map it built for an earlier batch.
+ */
+class CMasternodePingBatch
+{
+private:
+    mutable uint64_t shortidk0, shortidk1;
+    uint64_t nonce;
+
+    void FillShortIDSelector() const;
+
+public:
+    static const size_t MAX_PINGS = 1000;
+
+    std::vector<CCompactMasternodePing> vPings;
+
+    // Dummy for deserialization
+    CMasternodePingBatch() {}
+
+    /** Encode pings, each given with the height of its block in our active chain, salting short ids with nonceIn */
+    CMasternodePingBatch(const std::vector<std::pair<CMasternodePing, int>>& vPingsIn, uint64_t nonceIn);
+    /** Same with a random salt */
+    explicit CMasternodePingBatch(const std::vector<std::pair<CMasternodePing, int>>& vPingsIn);
+
+    uint64_t GetNonce() const { return nonce; }
+    uint64_t GetShortID(const COutPoint& outpoint) const;
+
+    /** Rebuild ping nIndex from the outpoint and block hash its short id and height resolved to */
+    CMasternodePing GetPing(size_t nIndex, const COutPoint& outpoint, const uint256& blockHash) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nonce);
+        READWRITE(vPings);
+        if (ser_action.ForRead()) {
+            if (vPings.size() > MAX_PINGS) {
+                throw std::ios_base::failure("too many pings in batch");
+            }
+            FillShortIDSelector();
+        }
+    }
+};
+
+#endif // BITCOIN_MODULES_MASTERNODE_MASTERNODE_COMPACT_H
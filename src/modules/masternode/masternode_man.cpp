@@ -6,11 +6,14 @@
 
 #include <addrman.h>
 #include <clientversion.h>
+#include <iblt.h>
 #include <init.h>
 #include <interfaces/chain.h>
 #include <messagesigner.h>
+#include <modules/coinjoin/coinjoin.h>
 #include <modules/platform/funding.h>
 #include <modules/masternode/activemasternode.h>
+#include <modules/masternode/masternode_compact.h>
 #include <modules/masternode/masternode_payments.h>
 #include <modules/masternode/masternode_sync.h>
 #include <netfulfilledman.h>
@@ -20,11 +23,14 @@
 #include <shutdown.h>
 #include <ui_interface.h>
 #include <util/system.h>
+#include <validationinterface.h>
 #include <warnings.h>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
+#include <unordered_map>
+
 /** Masternode manager */
 CMasternodeMan mnodeman;
 
@@ -86,7 +92,9 @@ bool CMasternodeMan::Add(CMasternode &mn)
     LogPrint(BCLog::MNODE, "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     uiInterface.NotifyMasternodeChanged(mn.outpoint, CT_NEW);
     mapMasternodes[mn.outpoint] = mn;
+    nListGeneration++;
     fMasternodesAdded = true;
+    PublishListSnapshot();
     return true;
 }
 
@@ -129,6 +137,7 @@ bool CMasternodeMan::PoSeBan(const COutPoint &outpoint)
         return false;
     }
     pmn->PoSeBan();
+    PublishListSnapshot();
 
     return true;
 }
@@ -144,6 +153,7 @@ void CMasternodeMan::Check()
         // since the last time, so expect some MNs to skip this
         mnpair.second.Check();
     }
+    PublishListSnapshot();
 }
 
 void CMasternodeMan::CheckAndRemove(CConnman* connman)
@@ -179,6 +189,7 @@ void CMasternodeMan::CheckAndRemove(CConnman* connman)
                 it->second.FlagGovernanceItemsAsDirty();
                 uiInterface.NotifyMasternodeChanged(it->first, CT_DELETED);
                 mapMasternodes.erase(it++);
+                nListGeneration++;
                 fMasternodesRemoved = true;
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
@@ -236,6 +247,7 @@ void CMasternodeMan::CheckAndRemove(CConnman* connman)
                 ++itMnbReplies;
             }
         }
+        PublishListSnapshot();
     }
     {
         // no need for cm_main below
@@ -335,12 +347,15 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    nListGeneration++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    if (pfilterRejectedPings) pfilterRejectedPings->reset();
     nLastSentinelPingTime = 0;
+    PublishListSnapshot();
 }
 
 int CMasternodeMan::CountMasternodes(int nProtocolVersion)
@@ -371,6 +386,74 @@ int CMasternodeMan::CountEnabled(int nProtocolVersion)
     return nCount;
 }
 
+void CMasternodeMan::CountPaymentQueue()
+{
+    int nHeight;
+    {
+        LOCK(cs);
+        nHeight = nCachedBlockHeight;
+        if (nPaymentQueueHeight == nHeight) return;
+    }
+
+    // Ranking the payment queue is costly, so it is done once per block
+    int nCount = 0;
+    masternode_info_t mnInfo;
+    GetNextMasternodeInQueueForPayment(nHeight, true, nCount, mnInfo);
+
+    LOCK(cs);
+    nPaymentQueueHeight = nHeight;
+    nPaymentQueueCount = nCount;
+}
+
+void CMasternodeMan::PublishListSnapshot()
+{
+    std::shared_ptr<CMasternodeListSnapshot> pSnapshot = std::make_shared<CMasternodeListSnapshot>();
+    const int nMinPaymentsProto = mnpayments.GetMinMasternodePaymentsProto();
+
+    LOCK(cs);
+    pSnapshot->nHeight = nCachedBlockHeight;
+    pSnapshot->nQualify = nPaymentQueueCount;
+    pSnapshot->nTotal = mapMasternodes.size();
+
+    // Both maps are in outpoint order
+    CMasternodeListDiff diff;
+    diff.nHeight = nCachedBlockHeight;
+    auto itPrev = mapSnapshotStates.begin();
+    for (const auto& mnpair : mapMasternodes) {
+        const CMasternode& mn = mnpair.second;
+        if (mn.IsEnabled()) {
+            if (mn.nProtocolVersion >= nMinPaymentsProto) pSnapshot->nEnabled++;
+            if (mn.nProtocolVersion >= MIN_COINJOIN_PEER_PROTO_VERSION) pSnapshot->nEnabledCJ++;
+        }
+
+        while (itPrev != mapSnapshotStates.end() && itPrev->first < mnpair.first) {
+            diff.vRemoved.push_back(itPrev->first);
+            itPrev = mapSnapshotStates.erase(itPrev);
+        }
+        if (itPrev != mapSnapshotStates.end() && itPrev->first == mnpair.first) {
+            if (itPrev->second != mn.nActiveState) {
+                itPrev->second = mn.nActiveState;
+                diff.vUpdated.emplace_back(mnpair.first, mn.nActiveState);
+            }
+            ++itPrev;
+        } else {
+            mapSnapshotStates.emplace_hint(itPrev, mnpair.first, mn.nActiveState);
+            diff.vUpdated.emplace_back(mnpair.first, mn.nActiveState);
+        }
+    }
+    while (itPrev != mapSnapshotStates.end()) {
+        diff.vRemoved.push_back(itPrev->first);
+        itPrev = mapSnapshotStates.erase(itPrev);
+    }
+
+    std::atomic_store(&pListSnapshot, std::shared_ptr<const CMasternodeListSnapshot>(std::move(pSnapshot)));
+
+    // Still under cs, so that listeners get the changes in order
+    if (!diff.IsEmpty()) {
+        GetMainSignals().NotifyMasternodeListChanged(diff);
+    }
+}
+
 int CMasternodeMan::CountByIP(int nNetworkType)
 {
     LOCK(cs);
@@ -386,6 +469,15 @@ int CMasternodeMan::CountByIP(int nNetworkType)
     return nNodeCount;
 }
 
+/** Entries announced to peers syncing our list, and covered by the sketch we send when syncing theirs */
+static bool IsAnnouncedOnSync(const CMasternode& mn)
+{
+    if (mn.addr.IsRFC1918() || mn.addr.IsLocal()) return false; // do not send local network masternode
+    // NOTE: send only ENABLED nodes as they are needed for payment verification. others can be processed
+    // as pings and votes are distributed. This saves bandwidth and prevents the list from uncontrolled growth.
+    return mn.IsEnabled();
+}
+
 void CMasternodeMan::DsegUpdate(CNode* pnode, CConnman* connman)
 {
     CNetMsgMaker msgMaker(pnode->GetSendVersion());
@@ -402,7 +494,22 @@ void CMasternodeMan::DsegUpdate(CNode* pnode, CConnman* connman)
         }
     }
 
-    connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, COutPoint()));
+    if (CMasternodeSync::CanReconcileWith(pnode) && !mapMasternodes.empty()) {
+        // Send a sketch of the announcements and pings the peer would send us, so only what we lack is announced
+        std::vector<uint256> vHashes;
+        for (const auto& mnpair : mapMasternodes) {
+            if (!IsAnnouncedOnSync(mnpair.second)) continue;
+            vHashes.push_back(CMasternodeBroadcast(mnpair.second).GetHash());
+            if (mnpair.second.lastPing) vHashes.push_back(mnpair.second.lastPing.GetHash());
+        }
+        CIblt sketch(CIblt::CellsForSetSize(vHashes.size()));
+        for (const uint256& hash : vHashes) {
+            sketch.Insert(hash);
+        }
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTRECON, sketch));
+    } else {
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, COutPoint()));
+    }
 
     int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
     mWeAskedForMasternodeList[addrSquashed] = askAgain;
@@ -831,43 +938,48 @@ void CMasternodeMan::ProcessModuleMessage(CNode* pfrom, const std::string& strCo
         CMasternodePing mnp;
         vRecv >> mnp;
 
-        uint256 nHash = mnp.GetHash();
-
         if (!masternodeSync.IsBlockchainSynced()) return;
 
         LogPrint(BCLog::MNODE, "MNPING -- Masternode ping, masternode=%s\n", mnp.masternodeOutpoint.ToStringShort());
 
         // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
         LOCK2(cs_main, cs);
+        ProcessPing(pfrom, mnp, false, connman);
 
-        if (mapSeenMasternodePing.count(nHash)) return; //seen
-        mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
-
-        LogPrint(BCLog::MNODE, "MNPING -- Masternode ping, masternode=%s new\n", mnp.masternodeOutpoint.ToStringShort());
+    } else if (strCommand == NetMsgType::MNPINGBATCH) { //Batch of compact Masternode Pings
 
-        // see if we have this Masternode
-        CMasternode* pmn = Find(mnp.masternodeOutpoint);
+        CMasternodePingBatch batch;
+        vRecv >> batch;
 
-        if (pmn && mnp.fSentinelIsCurrent)
-            UpdateLastSentinelPingTime();
-
-        // too late, new MNANNOUNCE is required
-        if (pmn && pmn->IsNewStartRequired()) return;
+        if (!masternodeSync.IsBlockchainSynced()) return;
 
-        int nDos = 0;
-        if (mnp.CheckAndUpdate(pmn, false, nDos, connman)) return;
+        LOCK2(cs_main, cs);
 
-        if (nDos > 0) {
-            // if anything significant failed, mark that node
-            Misbehaving(pfrom->GetId(), nDos);
-        } else if (pmn != nullptr) {
-            // nothing significant failed, mn is a known one too
-            return;
+        const std::unordered_map<uint64_t, COutPoint>& mapOutpoints = GetShortIdMap(batch);
+
+        int nUnresolved = 0;
+        int nFailed = 0;
+        for (size_t i = 0; i < batch.vPings.size(); i++) {
+            const CCompactMasternodePing& cmnp = batch.vPings[i];
+            auto it = mapOutpoints.find(cmnp.nShortId);
+            const CBlockIndex* pindex = chainActive[cmnp.nBlockHeight];
+            if (it == mapOutpoints.end() || it->second.IsNull() || pindex == nullptr) {
+                // unknown masternode or block, there is nothing to check this ping against
+                nUnresolved++;
+                continue;
+            }
+            CMasternodePing mnp = batch.GetPing(i, it->second, pindex->GetBlockHash());
+            CInv inv(MSG_MASTERNODE_PING, mnp.GetHash());
+            pfrom->AddInventoryKnown(inv);
+            EraseObjectRequest(pfrom->GetId(), inv);
+            if (!ProcessPing(pfrom, mnp, true, connman) && ++nFailed >= MAX_MNPINGBATCH_FAILURES) {
+                // Don't spend more signature checks on a batch this broken
+                LogPrint(BCLog::MNODE, "MNPINGBATCH -- dropping the rest of the batch after %d failed pings, peer=%d\n", nFailed, pfrom->GetId());
+                break;
+            }
         }
 
-        // something significant is broken or mn is unknown,
-        // we might have to ask for a masternode entry once
-        AskForMN(pfrom, mnp.masternodeOutpoint, connman);
+        LogPrint(BCLog::MNODE, "MNPINGBATCH -- %d Masternode pings, %d unresolved, %d failed, peer=%d\n", batch.vPings.size(), nUnresolved, nFailed, pfrom->GetId());
 
     } else if (strCommand == NetMsgType::DSEG) { //Get Masternode list or specific entry
         // Ignore such requests until we are fully synced.
@@ -887,6 +999,17 @@ void CMasternodeMan::ProcessModuleMessage(CNode* pfrom, const std::string& strCo
             SyncSingle(pfrom, masternodeOutpoint);
         }
 
+    } else if (strCommand == NetMsgType::MNLISTRECON) { //Get the part of Masternode list a peer lacks
+        // Same as DSEG, wait until we are fully synced
+        if (!masternodeSync.IsSynced()) return;
+
+        CIblt sketch;
+        vRecv >> sketch;
+
+        LogPrint(BCLog::MNODE, "MNLISTRECON -- Masternode list, %d cells, peer=%d\n", sketch.size(), pfrom->GetId());
+
+        SyncAll(pfrom, connman, &sketch);
+
     } else if (strCommand == NetMsgType::MNVERIFY) { // Masternode Verify
 
         // Need LOCK2 here to ensure consistent locking order because all functions below call GetBlockHash which locks cs_main
@@ -928,7 +1051,7 @@ void CMasternodeMan::SyncSingle(CNode* pnode, const COutPoint& outpoint)
     }
 }
 
-void CMasternodeMan::SyncAll(CNode* pnode, CConnman* connman)
+void CMasternodeMan::SyncAll(CNode* pnode, CConnman* connman, const CIblt* pSketch)
 {
     // do not provide any data until our node is synced
     if (!masternodeSync.IsSynced()) return;
@@ -954,32 +1077,163 @@ void CMasternodeMan::SyncAll(CNode* pnode, CConnman* connman)
 
     LOCK(cs);
 
+    std::vector<const CMasternode*> vToSend;
     for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.addr.IsRFC1918() || mnpair.second.addr.IsLocal()) continue; // do not send local network masternode
-        // NOTE: send only ENABLED nodes as they are needed for payment verification. others can be processed
-        // as pings and votes are distributed. This saves bandwidth and prevents the list from uncontrolled growth.
-        if (mnpair.second.IsEnabled()) {
-            LogPrint(BCLog::MNODE, "CMasternodeMan::%s -- Sending Masternode entry: masternode=%s  addr=%s\n", __func__, mnpair.first.ToStringShort(), mnpair.second.addr.ToString());
-            PushDsegInvs(pnode, mnpair.second);
-            nInvCount++;
+        if (IsAnnouncedOnSync(mnpair.second)) {
+            vToSend.push_back(&mnpair.second);
         }
     }
 
+    // Given a sketch of the announcements and pings the peer has, only send
+    // those it lacks. If the lists differ too much, send them all.
+    std::vector<uint256> vHashes;
+    // Where the announcement of each entry to send is in vHashes, its ping follows unless null
+    std::vector<size_t> vPos;
+    std::set<uint256> setMissing;
+    bool fReconciled = false;
+    if (pSketch) {
+        for (const CMasternode* pmn : vToSend) {
+            vPos.push_back(vHashes.size());
+            vHashes.push_back(CMasternodeBroadcast(*pmn).GetHash());
+            // Null pings are left out of the sketch on the other side too
+            if (pmn->lastPing) vHashes.push_back(pmn->lastPing.GetHash());
+        }
+        fReconciled = pSketch->GetMissing(vHashes, setMissing);
+        LogPrint(BCLog::MNODE, "CMasternodeMan::%s -- %s list of peer=%d, %d entries missing\n", __func__,
+                 fReconciled ? "reconciled" : "could not reconcile", pnode->GetId(), setMissing.size());
+    }
+
+    for (size_t i = 0; i < vToSend.size(); i++) {
+        const CMasternode& mn = *vToSend[i];
+        bool fPingOnly = false;
+        if (fReconciled && !setMissing.count(vHashes[vPos[i]])) {
+            if (!mn.lastPing || !setMissing.count(vHashes[vPos[i] + 1])) continue;
+            fPingOnly = true;
+        }
+        LogPrint(BCLog::MNODE, "CMasternodeMan::%s -- Sending Masternode entry: masternode=%s  addr=%s\n", __func__, mn.outpoint.ToStringShort(), mn.addr.ToString());
+        PushDsegInvs(pnode, mn, fPingOnly);
+        nInvCount++;
+    }
+
     connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, nInvCount));
     LogPrintf("CMasternodeMan::%s -- Sent %d Masternode invs to peer=%d\n", __func__, nInvCount, pnode->GetId());
 }
 
-void CMasternodeMan::PushDsegInvs(CNode* pnode, const CMasternode& mn)
+bool CMasternodeMan::ProcessPing(CNode* pfrom, const CMasternodePing& mnp, bool fCompact, CConnman* connman)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs);
+
+    uint256 nHash = mnp.GetHash();
+    if (mapSeenMasternodePing.count(nHash)) return true; //seen
+    if (!pfilterRejectedPings) {
+        pfilterRejectedPings.reset(new CRollingBloomFilter(MAX_REJECTED_PINGS, 0.000001));
+    }
+    if (pfilterRejectedPings->contains(nHash)) return true; //seen and not accepted
+
+    LogPrint(BCLog::MNODE, "CMasternodeMan::%s -- Masternode ping, masternode=%s new\n", __func__, mnp.masternodeOutpoint.ToStringShort());
+
+    // see if we have this Masternode
+    CMasternode* pmn = Find(mnp.masternodeOutpoint);
+
+    if (pmn && mnp.fSentinelIsCurrent)
+        UpdateLastSentinelPingTime();
+
+    // too late, new MNANNOUNCE is required
+    if (pmn && pmn->IsNewStartRequired()) {
+        pfilterRejectedPings->insert(nHash);
+        return true;
+    }
+
+    int nDos = 0;
+    CMasternodePing mnpCopy(mnp);
+    if (mnpCopy.CheckAndUpdate(pmn, false, nDos, connman)) {
+        // only pings that checked out are remembered as seen, and served to peers
+        mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
+        return true;
+    }
+    // the others are only remembered so that no peer makes us check them again
+    pfilterRejectedPings->insert(nHash);
+
+    if (nDos > 0) {
+        // if anything significant failed, mark that node. A ping rebuilt from
+        // a compact one may fail because the block at its height differs on
+        // the sender's chain, so it only scores a little, enough to cut off a
+        // peer that keeps sending pings which are expensive to check and wrong
+        Misbehaving(pfrom->GetId(), fCompact ? 1 : nDos);
+    } else if (pmn != nullptr) {
+        // nothing significant failed, mn is a known one too
+        return true;
+    }
+
+    // something significant is broken or mn is unknown,
+    // we might have to ask for a masternode entry once
+    AskForMN(pfrom, mnp.masternodeOutpoint, connman);
+    return nDos == 0;
+}
+
+const std::unordered_map<uint64_t, COutPoint>& CMasternodeMan::GetShortIdMap(const CMasternodePingBatch& batch)
+{
+    AssertLockHeld(cs);
+
+    auto it = mapShortIds.find(batch.GetNonce());
+    if (it == mapShortIds.end()) {
+        if (mapShortIds.size() >= MAX_SHORTID_MAPS) {
+            // Forget the salt used least recently
+            auto itOldest = mapShortIds.begin();
+            for (auto itMap = mapShortIds.begin(); itMap != mapShortIds.end(); ++itMap) {
+                if (itMap->second.nLastUsed < itOldest->second.nLastUsed) itOldest = itMap;
+            }
+            mapShortIds.erase(itOldest);
+        }
+        it = mapShortIds.emplace(batch.GetNonce(), ShortIdMap{nListGeneration + 1, 0, {}}).first;
+    }
+    ShortIdMap& shortIds = it->second;
+    shortIds.nLastUsed = ++nShortIdMapUses;
+    if (shortIds.nGeneration != nListGeneration) {
+        // Ids shared by several masternodes resolve to nothing
+        shortIds.mapOutpoints.clear();
+        shortIds.mapOutpoints.reserve(mapMasternodes.size());
+        for (const auto& mnpair : mapMasternodes) {
+            auto ret = shortIds.mapOutpoints.emplace(batch.GetShortID(mnpair.first), mnpair.first);
+            if (!ret.second) ret.first->second.SetNull();
+        }
+        shortIds.nGeneration = nListGeneration;
+    }
+    return shortIds.mapOutpoints;
+}
+
+void CMasternodeMan::GetPingsForRelay(const std::vector<uint256>& vHashes, std::vector<std::pair<CMasternodePing, int>>& vPingsRet, std::vector<uint256>& vNotCompactRet)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs);
+
+    for (const uint256& hash : vHashes) {
+        auto it = mapSeenMasternodePing.find(hash);
+        if (it == mapSeenMasternodePing.end()) continue;
+        const CBlockIndex* pindex = LookupBlockIndex(it->second.blockHash);
+        if (pindex == nullptr || !chainActive.Contains(pindex)) {
+            // the block can't be referred to by its height, announce the full ping
+            vNotCompactRet.push_back(hash);
+            continue;
+        }
+        vPingsRet.emplace_back(it->second, pindex->nHeight);
+    }
+}
+
+void CMasternodeMan::PushDsegInvs(CNode* pnode, const CMasternode& mn, bool fPingOnly)
 {
     AssertLockHeld(cs);
 
     CMasternodeBroadcast mnb(mn);
     CMasternodePing mnp = mnb.lastPing;
-    uint256 hashMNB = mnb.GetHash();
     uint256 hashMNP = mnp.GetHash();
-    pnode->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hashMNB));
+    if (!fPingOnly) {
+        uint256 hashMNB = mnb.GetHash();
+        pnode->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hashMNB));
+        mapSeenMasternodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
+    }
     pnode->PushInventory(CInv(MSG_MASTERNODE_PING, hashMNP));
-    mapSeenMasternodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
     mapSeenMasternodePing.insert(std::make_pair(hashMNP, mnp));
 }
 
@@ -1440,6 +1694,51 @@ std::string CMasternodeMan::ToString() const
     return info.str();
 }
 
+bool CMasternodeMan::HasSeenMasternodeBroadcast(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodeBroadcast.count(hash) && !mMnbRecoveryRequests.count(hash);
+}
+
+bool CMasternodeMan::GetSeenMasternodeBroadcast(const uint256& hash, CMasternodeBroadcast& mnbRet)
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodeBroadcast.find(hash);
+    if (it == mapSeenMasternodeBroadcast.end()) return false;
+    mnbRet = it->second.second;
+    return true;
+}
+
+bool CMasternodeMan::HasSeenMasternodePing(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodePing.count(hash);
+}
+
+bool CMasternodeMan::GetSeenMasternodePing(const uint256& hash, CMasternodePing& mnpRet)
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodePing.find(hash);
+    if (it == mapSeenMasternodePing.end()) return false;
+    mnpRet = it->second;
+    return true;
+}
+
+bool CMasternodeMan::HasSeenMasternodeVerification(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodeVerification.count(hash);
+}
+
+bool CMasternodeMan::GetSeenMasternodeVerification(const uint256& hash, CMasternodeVerification& mnvRet)
+{
+    LOCK(cs);
+    auto it = mapSeenMasternodeVerification.find(hash);
+    if (it == mapSeenMasternodeVerification.end()) return false;
+    mnvRet = it->second;
+    return true;
+}
+
 bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBroadcast mnb, int& nDos, CConnman* connman)
 {
     // Need to lock cs_main here to ensure consistent locking order because the SimpleCheck call below locks cs_main
@@ -1632,6 +1931,7 @@ void CMasternodeMan::UpdatedBlockTip(const CBlockIndex *pindexNew)
     LogPrint(BCLog::MNODE, "CMasternodeMan::UpdatedBlockTip -- nCachedBlockHeight=%d\n", nCachedBlockHeight);
 
     CheckSameAddr();
+    PublishListSnapshot();
 
     if (fMasternodeMode) {
         // normal wallet does not need to update this every block, doing update on rpc call should be enough
@@ -1737,6 +2037,7 @@ void CMasternodeMan::ClientTask(CConnman* connman)
     nTick++;
 
     // make sure to check all masternodes first
+    mnodeman.CountPaymentQueue();
     mnodeman.Check();
 
     mnodeman.ProcessPendingMnbRequests(connman);
@@ -6,14 +6,53 @@
 #ifndef BITCOIN_MODULES_MASTERNODE_MASTERNODEMAN_H
 #define BITCOIN_MODULES_MASTERNODE_MASTERNODEMAN_H
 
+#include <bloom.h>
 #include <modules/masternode/masternode.h>
 #include <sync.h>
 
+#include <memory>
+#include <unordered_map>
+
 class CMasternodeMan;
 class CConnman;
+class CIblt;
+class CMasternodePingBatch;
 
 extern CMasternodeMan mnodeman;
 
+/** Counts of the masternode list, published for readers that shouldn't take locks */
+struct CMasternodeListSnapshot
+{
+    int nTotal{0};
+    //! Enabled masternodes with the protocol version needed for payments, and for CoinJoin
+    int nEnabled{0};
+    int nEnabledCJ{0};
+    //! Masternodes qualifying for payment at nHeight
+    int nQualify{0};
+    int nHeight{0};
+};
+
+/** How the masternode list changed since the previous snapshot */
+struct CMasternodeListDiff
+{
+    int nHeight{0};
+    //! Masternodes that joined the list or changed state, with their new state
+    std::vector<std::pair<COutPoint, int>> vUpdated;
+    //! Masternodes that left the list
+    std::vector<COutPoint> vRemoved;
+
+    bool IsEmpty() const { return vUpdated.empty() && vRemoved.empty(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(vUpdated);
+        READWRITE(vRemoved);
+    }
+};
+
 class CMasternodeMan
 {
 public:
@@ -40,6 +79,13 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    /// Failed checks of rebuilt pings a ping batch may cause before the rest of it is dropped
+    static const int MAX_MNPINGBATCH_FAILURES       = 10;
+    /// Rejected pings remembered so that relays of them are turned away unchecked
+    static const unsigned int MAX_REJECTED_PINGS    = 50000;
+    /// Salts of ping batches whose short ids are kept resolved
+    static const size_t MAX_SHORTID_MAPS            = 16;
+
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -77,6 +123,30 @@ private:
 
     int64_t nLastSentinelPingTime;
 
+    /// Replaced as a whole by PublishListSnapshot, never changed in place
+    std::shared_ptr<const CMasternodeListSnapshot> pListSnapshot;
+    /// State of each masternode as of the last snapshot, to tell listeners what changed
+    std::map<COutPoint, int> mapSnapshotStates;
+    /// Masternodes qualifying for payment, as counted by CountPaymentQueue
+    int nPaymentQueueHeight{-1};
+    int nPaymentQueueCount{0};
+
+    /// Bumped whenever masternodes are added or removed
+    uint64_t nListGeneration{0};
+    struct ShortIdMap {
+        uint64_t nGeneration;
+        uint64_t nLastUsed;
+        /// Null for short ids shared by several masternodes
+        std::unordered_map<uint64_t, COutPoint> mapOutpoints;
+    };
+    /// Short ids of our list under the salts of recent ping batches
+    std::map<uint64_t, ShortIdMap> mapShortIds;
+    uint64_t nShortIdMapUses{0};
+    /// Pings that were not accepted, so that relays of them aren't checked again.
+    /// Kept apart from mapSeenMasternodePing, whose pings are served to peers.
+    /// Created on first use, as the randomizer isn't ready when mnodeman is constructed.
+    std::unique_ptr<CRollingBloomFilter> pfilterRejectedPings;
+
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
@@ -84,9 +154,16 @@ private:
     bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
 
     void SyncSingle(CNode* pnode, const COutPoint& outpoint);
-    void SyncAll(CNode* pnode, CConnman* connman);
+    /// Announce our list, or only what a peer lacks given a sketch of the announcements and pings it has
+    void SyncAll(CNode* pnode, CConnman* connman, const CIblt* pSketch = nullptr);
+
+    void PushDsegInvs(CNode* pnode, const CMasternode& mn, bool fPingOnly = false);
 
-    void PushDsegInvs(CNode* pnode, const CMasternode& mn);
+    /// Check and apply a ping received from pfrom, fCompact if it was rebuilt from a compact one.
+    /// Returns false if a significant check failed.
+    bool ProcessPing(CNode* pfrom, const CMasternodePing& mnp, bool fCompact, CConnman* connman);
+    /// Our list keyed by short id under the salt of batch
+    const std::unordered_map<uint64_t, COutPoint>& GetShortIdMap(const CMasternodePingBatch& batch);
 
 public:
     // Keep track of all broadcasts I've seen
@@ -175,7 +252,7 @@ public:
     /// Find a random entry
     masternode_info_t FindRandomNotInVec(const std::vector<COutPoint> &vecToExclude, int nProtocolVersion = -1);
 
-    std::map<COutPoint, CMasternode> GetFullMasternodeMap() { return mapMasternodes; }
+    std::map<COutPoint, CMasternode> GetFullMasternodeMap() { LOCK(cs); return mapMasternodes; }
 
     bool GetMasternodeRanks(rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight = -1, int nMinProtocol = 0);
     bool GetMasternodeRank(const COutPoint &outpoint, int& nRankRet, int nBlockHeight = -1, int nMinProtocol = 0);
@@ -195,11 +272,28 @@ public:
     /// Return the number of (unique) Masternodes
     int size() { return mapMasternodes.size(); }
 
+    /// Count the masternodes qualifying for payment at the current height, unless done already
+    void CountPaymentQueue();
+    /// Count the masternode list for GetListSnapshot. This walks the whole list, so it
+    /// is done once per check round, and when masternodes are added or removed, not
+    /// for each ping. Listeners are told how the list changed since the previous snapshot.
+    void PublishListSnapshot();
+    /// Counts of the masternode list as of its last snapshot, or null before the first one
+    std::shared_ptr<const CMasternodeListSnapshot> GetListSnapshot() const { return std::atomic_load(&pListSnapshot); }
+
     std::string ToString() const;
 
     /// Perform complete check and only then update masternode list and maps using provided CMasternodeBroadcast
     bool CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBroadcast mnb, int& nDos, CConnman* connman);
-    bool IsMnbRecoveryRequested(const uint256& hash) { return mMnbRecoveryRequests.count(hash); }
+    bool IsMnbRecoveryRequested(const uint256& hash) { LOCK(cs); return mMnbRecoveryRequests.count(hash); }
+
+    /// Whether the broadcast was seen and is not being recovered
+    bool HasSeenMasternodeBroadcast(const uint256& hash);
+    bool GetSeenMasternodeBroadcast(const uint256& hash, CMasternodeBroadcast& mnbRet);
+    bool HasSeenMasternodePing(const uint256& hash);
+    bool GetSeenMasternodePing(const uint256& hash, CMasternodePing& mnpRet);
+    bool HasSeenMasternodeVerification(const uint256& hash);
+    bool GetSeenMasternodeVerification(const uint256& hash, CMasternodeVerification& mnvRet);
 
     void UpdateLastPaid(const CBlockIndex* pindex);
 
@@ -236,6 +330,12 @@ public:
     void NotifyMasternodeUpdates(CConnman* connman);
 
     void ProcessModuleMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman* connman);
+
+    /**
+     * Look up seen pings to relay in a compact batch, paired with the height of their block.
+     * Pings whose block isn't in the active chain are returned in vNotCompactRet.
+     */
+    void GetPingsForRelay(const std::vector<uint256>& vHashes, std::vector<std::pair<CMasternodePing, int>>& vPingsRet, std::vector<uint256>& vNotCompactRet);
     void UpdatedBlockTip(const CBlockIndex *pindexNew);
 
     void ClientTask(CConnman* connman);
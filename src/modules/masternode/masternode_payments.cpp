@@ -12,6 +12,7 @@
 #include <netmessagemaker.h>
 #include <netfulfilledman.h>
 #include <util/system.h>
+#include <validationinterface.h>
 
 /** Object for who's going to get paid on which blocks */
 CMasternodePayments mnpayments;
@@ -436,18 +437,28 @@ bool CMasternodePayments::AddOrUpdatePaymentVote(const CMasternodePaymentVote& v
 
     if (HasVerifiedPaymentVote(nVoteHash)) return false;
 
-    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
+    {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
-    mapMasternodePaymentVotes[nVoteHash] = vote;
+        mapMasternodePaymentVotes[nVoteHash] = vote;
 
-    auto it = mapMasternodeBlocks.emplace(vote.nBlockHeight, CMasternodeBlockPayees(vote.nBlockHeight)).first;
-    it->second.AddPayee(vote);
+        auto it = mapMasternodeBlocks.emplace(vote.nBlockHeight, CMasternodeBlockPayees(vote.nBlockHeight)).first;
+        it->second.AddPayee(vote);
+    }
 
     LogPrint(BCLog::MNODEPAY, "CMasternodePayments::AddOrUpdatePaymentVote -- added, hash=%s\n", nVoteHash.ToString());
 
+    GetMainSignals().NotifyMasternodePaymentVote(vote);
+
     return true;
 }
 
+bool CMasternodePayments::HasPaymentVote(const uint256& hashIn) const
+{
+    LOCK(cs_mapMasternodePaymentVotes);
+    return mapMasternodePaymentVotes.count(hashIn);
+}
+
 bool CMasternodePayments::HasVerifiedPaymentVote(const uint256& hashIn) const
 {
     LOCK(cs_mapMasternodePaymentVotes);
@@ -455,6 +466,15 @@ bool CMasternodePayments::HasVerifiedPaymentVote(const uint256& hashIn) const
     return it != mapMasternodePaymentVotes.end() && it->second.IsVerified();
 }
 
+bool CMasternodePayments::GetVerifiedPaymentVote(const uint256& hashIn, CMasternodePaymentVote& voteRet) const
+{
+    LOCK(cs_mapMasternodePaymentVotes);
+    const auto it = mapMasternodePaymentVotes.find(hashIn);
+    if (it == mapMasternodePaymentVotes.end() || !it->second.IsVerified()) return false;
+    voteRet = it->second;
+    return true;
+}
+
 void CMasternodeBlockPayees::AddPayee(const CMasternodePaymentVote& vote)
 {
     LOCK(cs_vecPayees);
@@ -187,7 +187,9 @@ public:
     void Clear();
 
     bool AddOrUpdatePaymentVote(const CMasternodePaymentVote& vote);
+    bool HasPaymentVote(const uint256& hashIn) const;
     bool HasVerifiedPaymentVote(const uint256& hashIn) const;
+    bool GetVerifiedPaymentVote(const uint256& hashIn, CMasternodePaymentVote& voteRet) const;
     bool ProcessBlock(int nBlockHeight, CConnman* connman);
     void CheckBlockVotes(int nBlockHeight);
 
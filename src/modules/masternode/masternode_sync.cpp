@@ -5,6 +5,7 @@
 #include <modules/masternode/masternode_sync.h>
 
 #include <consensus/validation.h>
+#include <iblt.h>
 #include <modules/platform/funding.h>
 #include <modules/masternode/activemasternode.h>
 #include <modules/masternode/masternode_payments.h>
@@ -365,8 +366,19 @@ void CMasternodeSync::ProcessTick(CConnman* connman)
     connman->ReleaseNodeVector(vNodesCopy);
 }
 
+bool CMasternodeSync::CanReconcileWith(const CNode* pnode)
+{
+    return (pnode->GetLocalServices() & NODE_SYNC_RECON) && (pnode->nServices & NODE_SYNC_RECON);
+}
+
 void CMasternodeSync::SendGovernanceSyncRequest(CNode* pnode, CConnman* connman)
 {
+    CIblt sketch;
+    if (CanReconcileWith(pnode) && funding.GetSyncSketch(uint256(), sketch)) {
+        connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::MNGOVERNANCERECON, uint256(), sketch));
+        return;
+    }
+
     CBloomFilter filter;
     filter.clear();
 
@@ -22,6 +22,9 @@ static const int MASTERNODE_SYNC_FINISHED        = 999;
 static const int MASTERNODE_SYNC_TICK_SECONDS    = 6;
 static const int MASTERNODE_SYNC_TIMEOUT_SECONDS = 30; // our blocks are 1.5 minutes so 30 seconds should be fine
 
+/** Default for -syncrecon, reconciling the masternode list and governance data with peers advertising NODE_SYNC_RECON */
+static const bool DEFAULT_SYNC_RECON = true;
+
 extern CMasternodeSync masternodeSync;
 
 //
@@ -50,6 +53,8 @@ public:
 
 
     void SendGovernanceSyncRequest(CNode* pnode, CConnman* connman);
+    /// Whether lists can be synced with pnode by sending a sketch of ours instead of asking for all of its entries
+    static bool CanReconcileWith(const CNode* pnode);
 
     bool IsFailed() { return nRequestedMasternodeAssets == MASTERNODE_SYNC_FAILED; }
     bool IsBlockchainSynced() { return nRequestedMasternodeAssets > MASTERNODE_SYNC_WAITING; }
@@ -92,7 +92,7 @@ void CGovernanceManager::ProcessModuleMessage(CNode* pfrom, const std::string& s
     if(!masternodeSync.IsBlockchainSynced()) return;
 
     // ANOTHER USER IS ASKING US TO HELP THEM SYNC GOVERNANCE OBJECT DATA
-    if (strCommand == NetMsgType::MNGOVERNANCESYNC)
+    if (strCommand == NetMsgType::MNGOVERNANCESYNC || strCommand == NetMsgType::MNGOVERNANCERECON)
     {
         if(pfrom->GetSendVersion() < MIN_GOVERNANCE_PEER_PROTO_VERSION) {
             LogPrint(BCLog::GOV, "MNGOVERNANCESYNC -- peer=%d using obsolete version %i\n", pfrom->GetId(), pfrom->GetSendVersion());
@@ -110,13 +110,23 @@ void CGovernanceManager::ProcessModuleMessage(CNode* pfrom, const std::string& s
 
         vRecv >> nProp;
 
+        // When reconciling, a sketch of the peer's objects or votes replaces the filter
+        CIblt sketch;
+        const CIblt* pSketch = nullptr;
+        if (strCommand == NetMsgType::MNGOVERNANCERECON) {
+            vRecv >> sketch;
+            pSketch = &sketch;
+        }
+
         if(nProp == uint256()) {
-            SyncAll(pfrom, connman);
+            SyncAll(pfrom, connman, pSketch);
         } else {
             CBloomFilter filter;
-            vRecv >> filter;
-            filter.UpdateEmptyFull();
-            SyncSingleObjAndItsVotes(pfrom, nProp, filter, connman);
+            if (!pSketch) {
+                vRecv >> filter;
+                filter.UpdateEmptyFull();
+            }
+            SyncSingleObjAndItsVotes(pfrom, nProp, filter, connman, pSketch);
         }
         LogPrint(BCLog::GOV, "MNGOVERNANCESYNC -- syncing funding objects to our peer at %s\n", pfrom->addr.ToString());
     }
@@ -617,7 +627,7 @@ bool CGovernanceManager::ConfirmInventoryRequest(const CInv& inv)
     return true;
 }
 
-void CGovernanceManager::SyncSingleObjAndItsVotes(CNode* pnode, const uint256& nProp, const CBloomFilter& filter, CConnman* connman)
+void CGovernanceManager::SyncSingleObjAndItsVotes(CNode* pnode, const uint256& nProp, const CBloomFilter& filter, CConnman* connman, const CIblt* pSketch)
 {
     // do not provide any data until our node is synced
     if(!masternodeSync.IsSynced()) return;
@@ -651,11 +661,25 @@ void CGovernanceManager::SyncSingleObjAndItsVotes(CNode* pnode, const uint256& n
     LogPrint(BCLog::GOV, "CGovernanceManager::%s -- syncing govobj: %s, peer=%d\n", __func__, strHash, pnode->GetId());
     pnode->PushInventory(CInv(MSG_GOVERNANCE_OBJECT, it->first));
 
-    auto fileVotes = govobj.GetVoteFile();
+    std::vector<CGovernanceVote> vecVotes = govobj.GetVoteFile().GetVotes();
 
-    for (const auto& vote : fileVotes.GetVotes()) {
+    // Given a sketch of the peer's votes, only send those it lacks, or all of them if that fails
+    std::set<uint256> setMissing;
+    bool fReconciled = false;
+    if (pSketch) {
+        std::vector<uint256> vHashes;
+        for (const auto& vote : vecVotes) {
+            vHashes.push_back(vote.GetHash());
+        }
+        fReconciled = pSketch->GetMissing(vHashes, setMissing);
+        LogPrint(BCLog::GOV, "CGovernanceManager::%s -- %s votes of peer=%d, %d missing\n", __func__,
+                 fReconciled ? "reconciled" : "could not reconcile", pnode->GetId(), setMissing.size());
+    }
+
+    for (const auto& vote : vecVotes) {
         uint256 nVoteHash = vote.GetHash();
-        if(filter.contains(nVoteHash) || !vote.IsValid(true)) {
+        bool fPeerHasIt = fReconciled ? !setMissing.count(nVoteHash) : (!pSketch && filter.contains(nVoteHash));
+        if(fPeerHasIt || !vote.IsValid(true)) {
             continue;
         }
         pnode->PushInventory(CInv(MSG_GOVERNANCE_OBJECT_VOTE, nVoteHash));
@@ -668,7 +692,7 @@ void CGovernanceManager::SyncSingleObjAndItsVotes(CNode* pnode, const uint256& n
     LogPrintf("CGovernanceManager::%s -- sent 1 object and %d votes to peer=%d\n", __func__, nVoteCount, pnode->GetId());
 }
 
-void CGovernanceManager::SyncAll(CNode* pnode, CConnman* connman) const
+void CGovernanceManager::SyncAll(CNode* pnode, CConnman* connman, const CIblt* pSketch) const
 {
     // do not provide any data until our node is synced
     if(!masternodeSync.IsSynced()) return;
@@ -691,8 +715,23 @@ void CGovernanceManager::SyncAll(CNode* pnode, CConnman* connman) const
 
     LOCK2(cs_main, cs);
 
+    // Given a sketch of the peer's objects, only send those it lacks, or all of them if that fails
+    std::set<uint256> setMissing;
+    bool fReconciled = false;
+    if (pSketch) {
+        std::vector<uint256> vHashes;
+        for (const auto& objPair : mapObjects) {
+            vHashes.push_back(objPair.first);
+        }
+        fReconciled = pSketch->GetMissing(vHashes, setMissing);
+        LogPrint(BCLog::GOV, "CGovernanceManager::%s -- %s objects of peer=%d, %d missing\n", __func__,
+                 fReconciled ? "reconciled" : "could not reconcile", pnode->GetId(), setMissing.size());
+    }
+
     // all valid objects, no votes
     for (const auto& objPair : mapObjects) {
+        if (fReconciled && !setMissing.count(objPair.first)) continue;
+
         uint256 nHash = objPair.first;
         const CGovernanceObject& govobj = objPair.second;
         std::string strHash = nHash.ToString();
@@ -994,6 +1033,13 @@ void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nH
 
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
 
+    CIblt sketch;
+    if (fUseFilter && CMasternodeSync::CanReconcileWith(pfrom) && GetSyncSketch(nHash, sketch)) {
+        LogPrint(BCLog::GOV, "CGovernanceManager::RequestGovernanceObject -- nHash %s sketch cells %d peer=%d\n", nHash.ToString(), sketch.size(), pfrom->GetId());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNGOVERNANCERECON, nHash, sketch));
+        return;
+    }
+
     CBloomFilter filter;
     filter.clear();
 
@@ -1016,6 +1062,32 @@ void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nH
     connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNGOVERNANCESYNC, nHash, filter));
 }
 
+bool CGovernanceManager::GetSyncSketch(const uint256& nProp, CIblt& sketchRet)
+{
+    LOCK(cs);
+
+    std::vector<uint256> vHashes;
+    if (nProp == uint256()) {
+        for (const auto& objPair : mapObjects) {
+            vHashes.push_back(objPair.first);
+        }
+    } else {
+        const CGovernanceObject* pObj = FindGovernanceObject(nProp);
+        if (!pObj) return false;
+        for (const auto& vote : pObj->GetVoteFile().GetVotes()) {
+            vHashes.push_back(vote.GetHash());
+        }
+    }
+    // With nothing to compare against, a plain request is smaller
+    if (vHashes.empty()) return false;
+
+    sketchRet = CIblt(CIblt::CellsForSetSize(vHashes.size()));
+    for (const uint256& hash : vHashes) {
+        sketchRet.Insert(hash);
+    }
+    return true;
+}
+
 int CGovernanceManager::RequestGovernanceObjectVotes(CNode* pnode, CConnman* connman)
 {
     if(pnode->nVersion < MIN_GOVERNANCE_PEER_PROTO_VERSION) return -3;
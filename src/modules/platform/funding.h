@@ -9,6 +9,7 @@
 #include <cachemap.h>
 #include <cachemultimap.h>
 #include <chain.h>
+#include <iblt.h>
 #include <modules/platform/funding_exceptions.h>
 #include <modules/platform/funding_object.h>
 #include <modules/platform/funding_vote.h>
@@ -244,8 +245,16 @@ public:
      */
     bool ConfirmInventoryRequest(const CInv& inv);
 
-    void SyncSingleObjAndItsVotes(CNode* pnode, const uint256& nProp, const CBloomFilter& filter, CConnman* connman);
-    void SyncAll(CNode* pnode, CConnman* connman) const;
+    /** Announce an object and its votes, except those in filter or, given a sketch of the peer's votes, those it has */
+    void SyncSingleObjAndItsVotes(CNode* pnode, const uint256& nProp, const CBloomFilter& filter, CConnman* connman, const CIblt* pSketch = nullptr);
+    /** Announce all objects, or only those a peer lacks given a sketch of its objects */
+    void SyncAll(CNode* pnode, CConnman* connman, const CIblt* pSketch = nullptr) const;
+
+    /**
+     * Build a sketch of our objects (nProp null) or of the votes of object nProp,
+     * to reconcile them with a peer. Returns false if we have nothing to sketch.
+     */
+    bool GetSyncSketch(const uint256& nProp, CIblt& sketchRet);
 
     void ClientTask(CConnman* connman);
 
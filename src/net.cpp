@@ -27,12 +27,17 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -72,10 +77,17 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+/** Maximum number of events taken from epoll per wait */
+static const int EPOLL_MAX_EVENTS = 64;
+
+/** Maximum number of send queue buffers written by a single sendmsg() call */
+static const int MAX_SEND_IOVECS = 64;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
+static const uint64_t RANDOMIZER_ID_ADDRCACHE = 0x1cf2e4ddd306dda9ULL; // SHA256("addrcache")[0:8]
 //
 // Global state variables
 //
@@ -446,13 +458,14 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     return pnode;
 }
 
-void CNode::CloseSocketDisconnect()
+void CNode::CloseSocketDisconnect(const CConnman* connman)
 {
     fDisconnect = true;
     LOCK(cs_hSocket);
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint(BCLog::NET, "disconnecting peer=%d\n", id);
+        connman->UnregisterEvents(this);
         CloseSocket(hSocket);
     }
 }
@@ -567,7 +580,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -632,6 +645,94 @@ int CNode::GetSendVersion() const
     return nSendVersion;
 }
 
+const size_t CNetMessageBufferPool::MIN_BUFFER_SIZE;
+const size_t CNetMessageBufferPool::MAX_BUFFER_SIZE;
+const size_t CNetMessageBufferPool::MAX_BUFFERS_PER_CLASS;
+const size_t CNetMessageBufferPool::MAX_BYTES_PER_CLASS;
+
+CSerializeData CNetMessageBufferPool::Get(size_t nSize)
+{
+    nSize = std::max(std::min(nSize, MAX_BUFFER_SIZE), MIN_BUFFER_SIZE);
+    // Smallest class whose buffers hold nSize bytes
+    int nClass = 0;
+    while ((MIN_BUFFER_SIZE << nClass) < nSize) {
+        nClass++;
+    }
+    CSerializeData buffer;
+    {
+        LOCK(cs);
+        std::vector<CSerializeData>& vBuffers = vClasses[nClass];
+        if (!vBuffers.empty()) {
+            buffer.swap(vBuffers.back());
+            vBuffers.pop_back();
+            return buffer;
+        }
+    }
+    // Allocate the full class size so the buffer can be pooled again
+    buffer.reserve(MIN_BUFFER_SIZE << nClass);
+    return buffer;
+}
+
+void CNetMessageBufferPool::Put(CSerializeData&& buffer)
+{
+    const size_t nCapacity = buffer.capacity();
+    if (nCapacity < MIN_BUFFER_SIZE || nCapacity > MAX_BUFFER_SIZE) {
+        return;
+    }
+    // Largest class whose size the buffer holds
+    int nClass = 0;
+    while (nClass + 1 < NUM_CLASSES && (MIN_BUFFER_SIZE << (nClass + 1)) <= nCapacity) {
+        nClass++;
+    }
+    const size_t nMaxBuffers = std::min(MAX_BUFFERS_PER_CLASS, MAX_BYTES_PER_CLASS / (MIN_BUFFER_SIZE << nClass));
+    LOCK(cs);
+    std::vector<CSerializeData>& vBuffers = vClasses[nClass];
+    if (vBuffers.size() < nMaxBuffers) {
+        buffer.clear();
+        vBuffers.push_back(std::move(buffer));
+    }
+}
+
+size_t CNetMessageBufferPool::size() const
+{
+    LOCK(cs);
+    size_t nBuffers = 0;
+    for (const std::vector<CSerializeData>& vBuffers : vClasses) {
+        nBuffers += vBuffers.size();
+    }
+    return nBuffers;
+}
+
+static CNetMessageBufferPool& GetRecvBufferPool()
+{
+    // Leaked on purpose, so messages destroyed during shutdown can still
+    // give their buffers back
+    static CNetMessageBufferPool* pool = new CNetMessageBufferPool();
+    return *pool;
+}
+
+CNetMessage::CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn)
+{
+    CSerializeData buffer = GetRecvBufferPool().Get(CMessageHeader::HEADER_SIZE);
+    hdrbuf.swap_storage(buffer);
+    hdrbuf.resize(24);
+    in_data = false;
+    nHdrPos = 0;
+    nDataPos = 0;
+    nTime = 0;
+}
+
+CNetMessage::~CNetMessage()
+{
+    CNetMessageBufferPool& pool = GetRecvBufferPool();
+    CSerializeData buffer;
+    hdrbuf.swap_storage(buffer);
+    pool.Put(std::move(buffer));
+    buffer = CSerializeData();
+    vRecv.swap_storage(buffer);
+    pool.Put(std::move(buffer));
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -657,8 +758,13 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     if (hdr.nMessageSize > MAX_SIZE)
         return -1;
 
-    // switch state to reading message data
+    // switch state to reading message data, into a pooled buffer that
+    // readData() fills before growing vRecv any further
     in_data = true;
+    if (hdr.nMessageSize > 0) {
+        CSerializeData buffer = GetRecvBufferPool().Get(hdr.nMessageSize);
+        vRecv.swap_storage(buffer);
+    }
 
     return nCopy;
 }
@@ -669,8 +775,10 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // Use up the pooled buffer first, then allocate up to 256 KiB ahead,
+        // but never more than the total message size.
+        const size_t nGrow = nDataPos + nCopy <= vRecv.capacity() ? vRecv.capacity() : nDataPos + nCopy + 256 * 1024;
+        vRecv.resize(std::min<size_t>(hdr.nMessageSize, nGrow));
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
@@ -694,27 +802,61 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
+        // Number of bytes handed to the socket in this round
+        size_t nQueued = 0;
         int nBytes = 0;
+#ifdef WIN32
+        {
+            const auto &data = **it;
+            nQueued = data.size() - pnode->nSendOffset;
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                break;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nQueued, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+#else
         {
+            // Gather the queued buffers, which may be shared with other
+            // peers, into a single system call instead of copying them
+            struct iovec iov[MAX_SEND_IOVECS];
+            int nIov = 0;
+            for (auto itBuf = it; itBuf != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itBuf, ++nIov) {
+                const auto &data = **itBuf;
+                size_t nOffset = nIov == 0 ? pnode->nSendOffset : 0;
+                iov[nIov].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+                iov[nIov].iov_len = data.size() - nOffset;
+                nQueued += iov[nIov].iov_len;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
         }
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the buffers that went out completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nBufferLeft = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nBufferLeft) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nBufferLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nQueued) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -724,7 +866,7 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                 {
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
-                    pnode->CloseSocketDisconnect();
+                    pnode->CloseSocketDisconnect(this);
                 }
             }
             // couldn't send anything at all
@@ -971,10 +1113,16 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     pnode->AddRef();
     pnode->fWhitelisted = whitelisted;
     pnode->m_prefer_evict = bannedlevel > 0;
+    // Only relay what is announced from now on
+    pnode->nRelayLogCursor = invRelayLog.GetEnd();
+    pnode->nTxRelayLogCursor = txRelayLog.GetEnd();
     m_msgproc->InitializeNode(pnode);
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    if (!RegisterEvents(pnode)) {
+        pnode->fDisconnect = true;
+    }
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1009,7 +1157,7 @@ void CConnman::DisconnectNodes()
                 pnode->grantOutbound.Release();
 
                 // close socket and cleanup
-                pnode->CloseSocketDisconnect();
+                pnode->CloseSocketDisconnect(this);
 
                 // hold in disconnected pool until all refs are released
                 pnode->Release();
@@ -1090,11 +1238,51 @@ void CConnman::InactivityCheck(CNode *pnode)
     }
 }
 
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+#ifdef USE_POLL
+    case SOCKETEVENTS_POLL: return "poll";
+#else
+    case SOCKETEVENTS_POLL: return "select";
+#endif
+    case SOCKETEVENTS_EPOLL: return "epoll";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == GetSocketEventsModeName(SOCKETEVENTS_POLL)) {
+        mode = SOCKETEVENTS_POLL;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (str == GetSocketEventsModeName(SOCKETEVENTS_EPOLL)) {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string modes = GetSocketEventsModeName(SOCKETEVENTS_POLL);
+#ifdef USE_EPOLL
+    modes += ", " + GetSocketEventsModeName(SOCKETEVENTS_EPOLL);
+#endif
+    return modes;
+}
+
 bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     for (const ListenSocket& hListenSocket : vhListenSocket) {
         recv_set.insert(hListenSocket.socket);
     }
+    if (wakeupPipe[0] != -1) {
+        recv_set.insert(wakeupPipe[0]);
+    }
 
     {
         LOCK(cs_vNodes);
@@ -1254,13 +1442,193 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set, bool fOnlyPoll)
+{
+#ifdef USE_EPOLL
+    epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, EPOLL_MAX_EVENTS, fOnlyPoll ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        int nErr = errno;
+        if (nErr != EINTR) {
+            LogPrintf("epoll_wait error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+    // More events may be ready than fit in one batch; pick them up without waiting
+    fSocketHandlerMoreWork = nEvents == EPOLL_MAX_EVENTS;
+
+    for (int i = 0; i < nEvents; i++) {
+        const epoll_event& event = events[i];
+        if (event.data.ptr == &wakeupPipe) {
+            recv_set.insert(wakeupPipe[0]);
+            continue;
+        }
+        bool fListenSocket = false;
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (event.data.ptr == &hListenSocket) {
+                recv_set.insert(hListenSocket.socket);
+                fListenSocket = true;
+                break;
+            }
+        }
+        if (fListenSocket) continue;
+
+        // Nodes are unregistered before their socket is closed and only
+        // deleted by this thread, so the pointer is still valid here. Sockets
+        // are edge-triggered: remember readiness until the socket would block.
+        CNode* pnode = static_cast<CNode*>(event.data.ptr);
+        if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+            pnode->fHasRecvData = true;
+        }
+        if (event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            pnode->fCanSendData = true;
+        }
+    }
+#endif
+}
+
+bool CConnman::RegisterEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode != SOCKETEVENTS_EPOLL) {
+        return true;
+    }
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) {
+        return true;
+    }
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("Failed to register peer=%d with epoll: %s\n", pnode->GetId(), NetworkErrorString(errno));
+        return false;
+    }
+#endif
+    return true;
+}
+
+void CConnman::UnregisterEvents(CNode* pnode) const
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode != SOCKETEVENTS_EPOLL || epollfd == -1) {
+        return;
+    }
+    AssertLockHeld(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) {
+        return;
+    }
+    // Closing the socket would normally drop the registration too, but not if
+    // a forked child still holds a copy of the descriptor
+    if (epoll_ctl(epollfd, EPOLL_CTL_DEL, pnode->hSocket, nullptr) != 0 && errno != ENOENT) {
+        LogPrintf("Failed to unregister peer=%d from epoll: %s\n", pnode->GetId(), NetworkErrorString(errno));
+    }
+#endif
+}
+
+bool CConnman::InitSocketEvents()
+{
+#ifndef WIN32
+    if (pipe(wakeupPipe) != 0) {
+        wakeupPipe[0] = wakeupPipe[1] = -1;
+        LogPrintf("Failed to create wakeup pipe, queued data will wait for the socket handler to time out\n");
+    } else {
+        for (int fd : wakeupPipe) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+#endif
+
+#ifdef USE_EPOLL
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            LogPrintf("Failed to create epoll instance: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        epoll_event event;
+        event.events = EPOLLIN;
+        for (ListenSocket& hListenSocket : vhListenSocket) {
+            event.data.ptr = &hListenSocket;
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+                LogPrintf("Failed to register listening socket with epoll: %s\n", NetworkErrorString(errno));
+                return false;
+            }
+        }
+        if (wakeupPipe[0] != -1) {
+            event.data.ptr = &wakeupPipe;
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupPipe[0], &event) != 0) {
+                LogPrintf("Failed to register wakeup pipe with epoll: %s\n", NetworkErrorString(errno));
+                return false;
+            }
+        }
+    }
+#endif
+    return true;
+}
+
+void CConnman::CloseSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
+#ifndef WIN32
+    for (int& fd : wakeupPipe) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+void CConnman::WakeSelect()
+{
+#ifndef WIN32
+    if (wakeupPipe[1] == -1 || fWakeupPipePending.exchange(true)) {
+        return;
+    }
+    char buf{0};
+    if (write(wakeupPipe[1], &buf, sizeof(buf)) != sizeof(buf)) {
+        LogPrint(BCLog::NET, "write to wakeupPipe failed\n");
+    }
+#endif
+}
+
+void CConnman::DrainWakeupPipe()
+{
+#ifndef WIN32
+    // Clear the flag first, so a wakeup racing with the drain writes a new byte
+    fWakeupPipePending = false;
+    char buf[128];
+    while (read(wakeupPipe[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
-    SocketEvents(recv_set, send_set, error_set);
+    const bool fEpoll = socketEventsMode == SOCKETEVENTS_EPOLL;
+    if (fEpoll) {
+        SocketEventsEpoll(recv_set, fSocketHandlerMoreWork);
+    } else {
+        SocketEvents(recv_set, send_set, error_set);
+    }
 
     if (interruptNet) return;
 
+    if (wakeupPipe[0] != -1 && recv_set.count(wakeupPipe[0]) > 0) {
+        DrainWakeupPipe();
+    }
+
     //
     // Accept new connections
     //
@@ -1293,7 +1661,19 @@ void CConnman::SocketHandler()
         bool recvSet = false;
         bool sendSet = false;
         bool errorSet = false;
-        {
+        if (fEpoll) {
+            // Same policy as GenerateSelectSet: drain the send queue before receiving more
+            bool fSendQueued;
+            {
+                LOCK(pnode->cs_vSend);
+                fSendQueued = !pnode->vSendMsg.empty();
+            }
+            sendSet = fSendQueued && pnode->fCanSendData;
+            recvSet = !fSendQueued && pnode->fHasRecvData && !pnode->fPauseRecv;
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+        } else {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
@@ -1312,11 +1692,20 @@ void CConnman::SocketHandler()
                     continue;
                 nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
             }
+            if (fEpoll) {
+                // A full buffer means more data is likely waiting; anything
+                // less means the socket has been drained until the next edge
+                if (nBytes == (int)sizeof(pchBuf)) {
+                    fSocketHandlerMoreWork = true;
+                } else {
+                    pnode->fHasRecvData = false;
+                }
+            }
             if (nBytes > 0)
             {
                 bool notify = false;
                 if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
+                    pnode->CloseSocketDisconnect(this);
                 RecordBytesRecv(nBytes);
                 if (notify) {
                     size_t nSizeAdded = 0;
@@ -1332,7 +1721,7 @@ void CConnman::SocketHandler()
                         pnode->nProcessQueueSize += nSizeAdded;
                         pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                     }
-                    WakeMessageHandler();
+                    WakeMessageHandler(pnode);
                 }
             }
             else if (nBytes == 0)
@@ -1341,7 +1730,7 @@ void CConnman::SocketHandler()
                 if (!pnode->fDisconnect) {
                     LogPrint(BCLog::NET, "socket closed\n");
                 }
-                pnode->CloseSocketDisconnect();
+                pnode->CloseSocketDisconnect(this);
             }
             else if (nBytes < 0)
             {
@@ -1351,7 +1740,7 @@ void CConnman::SocketHandler()
                 {
                     if (!pnode->fDisconnect)
                         LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                    pnode->CloseSocketDisconnect();
+                    pnode->CloseSocketDisconnect(this);
                 }
             }
         }
@@ -1366,6 +1755,14 @@ void CConnman::SocketHandler()
             if (nBytes) {
                 RecordBytesSent(nBytes);
             }
+            if (fEpoll) {
+                if (!pnode->vSendMsg.empty()) {
+                    // The socket buffer is full until the next edge
+                    pnode->fCanSendData = false;
+                } else if (pnode->fHasRecvData && !pnode->fPauseRecv) {
+                    fSocketHandlerMoreWork = true;
+                }
+            }
         }
 
         InactivityCheck(pnode);
@@ -1389,11 +1786,29 @@ void CConnman::ThreadSocketHandler()
 
 void CConnman::WakeMessageHandler()
 {
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        MessageHandler& handler = messageHandlers[i];
+        {
+            std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+            handler.fMsgProcWake = true;
+        }
+        handler.condMsgProc.notify_one();
+    }
+}
+
+CConnman::MessageHandler& CConnman::GetMessageHandler(const CNode* pnode)
+{
+    return messageHandlers[pnode->GetId() % nMessageHandlerThreads];
+}
+
+void CConnman::WakeMessageHandler(const CNode* pnode)
+{
+    MessageHandler& handler = GetMessageHandler(pnode);
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+        handler.fMsgProcWake = true;
     }
-    condMsgProc.notify_one();
+    handler.condMsgProc.notify_one();
 }
 
 
@@ -1978,23 +2393,32 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     if (fConnectToMasternode)
         pnode->fMasternode = true;
 
+    pnode->nRelayLogCursor = invRelayLog.GetEnd();
+    pnode->nTxRelayLogCursor = txRelayLog.GetEnd();
     m_msgproc->InitializeNode(pnode);
+    if (!RegisterEvents(pnode)) {
+        pnode->fDisconnect = true;
+    }
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread)
 {
+    MessageHandler& handler = messageHandlers[nThread];
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
-                pnode->AddRef();
+            vNodesCopy.reserve(vNodes.size() / nMessageHandlerThreads + 1);
+            for (CNode* pnode : vNodes) {
+                if (&GetMessageHandler(pnode) == &handler) {
+                    pnode->AddRef();
+                    vNodesCopy.push_back(pnode);
+                }
             }
         }
 
@@ -2026,11 +2450,11 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
-        WAIT_LOCK(mutexMsgProc, lock);
+        WAIT_LOCK(handler.mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            handler.condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&handler] { return handler.fMsgProcWake; });
         }
-        fMsgProcWake = false;
+        handler.fMsgProcWake = false;
     }
 }
 
@@ -2288,9 +2712,18 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+    for (MessageHandler& handler : messageHandlers) {
+        LOCK(handler.mutexMsgProc);
+        handler.fMsgProcWake = false;
+    }
+
+    if (!InitSocketEvents()) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                strprintf(_("Failed to set up -socketevents=%s."), GetSocketEventsModeName(socketEventsMode)),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
     }
 
     // Send and receive from sockets, accept connections
@@ -2320,7 +2753,11 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        MessageHandler& handler = messageHandlers[i];
+        handler.name = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        handler.thread = std::thread(&TraceThread<std::function<void()> >, handler.name.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpAddresses, this), DUMP_PEERS_INTERVAL * 1000);
@@ -2345,13 +2782,16 @@ instance_of_cnetcleanup;
 
 void CConnman::Interrupt()
 {
-    {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        flagInterruptMsgProc = true;
+    for (MessageHandler& handler : messageHandlers) {
+        {
+            std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+            flagInterruptMsgProc = true;
+        }
+        handler.condMsgProc.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
+    WakeSelect();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2375,8 +2815,10 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (MessageHandler& handler : messageHandlers) {
+        if (handler.thread.joinable())
+            handler.thread.join();
+    }
     if (threadOpenMasternodeConnections.joinable())
         threadOpenMasternodeConnections.join();
     if (threadOpenConnections.joinable())
@@ -2396,7 +2838,7 @@ void CConnman::Stop()
 
     // Close sockets
     for (CNode* pnode : vNodes)
-        pnode->CloseSocketDisconnect();
+        pnode->CloseSocketDisconnect(this);
     for (ListenSocket& hListenSocket : vhListenSocket)
         if (hListenSocket.socket != INVALID_SOCKET)
             if (!CloseSocket(hListenSocket.socket))
@@ -2412,6 +2854,7 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    CloseSocketEvents();
     semOutbound.reset();
     semAddnode.reset();
     semMasternodeOutbound.reset();
@@ -2459,6 +2902,32 @@ std::vector<CAddress> CConnman::GetAddresses()
     return addrman.GetAddr();
 }
 
+std::shared_ptr<const std::vector<CAddress>> CConnman::GetAddressesCached(const CNode& requestor)
+{
+    const std::vector<unsigned char> vchBind = requestor.addrBind.GetKey();
+    const uint64_t nCacheId = GetDeterministicRandomizer(RANDOMIZER_ID_ADDRCACHE)
+        .Write(requestor.addr.GetNetwork())
+        .Write(vchBind.data(), vchBind.size())
+        .Finalize();
+    const int64_t nNow = GetTime();
+    {
+        LOCK(cs_addr_response_caches);
+        const auto it = m_addr_response_caches.find(nCacheId);
+        if (it != m_addr_response_caches.end() && nNow < it->second.nExpiry) {
+            return it->second.pAddrs;
+        }
+    }
+
+    // Concurrent refreshes are harmless, the last one stored wins
+    std::shared_ptr<const std::vector<CAddress>> pAddrs = std::make_shared<const std::vector<CAddress>>(addrman.GetAddr());
+    LOCK(cs_addr_response_caches);
+    CachedAddrResponse& cache = m_addr_response_caches[nCacheId];
+    cache.pAddrs = pAddrs;
+    // Don't keep answering with nothing while addrman is still being filled
+    cache.nExpiry = pAddrs->empty() ? nNow : nNow + ADDR_RESPONSE_CACHE_INTERVAL;
+    return pAddrs;
+}
+
 bool CConnman::AddNode(const std::string& strNode)
 {
     LOCK(cs_vAddedNodes);
@@ -2573,11 +3042,54 @@ bool CConnman::DisconnectNode(NodeId id)
     return false;
 }
 
-void CConnman::RelayInv(CInv &inv, const int minProtoVersion) {
-    LOCK(cs_vNodes);
-    for (CNode* pnode : vNodes)
-        if(pnode->nVersion >= minProtoVersion)
-            pnode->PushInventory(inv);
+const int64_t CInvRelayLog::MAX_AGE;
+const size_t CInvRelayLog::MAX_ENTRIES;
+
+const size_t CInvRelayLog::DEFAULT_SEGMENT_SIZE;
+
+void CInvRelayLog::Append(const CInv& inv, int nMinProtoVersion, int64_t nTime)
+{
+    LOCK(cs);
+    if (segments.empty() || segments.back()->nSize.load(std::memory_order_relaxed) == nSegmentSize) {
+        segments.push_back(std::make_shared<Segment>(nEnd, nSegmentSize));
+    }
+    Segment& segment = *segments.back();
+    const size_t nSize = segment.nSize.load(std::memory_order_relaxed);
+    segment.entries[nSize] = Entry{inv, nMinProtoVersion, nTime};
+    // Publish the entry to readers scanning without cs
+    segment.nSize.store(nSize + 1, std::memory_order_release);
+    nEnd++;
+    // Only full segments are dropped, readers may still hold them
+    while (segments.size() > 1 && (nEnd - segments.front()->nBegin > MAX_ENTRIES ||
+                                   segments.front()->entries[nSegmentSize - 1].nTime < nTime - MAX_AGE)) {
+        segments.pop_front();
+    }
+}
+
+uint64_t CInvRelayLog::GetEnd() const
+{
+    LOCK(cs);
+    return nEnd;
+}
+
+size_t CInvRelayLog::size() const
+{
+    LOCK(cs);
+    return segments.empty() ? 0 : nEnd - segments.front()->nBegin;
+}
+
+void CConnman::RelayInv(const CInv &inv, const int minProtoVersion) {
+    // Peers read it from the log when they next send inventory
+    (inv.type == MSG_TX ? txRelayLog : invRelayLog).Append(inv, minProtoVersion, GetTime());
+}
+
+void CConnman::ForEachRelayedInv(CNode* pnode, bool fTransactions, const std::function<void(const CInv&)>& func)
+{
+    uint64_t& nCursor = fTransactions ? pnode->nTxRelayLogCursor : pnode->nRelayLogCursor;
+    const uint64_t nMissed = (fTransactions ? txRelayLog : invRelayLog).Read(nCursor, pnode->nVersion, func);
+    if (nMissed > 0) {
+        LogPrint(BCLog::NET, "%s: %d relayed items expired before peer=%d read them\n", __func__, nMissed, pnode->GetId());
+    }
 }
 
 void CConnman::RecordBytesRecv(uint64_t bytes)
@@ -2746,19 +3258,34 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+CSharedNetMsg::CSharedNetMsg(std::string commandIn, CSendBuffer dataIn) : command(std::move(commandIn)), data(std::move(dataIn))
 {
-    size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
-
+    assert(data);
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
+    uint256 hash = Hash(data->data(), data->data() + data->size());
+    CMessageHeader hdr(Params().MessageStart(), command.c_str(), data->size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    header = std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader));
+}
+
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg) :
+    CSharedNetMsg(std::move(msg.command), std::make_shared<const std::vector<unsigned char>>(std::move(msg.data)))
+{
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, CSharedNetMsg(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.data->size();
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
     size_t nBytesSent = 0;
     {
@@ -2771,13 +3298,17 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.data);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+        // Have the socket handler pick up what's left right away, rather
+        // than when its current wait times out
+        if (optimisticSend && !pnode->vSendMsg.empty())
+            WakeSelect();
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
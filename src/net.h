@@ -23,6 +23,7 @@
 #include <uint256.h>
 #include <threadinterrupt.h>
 
+#include <array>
 #include <atomic>
 #include <deque>
 #include <stdint.h>
@@ -51,6 +52,8 @@ static const unsigned int MAX_INV_SZ = 50000;
 static const unsigned int MAX_LOCATOR_SZ = 101;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** How long (in seconds) the addresses sent in response to getaddr are reused for other peers */
+static const int64_t ADDR_RESPONSE_CACHE_INTERVAL = 30 * 60;
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
 /** Maximum length of strSubVer in `version` message */
@@ -83,6 +86,25 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of message handler threads */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+
+/** How the socket handler thread waits for socket events */
+enum SocketEventsMode {
+    //! poll() (select() where poll is unavailable) over a socket set rebuilt on every iteration
+    SOCKETEVENTS_POLL,
+    //! Edge-triggered epoll, with each socket registered once for its lifetime
+    SOCKETEVENTS_EPOLL,
+};
+/** epoll is opt-in with -socketevents=epoll until it has seen wider use */
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_POLL;
+
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode);
+/** Comma separated list of the socket events modes supported on this platform */
+std::string GetSupportedSocketEventsModes();
 
 typedef int64_t NodeId;
 
@@ -110,6 +132,116 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** A reference counted, immutable buffer in a peer's send queue */
+typedef std::shared_ptr<const std::vector<unsigned char>> CSendBuffer;
+
+/**
+ * A serialized message with its header (and so the payload checksum) built
+ * once, which can be queued to any number of peers without copying or
+ * hashing the payload again.
+ */
+class CSharedNetMsg
+{
+public:
+    CSharedNetMsg(std::string commandIn, CSendBuffer dataIn);
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    std::string command;
+    CSendBuffer header;
+    CSendBuffer data;
+};
+
+
+/**
+ * Log of inventory announced to all peers. An item is appended once, and
+ * each peer reads the items added since its cursor straight from the log
+ * the next time it sends inventory, instead of every announcement being
+ * queued to every peer.
+ *
+ * Entries are kept in fixed-size segments. An entry is never changed once
+ * the segment's size has been bumped past it, so readers only take the
+ * lock to copy the segment pointers they need and scan the entries
+ * without it. Segments are dropped whole.
+ */
+class CInvRelayLog
+{
+public:
+    //! Segments are dropped once all their items are this old, or the log is
+    //! full, even if some peer hasn't read them yet
+    static const int64_t MAX_AGE = 5 * 60;
+    static const size_t MAX_ENTRIES = 100000;
+    static const size_t DEFAULT_SEGMENT_SIZE = 1024;
+
+    explicit CInvRelayLog(size_t nSegmentSizeIn = DEFAULT_SEGMENT_SIZE) : nSegmentSize(nSegmentSizeIn) {}
+
+    void Append(const CInv& inv, int nMinProtoVersion, int64_t nTime);
+    /** Cursor of the next item to be appended */
+    uint64_t GetEnd() const;
+    /**
+     * Call fn for each item appended since nCursor that is meant for a peer
+     * of version nVersion, and move nCursor to the end. Returns the number
+     * of items the peer missed because they were dropped.
+     */
+    template<typename Callable>
+    uint64_t Read(uint64_t& nCursor, int nVersion, Callable&& fn) const
+    {
+        uint64_t nMissed = 0;
+        std::vector<std::shared_ptr<const Segment>> vSegments;
+        {
+            LOCK(cs);
+            const uint64_t nBegin = segments.empty() ? nEnd : segments.front()->nBegin;
+            if (nCursor < nBegin) {
+                nMissed = nBegin - nCursor;
+                nCursor = nBegin;
+            }
+            for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+                vSegments.push_back(*it);
+                if ((*it)->nBegin <= nCursor) break;
+            }
+        }
+        for (auto it = vSegments.rbegin(); it != vSegments.rend(); ++it) {
+            const Segment& segment = **it;
+            const size_t nSize = segment.nSize.load(std::memory_order_acquire);
+            for (size_t i = nCursor - segment.nBegin; i < nSize; i++) {
+                const Entry& entry = segment.entries[i];
+                if (nVersion >= entry.nMinProtoVersion) {
+                    fn(entry.inv);
+                }
+            }
+            nCursor = segment.nBegin + nSize;
+        }
+        return nMissed;
+    }
+    /** Add the items Read would pass on to vInv */
+    uint64_t Read(uint64_t& nCursor, int nVersion, std::vector<CInv>& vInv) const
+    {
+        return Read(nCursor, nVersion, [&vInv](const CInv& inv) { vInv.push_back(inv); });
+    }
+    size_t size() const;
+
+private:
+    struct Entry {
+        CInv inv;
+        int nMinProtoVersion;
+        int64_t nTime;
+    };
+
+    struct Segment {
+        //! Cursor of entries[0]
+        const uint64_t nBegin;
+        const std::unique_ptr<Entry[]> entries;
+        //! Number of entries published to readers
+        std::atomic<size_t> nSize{0};
+
+        Segment(uint64_t nBeginIn, size_t nCapacity) : nBegin(nBeginIn), entries(new Entry[nCapacity]) {}
+    };
+
+    const size_t nSegmentSize;
+    mutable Mutex cs;
+    std::deque<std::shared_ptr<Segment>> segments GUARDED_BY(cs);
+    //! Cursor of the next item to be appended
+    uint64_t nEnd GUARDED_BY(cs){0};
+};
 
 class NetEventsInterface;
 class CConnman
@@ -139,6 +271,8 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
+        int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<CSubNet> vWhitelistedRange;
         std::vector<CService> vBinds, vWhiteBinds;
@@ -161,6 +295,8 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        socketEventsMode = connOptions.socketEventsMode;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -204,6 +340,8 @@ public:
     bool IsDisconnectRequested(const CService& addr);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    /** Queue a message shared with other peers, referencing rather than copying its buffers */
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     template<typename Callable>
     bool ForEachNodeContinueIf(Callable&& func)
@@ -270,7 +408,14 @@ public:
     std::vector<CNode*> CopyNodeVector();
     void ReleaseNodeVector(const std::vector<CNode*>& vecNodes);
 
-    void RelayInv(CInv &inv, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
+    /** Announce inv to all peers of at least minProtoVersion */
+    void RelayInv(const CInv &inv, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
+    /**
+     * Pass the inventory relayed since pnode last read it to func, the
+     * transactions if fTransactions and everything else otherwise. Only
+     * SendMessages may call this for a given node.
+     */
+    void ForEachRelayedInv(CNode* pnode, bool fTransactions, const std::function<void(const CInv&)>& func);
 
     // Addrman functions
     size_t GetAddressCount() const;
@@ -278,6 +423,14 @@ public:
     void MarkAddressGood(const CAddress& addr);
     void AddNewAddresses(const std::vector<CAddress>& vAddr, const CAddress& addrFrom, int64_t nTimePenalty = 0);
     std::vector<CAddress> GetAddresses();
+    /**
+     * Addresses to answer getaddr from requestor with. The same selection is shared by all peers
+     * asking within ADDR_RESPONSE_CACHE_INTERVAL, so answering doesn't wait on addrman, and
+     * repeated requests can't be used to scrape all of its addresses. Peers that reach us over
+     * another network or local address get their own selection, so that comparing the answers
+     * can't link our addresses on different networks.
+     */
+    std::shared_ptr<const std::vector<CAddress>> GetAddressesCached(const CNode& requestor);
 
     // This allows temporarily exceeding nMaxOutbound, with the goal of finding
     // a peer that is better than all our current peers.
@@ -339,7 +492,15 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message handler threads */
     void WakeMessageHandler();
+    /** Wake the message handler thread that processes pnode */
+    void WakeMessageHandler(const CNode* pnode);
+
+    /** Stop the socket handler thread from waiting, e.g. because there is new data to send */
+    void WakeSelect();
+    /** Stop watching a node's socket for events. Must be called with pnode->cs_hSocket held, before the socket is closed. */
+    void UnregisterEvents(CNode* pnode) const;
 
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
@@ -362,13 +523,18 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set, bool fOnlyPoll);
+    bool InitSocketEvents();
+    void CloseSocketEvents();
+    bool RegisterEvents(CNode* pnode);
+    void DrainWakeupPipe();
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -425,6 +591,13 @@ private:
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
     CAddrMan addrman;
+    struct CachedAddrResponse {
+        std::shared_ptr<const std::vector<CAddress>> pAddrs;
+        int64_t nExpiry;
+    };
+    //! Keyed by the network and local address of the requestor, see GetAddressesCached
+    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches GUARDED_BY(cs_addr_response_caches);
+    Mutex cs_addr_response_caches;
     std::deque<std::string> vOneShots GUARDED_BY(cs_vOneShots);
     CCriticalSection cs_vOneShots;
     std::vector<std::string> vAddedNodes GUARDED_BY(cs_vAddedNodes);
@@ -456,21 +629,50 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /**
+     * A message handler thread. Every peer is processed by exactly one of
+     * them, picked by node id, so per-peer message order is kept while
+     * different peers are processed concurrently. Shared state is protected
+     * by the same locks as before: cs_main serializes validation, and module
+     * messages are handed to the modules one at a time.
+     */
+    struct MessageHandler {
+        /** flag for waking the message processor. */
+        bool fMsgProcWake GUARDED_BY(mutexMsgProc){false};
+
+        std::condition_variable condMsgProc;
+        Mutex mutexMsgProc;
+        //! Thread name, which must outlive the thread
+        std::string name;
+        std::thread thread;
+    };
+    std::atomic<int> nMessageHandlerThreads{DEFAULT_MSGHANDLER_THREADS};
 
-    std::condition_variable condMsgProc;
-    Mutex mutexMsgProc;
+    //! Transactions, read at each trickle, and all other relayed inventory
+    CInvRelayLog txRelayLog;
+    CInvRelayLog invRelayLog;
+    //! Only the first nMessageHandlerThreads are used
+    std::array<MessageHandler, MAX_MSGHANDLER_THREADS> messageHandlers;
     std::atomic<bool> flagInterruptMsgProc{false};
 
+    MessageHandler& GetMessageHandler(const CNode* pnode);
+
     CThreadInterrupt interruptNet;
 
+    SocketEventsMode socketEventsMode;
+    //! epoll instance all sockets are registered with in SOCKETEVENTS_EPOLL mode
+    int epollfd{-1};
+    //! Pipe written to by WakeSelect(), watched by the socket handler thread
+    int wakeupPipe[2]{-1, -1};
+    std::atomic<bool> fWakeupPipePending{false};
+    //! Set when the socket handler left work for its next iteration, which then shouldn't wait
+    bool fSocketHandlerMoreWork{false};
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadOpenMasternodeConnections;
-    std::thread threadMessageHandler;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -612,6 +814,36 @@ public:
 
 
 
+/**
+ * Receive buffers kept for reuse in power of two size classes, so that
+ * floods of small messages (inv, ping, ...) don't allocate and free payload
+ * storage for every message.
+ */
+class CNetMessageBufferPool
+{
+public:
+    //! Smallest and largest pooled buffer capacity
+    static const size_t MIN_BUFFER_SIZE = 32;
+    static const size_t MAX_BUFFER_SIZE = 256 * 1024;
+    //! Limits on what is kept in each size class
+    static const size_t MAX_BUFFERS_PER_CLASS = 256;
+    static const size_t MAX_BYTES_PER_CLASS = 512 * 1024;
+
+    /** Return an empty buffer with capacity for at least nSize bytes (up to MAX_BUFFER_SIZE) */
+    CSerializeData Get(size_t nSize);
+    /** Hand a buffer back for reuse; it is freed if it doesn't fit a size class that has room */
+    void Put(CSerializeData&& buffer);
+    /** Number of buffers kept */
+    size_t size() const;
+
+private:
+    static const int NUM_CLASSES = 14;
+    static_assert(MIN_BUFFER_SIZE << (NUM_CLASSES - 1) == MAX_BUFFER_SIZE, "size classes must cover MIN_BUFFER_SIZE to MAX_BUFFER_SIZE");
+
+    mutable Mutex cs;
+    std::array<std::vector<CSerializeData>, NUM_CLASSES> vClasses GUARDED_BY(cs);
+};
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -628,13 +860,13 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
-        in_data = false;
-        nHdrPos = 0;
-        nDataPos = 0;
-        nTime = 0;
-    }
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn);
+    //! Gives the buffers back to the receive buffer pool
+    ~CNetMessage();
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    CNetMessage(const CNetMessage&) = delete;
+    CNetMessage& operator=(const CNetMessage&) = delete;
 
     bool complete() const
     {
@@ -667,7 +899,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -726,6 +958,9 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    // Edge-triggered readiness of hSocket, only used in SOCKETEVENTS_EPOLL mode
+    std::atomic_bool fHasRecvData{false};
+    std::atomic_bool fCanSendData{false};
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -736,8 +971,9 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    CCriticalSection cs_vAddrToSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_vAddrToSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_vAddrToSend);
     bool fGetAddr{false};
     std::set<uint256> setKnown;
     int64_t nNextAddrSend GUARDED_BY(cs_sendProcessing){0};
@@ -756,6 +992,9 @@ public:
     std::vector<CInv> vInventoryOtherToSend GUARDED_BY(cs_inventory);
     CCriticalSection cs_inventory;
     int64_t nNextInvSend{0};
+    // Positions in the connman's relay logs, only used by SendMessages
+    uint64_t nRelayLogCursor{0};
+    uint64_t nTxRelayLogCursor{0};
     // Used for headers announcements - unfiltered blocks to relay
     std::vector<uint256> vBlockHashesToAnnounce GUARDED_BY(cs_inventory);
     // Used for BIP35 mempool sending
@@ -859,11 +1098,14 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        // Other peers' message handler threads relay addresses to this node
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -908,7 +1150,7 @@ public:
         vBlockHashesToAnnounce.push_back(hash);
     }
 
-    void CloseSocketDisconnect();
+    void CloseSocketDisconnect(const CConnman* connman);
 
     void copyStats(CNodeStats &stats);
 
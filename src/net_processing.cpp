@@ -32,6 +32,7 @@
 #include <modules/platform/funding.h>
 #include <modules/masternode/masternode_payments.h>
 #include <modules/masternode/masternode_sync.h>
+#include <modules/masternode/masternode_compact.h>
 #include <modules/masternode/masternode_man.h>
 #include <modules/coinjoin/coinjoin_server.h>
 
@@ -63,6 +64,10 @@ static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
 /** SHA256("main address relay")[0:8] */
 static constexpr uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL;
+/** SHA256("main mnpingbatch salt")[0:8] */
+static constexpr uint64_t RANDOMIZER_ID_MNPINGBATCH = 0x94d51f5cea4fc15fULL;
+/** How long (in seconds) the short ids of masternode ping batches to a peer keep the same salt */
+static constexpr int64_t MNPINGBATCH_SALT_INTERVAL = 10 * 60;
 /// Age after which a stale block will no longer be served if requested as
 /// protection against fingerprinting. Set to one month, denominated in seconds.
 static constexpr int STALE_RELAY_AGE_LIMIT = 30 * 24 * 60 * 60;
@@ -154,6 +159,7 @@ namespace {
         uint256 hash;
         const CBlockIndex* pindex;     //!< Optional.
         bool fValidatedHeaders;  //!< Whether this block has validated headers at the time of request.
+        int64_t nTimeRequested;  //!< When the block was requested (in microseconds).
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
@@ -245,6 +251,10 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the time (in microseconds) between blocks we requested from this peer arriving, or 0.
+    int64_t nBlockIntervalAvg;
+    //! When the last block we requested from this peer arrived (in microseconds).
+    int64_t nLastBlockReceived;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -383,6 +393,8 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlockIntervalAvg = 0;
+        nLastBlockReceived = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -441,11 +453,19 @@ static void PushNodeVersion(CNode *pnode, CConnman* connman, int64_t nTime)
 
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+// nodeFrom is the peer that delivered the block at nNow, if any, to measure its download speed
+static bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1, int64_t nNow = GetTimeMicros()) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
         assert(state != nullptr);
+        if (itInFlight->second.first == nodeFrom) {
+            // While several blocks are in flight this is the time the peer takes to send one,
+            // otherwise it also includes the round trip.
+            const int64_t nInterval = std::max<int64_t>(nNow - std::max(itInFlight->second.second->nTimeRequested, state->nLastBlockReceived), 1);
+            state->nBlockIntervalAvg = state->nBlockIntervalAvg == 0 ? nInterval : (state->nBlockIntervalAvg * 7 + nInterval) / 8;
+            state->nLastBlockReceived = nNow;
+        }
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         if (state->nBlocksInFlightValidHeaders == 0 && itInFlight->second.second->fValidatedHeaders) {
             // Last validated block on the queue was received.
@@ -453,7 +473,7 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
         }
         if (state->vBlocksInFlight.begin() == itInFlight->second.second) {
             // First block on the queue was received, update the start download time for the next one
-            state->nDownloadingSince = std::max(state->nDownloadingSince, GetTimeMicros());
+            state->nDownloadingSince = std::max(state->nDownloadingSince, nNow);
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
@@ -466,7 +486,7 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
 
 // returns false, still setting pit, if the block was already in flight from the same peer
 // pit will only be valid as long as the same cs_main lock is being held
-static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr, int64_t nNow = GetTimeMicros()) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     CNodeState *state = State(nodeid);
     assert(state != nullptr);
 
@@ -480,15 +500,15 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     }
 
     // Make sure it's not listed somewhere already.
-    MarkBlockAsReceived(hash);
+    MarkBlockAsReceived(hash, -1, nNow);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, nNow, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
         // We're starting a block download (batch) from this peer.
-        state->nDownloadingSince = GetTimeMicros();
+        state->nDownloadingSince = nNow;
     }
     if (state->nBlocksInFlightValidHeaders == 1 && pindex != nullptr) {
         nPeersWithValidatedDownloads++;
@@ -600,8 +620,9 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex) EXCLUSIV
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+ *  at most count entries. nWindow is the size of the download window, and ppindexStalling is set to
+ *  the in-flight block holding it back along with nodeStaller. */
+static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams, unsigned int nWindow = BLOCK_DOWNLOAD_WINDOW, const CBlockIndex** ppindexStalling = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
         return;
@@ -632,12 +653,13 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than nWindow + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + nWindow;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -673,6 +695,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        if (ppindexStalling) *ppindexStalling = pindexWaitingFor;
                     }
                     return;
                 }
@@ -683,6 +706,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -752,6 +776,17 @@ void RequestInv(CNodeState* state, const CInv& inv, std::chrono::microseconds cu
 
 } // namespace
 
+void EraseObjectRequest(NodeId nodeid, const CInv& inv)
+{
+    AssertLockHeld(cs_main);
+    CNodeState* nodestate = State(nodeid);
+    if (nodestate) {
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+    }
+    EraseInvRequest(inv.hash);
+}
+
 // This function is used for testing the stale tip eviction logic, see
 // denialofservice_tests.cpp
 void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds)
@@ -761,6 +796,65 @@ void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds)
     if (state) state->m_last_block_announcement = time_in_seconds;
 }
 
+/** Number of blocks to keep in flight from a peer: enough to cover twice the blocks it can send in a
+ *  round trip, so its link stays busy without queueing blocks a faster peer could deliver sooner. */
+int GetBlocksInTransitTarget(NodeId nodeid, int64_t nPingUsec) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CNodeState* state = State(nodeid);
+    if (!state || state->nBlockIntervalAvg == 0 || nPingUsec <= 0 || nPingUsec == std::numeric_limits<int64_t>::max()) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    const int64_t nTarget = 2 * (nPingUsec / state->nBlockIntervalAvg + 1);
+    return std::min<int64_t>(std::max<int64_t>(nTarget, MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER), MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+/** Size the download window to what all our peers together can deliver in BLOCK_DOWNLOAD_WINDOW_TIME seconds */
+unsigned int GetBlockDownloadWindow() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (fPruneMode) {
+        // Keep blocks on disk in close to chain order so they can be pruned together
+        return BLOCK_DOWNLOAD_WINDOW;
+    }
+    double dBlocksPerSecond = 0;
+    for (const auto& entry : mapNodeState) {
+        if (entry.second.nBlockIntervalAvg > 0) {
+            dBlocksPerSecond += 1000000.0 / entry.second.nBlockIntervalAvg;
+        }
+    }
+    return std::min<double>(std::max<double>(dBlocksPerSecond * BLOCK_DOWNLOAD_WINDOW_TIME, BLOCK_DOWNLOAD_WINDOW), MAX_BLOCK_DOWNLOAD_WINDOW);
+}
+
+/** Whether nodeid should take over the block staller holds back the download window with: nodeid has been
+ *  delivering blocks faster, and the block is well overdue for the rate staller delivers at. */
+bool IsStallingBlockOverdue(NodeId nodeid, NodeId staller, const uint256& hash, int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CNodeState* state = State(nodeid);
+    const CNodeState* stateStaller = State(staller);
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (!state || !stateStaller || itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != staller) {
+        return false;
+    }
+    if (state->nBlockIntervalAvg == 0 || stateStaller->nBlockIntervalAvg <= state->nBlockIntervalAvg) {
+        return false;
+    }
+    const int64_t nExpected = stateStaller->nBlockIntervalAvg * stateStaller->nBlocksInFlight;
+    return nNow - itInFlight->second.second->nTimeRequested > std::max<int64_t>(2 * nExpected, BLOCK_REASSIGN_MIN_AGE);
+}
+
+// These functions are used for testing the adaptive block download logic, see
+// denialofservice_tests.cpp
+void MarkBlockAsInFlightAt(NodeId nodeid, const CBlockIndex* pindex, int64_t nTime)
+{
+    LOCK(cs_main);
+    MarkBlockAsInFlight(nodeid, pindex->GetBlockHash(), pindex, nullptr, nTime);
+}
+
+bool MarkBlockAsReceivedAt(const uint256& hash, NodeId nodeFrom, int64_t nTime)
+{
+    LOCK(cs_main);
+    return MarkBlockAsReceived(hash, nodeFrom, nTime);
+}
+
 // Returns true for outbound peers, excluding manual connections, feelers, and
 // one-shots
 static bool IsOutboundDisconnectionCandidate(const CNode *node)
@@ -1010,8 +1104,8 @@ static bool BlockRequestAllowed(const CBlockIndex* pindex, const Consensus::Para
         (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) < STALE_RELAY_AGE_LIMIT);
 }
 
-PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CScheduler &scheduler, bool enable_bip61)
-    : connman(connmanIn), m_banman(banman), m_stale_tip_check_time(0), m_enable_bip61(enable_bip61) {
+PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CScheduler &scheduler, bool enable_bip61, bool adaptive_download)
+    : connman(connmanIn), m_banman(banman), m_stale_tip_check_time(0), m_enable_bip61(enable_bip61), m_adaptive_download(adaptive_download) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 
@@ -1064,6 +1158,8 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
 static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent_block);
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+//! most_recent_compact_block serialized with witnesses, shared by all peers it is announced to
+static std::shared_ptr<const CSharedNetMsg> most_recent_compact_block_msg GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
 
@@ -1074,6 +1170,8 @@ static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    // Serialize once, every peer gets a reference to the same buffers
+    std::shared_ptr<const CSharedNetMsg> pcmpctblockmsg = std::make_shared<const CSharedNetMsg>(msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
 
     LOCK(cs_main);
 
@@ -1090,13 +1188,13 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_msg = pcmpctblockmsg;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    connman->ForEachNode([this, &pcmpctblockmsg, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -1108,7 +1206,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, *pcmpctblockmsg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1235,26 +1333,27 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         We want to only update the time on new hits, so that we can time out appropriately if needed.
     */
     case MSG_MASTERNODE_PAYMENT_VOTE:
-        return mnpayments.mapMasternodePaymentVotes.count(inv.hash);
+        return mnpayments.HasPaymentVote(inv.hash);
 
     case MSG_MASTERNODE_PAYMENT_BLOCK:
         {
             CBlockIndex* pindex = LookupBlockIndex(inv.hash);
+            LOCK(cs_mapMasternodeBlocks);
             return pindex && mnpayments.mapMasternodeBlocks.find(pindex->nHeight) != mnpayments.mapMasternodeBlocks.end();
         }
 
     case MSG_MASTERNODE_ANNOUNCE:
-        return mnodeman.mapSeenMasternodeBroadcast.count(inv.hash) && !mnodeman.IsMnbRecoveryRequested(inv.hash);
+        return mnodeman.HasSeenMasternodeBroadcast(inv.hash);
 
     case MSG_MASTERNODE_PING:
-        return mnodeman.mapSeenMasternodePing.count(inv.hash);
+        return mnodeman.HasSeenMasternodePing(inv.hash);
 
     case MSG_GOVERNANCE_OBJECT:
     case MSG_GOVERNANCE_OBJECT_VOTE:
         return !funding.ConfirmInventoryRequest(inv);
 
     case MSG_MASTERNODE_VERIFY:
-        return mnodeman.mapSeenMasternodeVerification.count(inv.hash);
+        return mnodeman.HasSeenMasternodeVerification(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -1262,11 +1361,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
-    CInv inv(MSG_TX, tx.GetHash());
-    connman->ForEachNode([&inv](CNode* pnode)
-    {
-        pnode->PushInventory(inv);
-    });
+    connman->RelayInv(CInv(MSG_TX, tx.GetHash()));
 }
 
 static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connman)
@@ -1378,21 +1473,29 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
+        } else if (inv.type == MSG_WITNESS_BLOCK ||
+                   (inv.type == MSG_BLOCK && RawBlockMatchesSerialization(pindex, SERIALIZE_TRANSACTION_NO_WITNESS, consensusParams))) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
+            // as the network format matches the format on disk (blocks before segwit
+            // activation have no witness data, so this holds for MSG_BLOCK too)
+            std::shared_ptr<const std::vector<uint8_t>> cached_data = GetCachedRawBlock(pindex->GetBlockHash());
+            if (cached_data) {
+                // Queue the cached bytes by reference instead of copying them
+                connman->PushMessage(pfrom, CSharedNetMsg(NetMsgType::BLOCK, std::move(cached_data)));
+            } else {
+                std::vector<uint8_t> block_data;
+                if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+                    assert(!"cannot load block from disk");
+                }
+                // Hand the bytes read from disk to the send queue as they are
+                connman->PushMessage(pfrom, msgMaker.MakeRaw(NetMsgType::BLOCK, std::move(block_data)));
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
             // Don't set pblock as we've sent the block
         } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+            // Send block from the recent block cache or disk
+            pblock = ReadBlockCached(pindex, consensusParams);
+            if (!pblock)
                 assert(!"cannot load block from disk");
-            pblock = pblockRead;
         }
         if (pblock) {
             if (inv.type == MSG_BLOCK)
@@ -1500,20 +1603,23 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
             }
             else if (!push) {
                 if (inv.type == MSG_MASTERNODE_PAYMENT_VOTE) {
-                    if(mnpayments.HasVerifiedPaymentVote(inv.hash)) {
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTE, mnpayments.mapMasternodePaymentVotes[inv.hash]));
+                    CMasternodePaymentVote vote;
+                    if(mnpayments.GetVerifiedPaymentVote(inv.hash, vote)) {
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTE, vote));
                         push = true;
                     }
                 }
                 else if (inv.type == MSG_MASTERNODE_PAYMENT_BLOCK) {
                     CBlockIndex* pindex = LookupBlockIndex(inv.hash);
                     LOCK(cs_mapMasternodeBlocks);
-                    if (pindex && mnpayments.mapMasternodeBlocks.count(pindex->nHeight)) {
-                        for (CMasternodePayee& payee : mnpayments.mapMasternodeBlocks[pindex->nHeight].vecPayees) {
+                    const auto it = pindex ? mnpayments.mapMasternodeBlocks.find(pindex->nHeight) : mnpayments.mapMasternodeBlocks.end();
+                    if (it != mnpayments.mapMasternodeBlocks.end()) {
+                        for (CMasternodePayee& payee : it->second.vecPayees) {
                             std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
                             for (uint256& hash : vecVoteHashes) {
-                                if(mnpayments.HasVerifiedPaymentVote(hash)) {
-                                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTE, mnpayments.mapMasternodePaymentVotes[hash]));
+                                CMasternodePaymentVote vote;
+                                if(mnpayments.GetVerifiedPaymentVote(hash, vote)) {
+                                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTVOTE, vote));
                                 }
                             }
                         }
@@ -1521,14 +1627,16 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
                     }
                 }
                 else if (inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if(mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)){
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNANNOUNCE, mnodeman.mapSeenMasternodeBroadcast[inv.hash].second));
+                    CMasternodeBroadcast mnb;
+                    if(mnodeman.GetSeenMasternodeBroadcast(inv.hash, mnb)){
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNANNOUNCE, mnb));
                         push = true;
                     }
                 }
                 else if (inv.type == MSG_MASTERNODE_PING) {
-                    if(mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNPING, mnodeman.mapSeenMasternodePing[inv.hash]));
+                    CMasternodePing mnp;
+                    if(mnodeman.GetSeenMasternodePing(inv.hash, mnp)) {
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNPING, mnp));
                         push = true;
                     }
                 }
@@ -1568,8 +1676,9 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
                         }
                     }
                 else if (inv.type == MSG_MASTERNODE_VERIFY) {
-                    if(mnodeman.mapSeenMasternodeVerification.count(inv.hash)) {
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNVERIFY, mnodeman.mapSeenMasternodeVerification[inv.hash]));
+                    CMasternodeVerification mnv;
+                    if(mnodeman.GetSeenMasternodeVerification(inv.hash, mnv)) {
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNVERIFY, mnv));
                         push = true;
                     }
                 }
@@ -1636,7 +1745,13 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
         return true;
     }
 
+    // Hash the headers up front, on several threads and without holding
+    // cs_main; validation reuses these hashes.
+    std::vector<uint256> hashes;
+    HashBlockHeaders(headers, hashes);
+
     bool received_new_header = false;
+    bool requested_more = false;
     const CBlockIndex *pindexLast = nullptr;
     {
         LOCK(cs_main);
@@ -1654,14 +1769,14 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
             nodestate->nUnconnectingHeaders++;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256()));
             LogPrint(BCLog::NET, "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
-                    headers[0].GetHash().ToString(),
+                    hashes[0].ToString(),
                     headers[0].hashPrevBlock.ToString(),
                     pindexBestHeader->nHeight,
                     pfrom->GetId(), nodestate->nUnconnectingHeaders);
             // Set hashLastUnknownBlock for this peer, so that if we
             // eventually get the headers - even from a different peer -
             // we can use this peer to download.
-            UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+            UpdateBlockAvailability(pfrom->GetId(), hashes.back());
 
             if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -1669,25 +1784,36 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
             return true;
         }
 
-        uint256 hashLastBlock;
-        for (const CBlockHeader& header : headers) {
-            if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
+        for (size_t i = 1; i < nCount; i++) {
+            if (headers[i].hashPrevBlock != hashes[i - 1]) {
                 Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
                 return false;
             }
-            hashLastBlock = header.GetHash();
         }
+        const uint256& hashLastBlock = hashes.back();
 
         // If we don't have the last header, then they'll have given us
         // something new (if these headers are valid).
         if (!LookupBlockIndex(hashLastBlock)) {
             received_new_header = true;
         }
+
+        // A full headers message means the peer may have more headers. When
+        // these connect to our tree, ask for the next ones now, starting from
+        // the last header, so the peer sends them while we validate these.
+        // Our own locator follows in case the peer doesn't know that header.
+        if (nCount == MAX_HEADERS_RESULTS && received_new_header && LookupBlockIndex(headers[0].hashPrevBlock)) {
+            CBlockLocator locator = chainActive.GetLocator(pindexBestHeader);
+            locator.vHave.insert(locator.vHave.begin(), hashLastBlock);
+            LogPrint(BCLog::NET, "more getheaders from %s to end to peer=%d (startheight:%d)\n", hashLastBlock.ToString(), pfrom->GetId(), pfrom->nStartingHeight);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, locator, uint256()));
+            requested_more = true;
+        }
     }
 
     CValidationState state;
     CBlockHeader first_invalid_header;
-    if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast, &first_invalid_header)) {
+    if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast, &first_invalid_header, &hashes)) {
         int nDoS;
         if (state.IsInvalid(nDoS)) {
             LOCK(cs_main);
@@ -1753,7 +1879,7 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
             nodestate->m_last_block_announcement = GetTime();
         }
 
-        if (nCount == MAX_HEADERS_RESULTS) {
+        if (nCount == MAX_HEADERS_RESULTS && !requested_more) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -2685,148 +2811,141 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         return true;
     }
 
+    // Module messages are handed over without holding cs_main, the handlers take
+    // it as needed. It is only taken afterwards to forget the request.
     if (strCommand == NetMsgType::MNANNOUNCE)
     {
         if (fReindex || fImporting || IsInitialBlockDownload()) return true;
-        {
-            LOCK(cs_main);
-
-            CDataStream ss(vRecv);
-            CMasternodeBroadcast mnb;
-            ss >> mnb;
-            CInv inv(MSG_MASTERNODE_ANNOUNCE, mnb.GetHash());
-            pfrom->AddInventoryKnown(inv);
+        CDataStream ss(vRecv);
+        CMasternodeBroadcast mnb;
+        ss >> mnb;
+        CInv inv(MSG_MASTERNODE_ANNOUNCE, mnb.GetHash());
+        pfrom->AddInventoryKnown(inv);
 
-            GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
-            LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
 
-            CNodeState* nodestate = State(pfrom->GetId());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
 
-            nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
-            nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
-            EraseInvRequest(inv.hash);
-            return true;
-        }
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+        EraseInvRequest(inv.hash);
+        return true;
     }
 
     if (strCommand == NetMsgType::MNPING)
     {
         if (fReindex || fImporting || IsInitialBlockDownload()) return true;
-        {
-            LOCK(cs_main);
+        CDataStream ss(vRecv);
+        CMasternodePing mnp;
+        ss >> mnp;
+        CInv inv(MSG_MASTERNODE_PING, mnp.GetHash());
+        pfrom->AddInventoryKnown(inv);
 
-            CDataStream ss(vRecv);
-            CMasternodePing mnp;
-            ss >> mnp;
-            CInv inv(MSG_MASTERNODE_PING, mnp.GetHash());
-            pfrom->AddInventoryKnown(inv);
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
 
-            GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
-            LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
 
-            CNodeState* nodestate = State(pfrom->GetId());
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+        EraseInvRequest(inv.hash);
+        return true;
+    }
 
-            nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
-            nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
-            EraseInvRequest(inv.hash);
-            return true;
-        }
+    if (strCommand == NetMsgType::MNPINGBATCH)
+    {
+        if (fReindex || fImporting || IsInitialBlockDownload()) return true;
+        // Pings are marked known, and their requests forgotten, as they are resolved by the masternode manager
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        return true;
     }
 
     if (strCommand == NetMsgType::MNVERIFY)
     {
         if (fReindex || fImporting || IsInitialBlockDownload()) return true;
-        {
-            LOCK(cs_main);
-
-            CDataStream ss(vRecv);
-            CMasternodeVerification mnv;
-            ss >> mnv;
-            CInv inv(MSG_MASTERNODE_VERIFY, mnv.GetHash());
-            pfrom->AddInventoryKnown(inv);
+        CDataStream ss(vRecv);
+        CMasternodeVerification mnv;
+        ss >> mnv;
+        CInv inv(MSG_MASTERNODE_VERIFY, mnv.GetHash());
+        pfrom->AddInventoryKnown(inv);
 
-            GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
-            LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_MAN, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
 
-            CNodeState* nodestate = State(pfrom->GetId());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
 
-            nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
-            nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
-            EraseInvRequest(inv.hash);
-            return true;
-        }
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+        EraseInvRequest(inv.hash);
+        return true;
     }
 
     if (strCommand == NetMsgType::MASTERNODEPAYMENTVOTE)
     {
         if (fReindex || fImporting || IsInitialBlockDownload()) return true;
-        {
-            LOCK(cs_main);
-
-            CDataStream ss(vRecv);
-            CMasternodePaymentVote mnv;
-            ss >> mnv;
-            CInv inv(MSG_MASTERNODE_PAYMENT_VOTE, mnv.GetHash());
-            pfrom->AddInventoryKnown(inv);
+        CDataStream ss(vRecv);
+        CMasternodePaymentVote mnv;
+        ss >> mnv;
+        CInv inv(MSG_MASTERNODE_PAYMENT_VOTE, mnv.GetHash());
+        pfrom->AddInventoryKnown(inv);
 
-            GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_PAY, strCommand, vRecv, connman);
-            LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_MN_PAY, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
 
-            CNodeState* nodestate = State(pfrom->GetId());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
 
-            nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
-            nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
-            EraseInvRequest(inv.hash);
-            return true;
-        }
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+        EraseInvRequest(inv.hash);
+        return true;
     }
 
     if (strCommand == NetMsgType::MNGOVERNANCEOBJECT)
     {
         if (fReindex || fImporting || IsInitialBlockDownload()) return true;
-        {
-            LOCK(cs_main);
-
-            CDataStream ss(vRecv);
-            CGovernanceObject govobj;
-            ss >> govobj;
-            CInv inv(MSG_GOVERNANCE_OBJECT, govobj.GetHash());
-            pfrom->AddInventoryKnown(inv);
+        CDataStream ss(vRecv);
+        CGovernanceObject govobj;
+        ss >> govobj;
+        CInv inv(MSG_GOVERNANCE_OBJECT, govobj.GetHash());
+        pfrom->AddInventoryKnown(inv);
 
-            GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_FUND, strCommand, vRecv, connman);
-            LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_FUND, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
 
-            CNodeState* nodestate = State(pfrom->GetId());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
 
-            nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
-            nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
-            EraseInvRequest(inv.hash);
-            return true;
-        }
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+        EraseInvRequest(inv.hash);
+        return true;
     }
 
     if (strCommand == NetMsgType::MNGOVERNANCEOBJECTVOTE)
     {
         if (fReindex || fImporting || IsInitialBlockDownload()) return true;
-        {
-            LOCK(cs_main);
-
-            CDataStream ss(vRecv);
-            CGovernanceVote vote;
-            ss >> vote;
-            CInv inv(MSG_GOVERNANCE_OBJECT_VOTE, vote.GetHash());
-            pfrom->AddInventoryKnown(inv);
+        CDataStream ss(vRecv);
+        CGovernanceVote vote;
+        ss >> vote;
+        CInv inv(MSG_GOVERNANCE_OBJECT_VOTE, vote.GetHash());
+        pfrom->AddInventoryKnown(inv);
 
-            GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_FUND, strCommand, vRecv, connman);
-            LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
+        GetMainSignals().ProcessModuleMessage(pfrom, NetMsgDest::MSG_FUND, strCommand, vRecv, connman);
+        LogPrint(BCLog::NET, "Forwarded message \"%s\" from peer=%d to Bagicoin modules\n", SanitizeString(strCommand), pfrom->GetId());
 
-            CNodeState* nodestate = State(pfrom->GetId());
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
 
-            nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
-            nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
-            EraseInvRequest(inv.hash);
-            return true;
-        }
+        nodestate->m_inv_download.m_inv_announced.erase(inv.hash);
+        nodestate->m_inv_download.m_inv_in_flight.erase(inv.hash);
+        EraseInvRequest(inv.hash);
+        return true;
     }
 
     if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
@@ -3164,7 +3283,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash);
+            forceProcessing |= MarkBlockAsReceived(hash, pfrom->GetId());
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
@@ -3199,10 +3318,13 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
-        std::vector<CAddress> vAddr = connman->GetAddresses();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
+        std::shared_ptr<const std::vector<CAddress>> pAddrs = connman->GetAddressesCached(*pfrom);
         FastRandomContext insecure_rand;
-        for (const CAddress &addr : vAddr) {
+        for (const CAddress &addr : *pAddrs) {
             if (!g_banman->IsBanned(addr)) {
                 pfrom->PushAddress(addr, insecure_rand);
             }
@@ -3719,11 +3841,11 @@ public:
         mp = _mempool;
     }
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(const uint256& a, const uint256& b)
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
          * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+        return mp->CompareDepthAndScore(b, a);
     }
 };
 }
@@ -3768,12 +3890,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             }
         }
 
-        TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
-        if (!lockMain)
-            return true;
-
-        if (SendRejectsAndCheckIfBanned(pto, m_enable_bip61)) return true;
-        CNodeState &state = *State(pto->GetId());
+        // Only the parts below that use chain state or CNodeState take cs_main, and
+        // they wait for it rather than skip the pass. Address and inventory relay
+        // use the peer's own locks, so that message handler threads don't queue up
+        // on cs_main for them.
+        {
+            LOCK(cs_main);
+            if (SendRejectsAndCheckIfBanned(pto, m_enable_bip61)) return true;
+        }
 
         // Address refresh broadcast
         int64_t nNow = GetTimeMicros();
@@ -3787,6 +3911,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3811,182 +3936,193 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 pto->vAddrToSend.shrink_to_fit();
         }
 
-        // Start block sync
-        if (pindexBestHeader == nullptr)
-            pindexBestHeader = chainActive.Tip();
-        bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
-        if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
-            // Only actively request headers from a single peer, unless we're close to end of initial download.
-            if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
-                state.fSyncStarted = true;
-                state.nHeadersSyncTimeout = GetTimeMicros() + HEADERS_DOWNLOAD_TIMEOUT_BASE + HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER * (GetAdjustedTime() - pindexBestHeader->GetBlockTime())/(consensusParams.nPowTargetSpacing);
-                nSyncStarted++;
-                const CBlockIndex *pindexStart = pindexBestHeader;
-                /* If possible, start at the block preceding the currently
-                   best known header.  This ensures that we always get a
-                   non-empty list of headers back as long as the peer
-                   is up-to-date.  With a non-empty response, we can initialise
-                   the peer's known best block.  This wouldn't be possible
-                   if we requested starting at pindexBestHeader and
-                   got back an empty response.  */
-                if (pindexStart->pprev)
-                    pindexStart = pindexStart->pprev;
-                LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), uint256()));
+        bool fFetch;
+        {
+            LOCK(cs_main);
+            CNodeState &state = *State(pto->GetId());
+
+            // Start block sync
+            if (pindexBestHeader == nullptr)
+                pindexBestHeader = chainActive.Tip();
+            fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
+            if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
+                // Only actively request headers from a single peer, unless we're close to end of initial download.
+                if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
+                    state.fSyncStarted = true;
+                    state.nHeadersSyncTimeout = GetTimeMicros() + HEADERS_DOWNLOAD_TIMEOUT_BASE + HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER * (GetAdjustedTime() - pindexBestHeader->GetBlockTime())/(consensusParams.nPowTargetSpacing);
+                    nSyncStarted++;
+                    const CBlockIndex *pindexStart = pindexBestHeader;
+                    /* If possible, start at the block preceding the currently
+                       best known header.  This ensures that we always get a
+                       non-empty list of headers back as long as the peer
+                       is up-to-date.  With a non-empty response, we can initialise
+                       the peer's known best block.  This wouldn't be possible
+                       if we requested starting at pindexBestHeader and
+                       got back an empty response.  */
+                    if (pindexStart->pprev)
+                        pindexStart = pindexStart->pprev;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), uint256()));
+                }
             }
-        }
 
-        // Resend wallet transactions that haven't gotten in a block yet
-        // Except during reindex, importing and IBD, when old wallet
-        // transactions become unconfirmed and spams other nodes.
-        if (!fReindex && !fImporting && !IsInitialBlockDownload())
-        {
-            GetMainSignals().Broadcast(nTimeBestReceived, connman);
-        }
+            // Resend wallet transactions that haven't gotten in a block yet
+            // Except during reindex, importing and IBD, when old wallet
+            // transactions become unconfirmed and spams other nodes.
+            if (!fReindex && !fImporting && !IsInitialBlockDownload())
+            {
+                GetMainSignals().Broadcast(nTimeBestReceived, connman);
+            }
 
-        //
-        // Try sending block announcements via headers
-        //
-        {
-            // If we have less than MAX_BLOCKS_TO_ANNOUNCE in our
-            // list of block hashes we're relaying, and our peer wants
-            // headers announcements, then find the first header
-            // not yet known to our peer but would connect, and send.
-            // If no header would connect, or if we have too many
-            // blocks, or if the peer doesn't want headers, just
-            // add all to the inv queue.
-            LOCK(pto->cs_inventory);
-            std::vector<CBlock> vHeaders;
-            bool fRevertToInv = ((!state.fPreferHeaders &&
-                                 (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
-                                pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
-            const CBlockIndex *pBestIndex = nullptr; // last header queued for delivery
-            ProcessBlockAvailability(pto->GetId()); // ensure pindexBestKnownBlock is up-to-date
-
-            if (!fRevertToInv) {
-                bool fFoundStartingHeader = false;
-                // Try to find first header that our peer doesn't have, and
-                // then send all headers past that one.  If we come across any
-                // headers that aren't on chainActive, give up.
-                for (const uint256 &hash : pto->vBlockHashesToAnnounce) {
-                    const CBlockIndex* pindex = LookupBlockIndex(hash);
-                    assert(pindex);
-                    if (chainActive[pindex->nHeight] != pindex) {
-                        // Bail out if we reorged away from this block
-                        fRevertToInv = true;
-                        break;
-                    }
-                    if (pBestIndex != nullptr && pindex->pprev != pBestIndex) {
-                        // This means that the list of blocks to announce don't
-                        // connect to each other.
-                        // This shouldn't really be possible to hit during
-                        // regular operation (because reorgs should take us to
-                        // a chain that has some block not on the prior chain,
-                        // which should be caught by the prior check), but one
-                        // way this could happen is by using invalidateblock /
-                        // reconsiderblock repeatedly on the tip, causing it to
-                        // be added multiple times to vBlockHashesToAnnounce.
-                        // Robustly deal with this rare situation by reverting
-                        // to an inv.
-                        fRevertToInv = true;
-                        break;
-                    }
-                    pBestIndex = pindex;
-                    if (fFoundStartingHeader) {
-                        // add this to the headers message
-                        vHeaders.push_back(pindex->GetBlockHeader());
-                    } else if (PeerHasHeader(&state, pindex)) {
-                        continue; // keep looking for the first new block
-                    } else if (pindex->pprev == nullptr || PeerHasHeader(&state, pindex->pprev)) {
-                        // Peer doesn't have this header but they do have the prior one.
-                        // Start sending headers.
-                        fFoundStartingHeader = true;
-                        vHeaders.push_back(pindex->GetBlockHeader());
-                    } else {
-                        // Peer doesn't have this header or the prior one -- nothing will
-                        // connect, so bail out.
-                        fRevertToInv = true;
-                        break;
+            //
+            // Try sending block announcements via headers
+            //
+            {
+                // If we have less than MAX_BLOCKS_TO_ANNOUNCE in our
+                // list of block hashes we're relaying, and our peer wants
+                // headers announcements, then find the first header
+                // not yet known to our peer but would connect, and send.
+                // If no header would connect, or if we have too many
+                // blocks, or if the peer doesn't want headers, just
+                // add all to the inv queue.
+                LOCK(pto->cs_inventory);
+                std::vector<CBlock> vHeaders;
+                bool fRevertToInv = ((!state.fPreferHeaders &&
+                                     (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
+                                    pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
+                const CBlockIndex *pBestIndex = nullptr; // last header queued for delivery
+                ProcessBlockAvailability(pto->GetId()); // ensure pindexBestKnownBlock is up-to-date
+
+                if (!fRevertToInv) {
+                    bool fFoundStartingHeader = false;
+                    // Try to find first header that our peer doesn't have, and
+                    // then send all headers past that one.  If we come across any
+                    // headers that aren't on chainActive, give up.
+                    for (const uint256 &hash : pto->vBlockHashesToAnnounce) {
+                        const CBlockIndex* pindex = LookupBlockIndex(hash);
+                        assert(pindex);
+                        if (chainActive[pindex->nHeight] != pindex) {
+                            // Bail out if we reorged away from this block
+                            fRevertToInv = true;
+                            break;
+                        }
+                        if (pBestIndex != nullptr && pindex->pprev != pBestIndex) {
+                            // This means that the list of blocks to announce don't
+                            // connect to each other.
+                            // This shouldn't really be possible to hit during
+                            // regular operation (because reorgs should take us to
+                            // a chain that has some block not on the prior chain,
+                            // which should be caught by the prior check), but one
+                            // way this could happen is by using invalidateblock /
+                            // reconsiderblock repeatedly on the tip, causing it to
+                            // be added multiple times to vBlockHashesToAnnounce.
+                            // Robustly deal with this rare situation by reverting
+                            // to an inv.
+                            fRevertToInv = true;
+                            break;
+                        }
+                        pBestIndex = pindex;
+                        if (fFoundStartingHeader) {
+                            // add this to the headers message
+                            vHeaders.push_back(pindex->GetBlockHeader());
+                        } else if (PeerHasHeader(&state, pindex)) {
+                            continue; // keep looking for the first new block
+                        } else if (pindex->pprev == nullptr || PeerHasHeader(&state, pindex->pprev)) {
+                            // Peer doesn't have this header but they do have the prior one.
+                            // Start sending headers.
+                            fFoundStartingHeader = true;
+                            vHeaders.push_back(pindex->GetBlockHeader());
+                        } else {
+                            // Peer doesn't have this header or the prior one -- nothing will
+                            // connect, so bail out.
+                            fRevertToInv = true;
+                            break;
+                        }
                     }
                 }
-            }
-            if (!fRevertToInv && !vHeaders.empty()) {
-                if (vHeaders.size() == 1 && state.fPreferHeaderAndIDs) {
-                    // We only send up to 1 block as header-and-ids, as otherwise
-                    // probably means we're doing an initial-ish-sync or they're slow
-                    LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", __func__,
-                            vHeaders.front().GetHash().ToString(), pto->GetId());
+                if (!fRevertToInv && !vHeaders.empty()) {
+                    if (vHeaders.size() == 1 && state.fPreferHeaderAndIDs) {
+                        // We only send up to 1 block as header-and-ids, as otherwise
+                        // probably means we're doing an initial-ish-sync or they're slow
+                        LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", __func__,
+                                vHeaders.front().GetHash().ToString(), pto->GetId());
 
-                    int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+                        int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
 
-                    bool fGotBlockFromCache = false;
-                    {
-                        LOCK(cs_most_recent_block);
-                        if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
-                            else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                        bool fGotBlockFromCache = false;
+                        {
+                            LOCK(cs_most_recent_block);
+                            if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
+                                if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock) {
+                                    // Without witnesses both serializations are the same
+                                    connman->PushMessage(pto, *most_recent_compact_block_msg);
+                                } else {
+                                    CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
+                                    connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                                }
+                                fGotBlockFromCache = true;
                             }
-                            fGotBlockFromCache = true;
                         }
-                    }
-                    if (!fGotBlockFromCache) {
-                        CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
-                        assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                        connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
-                    state.pindexBestHeaderSent = pBestIndex;
-                } else if (state.fPreferHeaders) {
-                    if (vHeaders.size() > 1) {
-                        LogPrint(BCLog::NET, "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
-                                vHeaders.size(),
-                                vHeaders.front().GetHash().ToString(),
-                                vHeaders.back().GetHash().ToString(), pto->GetId());
-                    } else {
-                        LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
-                                vHeaders.front().GetHash().ToString(), pto->GetId());
-                    }
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
-                    state.pindexBestHeaderSent = pBestIndex;
-                } else
-                    fRevertToInv = true;
-            }
-            if (fRevertToInv) {
-                // If falling back to using an inv, just try to inv the tip.
-                // The last entry in vBlockHashesToAnnounce was our tip at some point
-                // in the past.
-                if (!pto->vBlockHashesToAnnounce.empty()) {
-                    const uint256 &hashToAnnounce = pto->vBlockHashesToAnnounce.back();
-                    const CBlockIndex* pindex = LookupBlockIndex(hashToAnnounce);
-                    assert(pindex);
-
-                    // Warn if we're announcing a block that is not on the main chain.
-                    // This should be very rare and could be optimized out.
-                    // Just log for now.
-                    if (chainActive[pindex->nHeight] != pindex) {
-                        LogPrint(BCLog::NET, "Announcing block %s not on main chain (tip=%s)\n",
-                            hashToAnnounce.ToString(), chainActive.Tip()->GetBlockHash().ToString());
-                    }
+                        if (!fGotBlockFromCache) {
+                            CBlock block;
+                            bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
+                            assert(ret);
+                            CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
+                            connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                        }
+                        state.pindexBestHeaderSent = pBestIndex;
+                    } else if (state.fPreferHeaders) {
+                        if (vHeaders.size() > 1) {
+                            LogPrint(BCLog::NET, "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
+                                    vHeaders.size(),
+                                    vHeaders.front().GetHash().ToString(),
+                                    vHeaders.back().GetHash().ToString(), pto->GetId());
+                        } else {
+                            LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
+                                    vHeaders.front().GetHash().ToString(), pto->GetId());
+                        }
+                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                        state.pindexBestHeaderSent = pBestIndex;
+                    } else
+                        fRevertToInv = true;
+                }
+                if (fRevertToInv) {
+                    // If falling back to using an inv, just try to inv the tip.
+                    // The last entry in vBlockHashesToAnnounce was our tip at some point
+                    // in the past.
+                    if (!pto->vBlockHashesToAnnounce.empty()) {
+                        const uint256 &hashToAnnounce = pto->vBlockHashesToAnnounce.back();
+                        const CBlockIndex* pindex = LookupBlockIndex(hashToAnnounce);
+                        assert(pindex);
+
+                        // Warn if we're announcing a block that is not on the main chain.
+                        // This should be very rare and could be optimized out.
+                        // Just log for now.
+                        if (chainActive[pindex->nHeight] != pindex) {
+                            LogPrint(BCLog::NET, "Announcing block %s not on main chain (tip=%s)\n",
+                                hashToAnnounce.ToString(), chainActive.Tip()->GetBlockHash().ToString());
+                        }
 
-                    // If the peer announced this block to us, don't inv it back.
-                    if (!PeerHasHeader(&state, pindex)) {
-                        pto->PushInventory(CInv(MSG_BLOCK, hashToAnnounce));
-                        LogPrint(BCLog::NET, "%s: sending inv peer=%d hash=%s\n", __func__,
-                            pto->GetId(), hashToAnnounce.ToString());
+                        // If the peer announced this block to us, don't inv it back.
+                        if (!PeerHasHeader(&state, pindex)) {
+                            pto->PushInventory(CInv(MSG_BLOCK, hashToAnnounce));
+                            LogPrint(BCLog::NET, "%s: sending inv peer=%d hash=%s\n", __func__,
+                                pto->GetId(), hashToAnnounce.ToString());
+                        }
                     }
                 }
+                pto->vBlockHashesToAnnounce.clear();
             }
-            pto->vBlockHashesToAnnounce.clear();
         }
 
         //
         // Message: inventory
         //
         std::vector<CInv> vInv;
+        std::vector<uint256> vPingHashes;
+        // Transactions announced, which getdata serves from mapRelay
+        std::vector<std::pair<uint256, CTransactionRef>> vRelayed;
+        const bool fCompactPings = (pto->GetLocalServices() & NODE_COMPACT_MNPING) && (pto->nServices & NODE_COMPACT_MNPING);
         {
             LOCK(pto->cs_inventory);
             vInv.reserve(std::max<size_t>(pto->vInventoryBlockToSend.size(), INVENTORY_BROADCAST_MAX));
@@ -4054,11 +4190,17 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
+                // Produce a vector with all candidates for sending: those queued to this
+                // peer, and those relayed to all peers since the last trickle, which are
+                // read straight from the relay log
+                std::vector<uint256> vInvTx(pto->setInventoryTxToSend.begin(), pto->setInventoryTxToSend.end());
+                {
+                    LOCK(pto->cs_filter);
+                    connman->ForEachRelayedInv(pto, true, [&](const CInv& inv) {
+                        if (pto->fRelayTxes && !pto->filterInventoryKnown.contains(inv.hash)) {
+                            vInvTx.push_back(inv.hash);
+                        }
+                    });
                 }
                 CAmount filterrate = 0;
                 {
@@ -4076,11 +4218,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
                     std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
+                    uint256 hash = vInvTx.back();
                     vInvTx.pop_back();
-                    uint256 hash = *it;
                     // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
+                    pto->setInventoryTxToSend.erase(hash);
                     // Check if not in the filter already
                     if (pto->filterInventoryKnown.contains(hash)) {
                         continue;
@@ -4097,191 +4238,250 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
-                    {
-                        // Expire old relay messages
-                        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
-                        {
-                            mapRelay.erase(vRelayExpiration.front().second);
-                            vRelayExpiration.pop_front();
-                        }
-
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
-                        if (ret.second) {
-                            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
-                        }
-                    }
+                    vRelayed.emplace_back(hash, std::move(txinfo.tx));
                     if (vInv.size() == MAX_INV_SZ) {
                         connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                         vInv.clear();
                     }
                     pto->filterInventoryKnown.insert(hash);
                 }
+                // Candidates over the limit wait for the next trickle
+                for (const uint256& hash : vInvTx) {
+                    pto->setInventoryTxToSend.insert(hash);
+                }
             }
-            // Send non-tx/non-block inventory items
-            for (const auto& inv : pto->vInventoryOtherToSend) {
+            // Send non-tx/non-block inventory items, those queued to this peer and
+            // those relayed to all peers since the last pass
+            auto announce = [&](const CInv& inv) {
                 if (pto->filterInventoryKnown.contains(inv.hash)) {
-                    continue;
+                    return;
                 }
-                vInv.push_back(inv);
                 pto->filterInventoryKnown.insert(inv.hash);
+                if (fCompactPings && inv.type == MSG_MASTERNODE_PING) {
+                    // Pushed below in a compact batch
+                    vPingHashes.push_back(inv.hash);
+                    return;
+                }
+                vInv.push_back(inv);
                 if (vInv.size() == MAX_INV_SZ) {
                     connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                     vInv.clear();
                 }
+            };
+            for (const auto& inv : pto->vInventoryOtherToSend) {
+                announce(inv);
             }
             pto->vInventoryOtherToSend.clear();
+            connman->ForEachRelayedInv(pto, false, announce);
+        }
+        if (!vRelayed.empty()) {
+            LOCK(cs_main);
+            // Expire old relay messages
+            while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
+            {
+                mapRelay.erase(vRelayExpiration.front().second);
+                vRelayExpiration.pop_front();
+            }
+
+            for (auto& relayed : vRelayed) {
+                auto ret = mapRelay.insert(std::move(relayed));
+                if (ret.second) {
+                    vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+                }
+            }
+        }
+        if (!vPingHashes.empty()) {
+            std::vector<std::pair<CMasternodePing, int>> vPings;
+            std::vector<uint256> vNotCompact;
+            {
+                LOCK(cs_main);
+                mnodeman.GetPingsForRelay(vPingHashes, vPings, vNotCompact);
+            }
+            // The peer keeps the short ids it resolved under a salt, so don't change it with every batch
+            const uint64_t nonce = connman->GetDeterministicRandomizer(RANDOMIZER_ID_MNPINGBATCH).Write(pto->GetId()).Write(GetTime() / MNPINGBATCH_SALT_INTERVAL).Finalize();
+            for (size_t i = 0; i < vPings.size(); i += CMasternodePingBatch::MAX_PINGS) {
+                auto itEnd = vPings.begin() + std::min(vPings.size(), i + CMasternodePingBatch::MAX_PINGS);
+                std::vector<std::pair<CMasternodePing, int>> vChunk(vPings.begin() + i, itEnd);
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::MNPINGBATCH, CMasternodePingBatch(vChunk, nonce)));
+            }
+            // Pings whose block the peer can't look up by height are announced as usual
+            for (const uint256& hash : vNotCompact) {
+                vInv.push_back(CInv(MSG_MASTERNODE_PING, hash));
+                if (vInv.size() == MAX_INV_SZ) {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                    vInv.clear();
+                }
+            }
         }
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
-        // Detect whether we're stalling
-        // nNow is the current system time (GetTimeMicros is not mockable) and
-        // should be replaced by the mockable current_time eventually
-        const auto current_time = GetTime<std::chrono::microseconds>();
-        if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
-            // Stalling only triggers when the block download window cannot move. During normal steady state,
-            // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
-            // should only happen during initial block download.
-            LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->GetId());
-            pto->fDisconnect = true;
-            return true;
-        }
-        // In case there is a block that has been in flight from this peer for 2 + 0.5 * N times the block interval
-        // (with N the number of peers from which we're downloading validated blocks), disconnect due to timeout.
-        // We compensate for other peers to prevent killing off peers due to our own downstream link
-        // being saturated. We only count validated in-flight blocks so peers can't advertise non-existing block hashes
-        // to unreasonably increase our timeout.
-        if (state.vBlocksInFlight.size() > 0) {
-            QueuedBlock &queuedBlock = state.vBlocksInFlight.front();
-            int nOtherPeersWithValidatedDownloads = nPeersWithValidatedDownloads - (state.nBlocksInFlightValidHeaders > 0);
-            if (nNow > state.nDownloadingSince + consensusParams.nPowTargetSpacing * (BLOCK_DOWNLOAD_TIMEOUT_BASE + BLOCK_DOWNLOAD_TIMEOUT_PER_PEER * nOtherPeersWithValidatedDownloads)) {
-                LogPrintf("Timeout downloading block %s from peer=%d, disconnecting\n", queuedBlock.hash.ToString(), pto->GetId());
+        {
+            LOCK(cs_main);
+            CNodeState &state = *State(pto->GetId());
+
+            // Detect whether we're stalling
+            // nNow is the current system time (GetTimeMicros is not mockable) and
+            // should be replaced by the mockable current_time eventually
+            const auto current_time = GetTime<std::chrono::microseconds>();
+            if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
+                // Stalling only triggers when the block download window cannot move. During normal steady state,
+                // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
+                // should only happen during initial block download.
+                LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->GetId());
                 pto->fDisconnect = true;
                 return true;
             }
-        }
-        // Check for headers sync timeouts
-        if (state.fSyncStarted && state.nHeadersSyncTimeout < std::numeric_limits<int64_t>::max()) {
-            // Detect whether this is a stalling initial-headers-sync peer
-            if (pindexBestHeader->GetBlockTime() <= GetAdjustedTime() - 24*60*60) {
-                if (nNow > state.nHeadersSyncTimeout && nSyncStarted == 1 && (nPreferredDownload - state.fPreferredDownload >= 1)) {
-                    // Disconnect a (non-whitelisted) peer if it is our only sync peer,
-                    // and we have others we could be using instead.
-                    // Note: If all our peers are inbound, then we won't
-                    // disconnect our sync peer for stalling; we have bigger
-                    // problems if we can't get any outbound peers.
-                    if (!pto->fWhitelisted) {
-                        LogPrintf("Timeout downloading headers from peer=%d, disconnecting\n", pto->GetId());
-                        pto->fDisconnect = true;
-                        return true;
-                    } else {
-                        LogPrintf("Timeout downloading headers from whitelisted peer=%d, not disconnecting\n", pto->GetId());
-                        // Reset the headers sync state so that we have a
-                        // chance to try downloading from a different peer.
-                        // Note: this will also result in at least one more
-                        // getheaders message to be sent to
-                        // this peer (eventually).
-                        state.fSyncStarted = false;
-                        nSyncStarted--;
-                        state.nHeadersSyncTimeout = 0;
+            // In case there is a block that has been in flight from this peer for 2 + 0.5 * N times the block interval
+            // (with N the number of peers from which we're downloading validated blocks), disconnect due to timeout.
+            // We compensate for other peers to prevent killing off peers due to our own downstream link
+            // being saturated. We only count validated in-flight blocks so peers can't advertise non-existing block hashes
+            // to unreasonably increase our timeout.
+            if (state.vBlocksInFlight.size() > 0) {
+                QueuedBlock &queuedBlock = state.vBlocksInFlight.front();
+                int nOtherPeersWithValidatedDownloads = nPeersWithValidatedDownloads - (state.nBlocksInFlightValidHeaders > 0);
+                if (nNow > state.nDownloadingSince + consensusParams.nPowTargetSpacing * (BLOCK_DOWNLOAD_TIMEOUT_BASE + BLOCK_DOWNLOAD_TIMEOUT_PER_PEER * nOtherPeersWithValidatedDownloads)) {
+                    LogPrintf("Timeout downloading block %s from peer=%d, disconnecting\n", queuedBlock.hash.ToString(), pto->GetId());
+                    pto->fDisconnect = true;
+                    return true;
+                }
+            }
+            // Check for headers sync timeouts
+            if (state.fSyncStarted && state.nHeadersSyncTimeout < std::numeric_limits<int64_t>::max()) {
+                // Detect whether this is a stalling initial-headers-sync peer
+                if (pindexBestHeader->GetBlockTime() <= GetAdjustedTime() - 24*60*60) {
+                    if (nNow > state.nHeadersSyncTimeout && nSyncStarted == 1 && (nPreferredDownload - state.fPreferredDownload >= 1)) {
+                        // Disconnect a (non-whitelisted) peer if it is our only sync peer,
+                        // and we have others we could be using instead.
+                        // Note: If all our peers are inbound, then we won't
+                        // disconnect our sync peer for stalling; we have bigger
+                        // problems if we can't get any outbound peers.
+                        if (!pto->fWhitelisted) {
+                            LogPrintf("Timeout downloading headers from peer=%d, disconnecting\n", pto->GetId());
+                            pto->fDisconnect = true;
+                            return true;
+                        } else {
+                            LogPrintf("Timeout downloading headers from whitelisted peer=%d, not disconnecting\n", pto->GetId());
+                            // Reset the headers sync state so that we have a
+                            // chance to try downloading from a different peer.
+                            // Note: this will also result in at least one more
+                            // getheaders message to be sent to
+                            // this peer (eventually).
+                            state.fSyncStarted = false;
+                            nSyncStarted--;
+                            state.nHeadersSyncTimeout = 0;
+                        }
                     }
+                } else {
+                    // After we've caught up once, reset the timeout so we can't trigger
+                    // disconnect later.
+                    state.nHeadersSyncTimeout = std::numeric_limits<int64_t>::max();
                 }
-            } else {
-                // After we've caught up once, reset the timeout so we can't trigger
-                // disconnect later.
-                state.nHeadersSyncTimeout = std::numeric_limits<int64_t>::max();
             }
-        }
 
-        // Check that outbound peers have reasonable chains
-        // GetTime() is used by this anti-DoS logic so we can test this using mocktime
-        ConsiderEviction(pto, GetTime());
+            // Check that outbound peers have reasonable chains
+            // GetTime() is used by this anti-DoS logic so we can test this using mocktime
+            ConsiderEviction(pto, GetTime());
 
-        //
-        // Message: getdata (blocks)
-        //
-        std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-            std::vector<const CBlockIndex*> vToDownload;
-            NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
-            for (const CBlockIndex *pindex : vToDownload) {
-                uint32_t nFetchFlags = GetFetchFlags(pto);
-                vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
-                MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
-                LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
-                    pindex->nHeight, pto->GetId());
-            }
-            if (state.nBlocksInFlight == 0 && staller != -1) {
-                if (State(staller)->nStallingSince == 0) {
-                    State(staller)->nStallingSince = nNow;
-                    LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
+            //
+            // Message: getdata (blocks)
+            //
+            std::vector<CInv> vGetData;
+            const int nMaxBlocksInTransit = m_adaptive_download ? GetBlocksInTransitTarget(pto->GetId(), pto->nMinPingUsecTime) : MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+            if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < nMaxBlocksInTransit) {
+                std::vector<const CBlockIndex*> vToDownload;
+                NodeId staller = -1;
+                const CBlockIndex* pindexStalling = nullptr;
+                FindNextBlocksToDownload(pto->GetId(), nMaxBlocksInTransit - state.nBlocksInFlight, vToDownload, staller, consensusParams,
+                    m_adaptive_download ? GetBlockDownloadWindow() : BLOCK_DOWNLOAD_WINDOW, &pindexStalling);
+                if (m_adaptive_download && staller != -1 && pindexStalling) {
+                    // Rather than wait for the staller to be disconnected, take over the block holding
+                    // back the window once it is well overdue and we have been delivering blocks faster.
+                    if (IsStallingBlockOverdue(pto->GetId(), staller, pindexStalling->GetBlockHash(), nNow)) {
+                        LogPrint(BCLog::NET, "Reassigning block %s (%d) from stalling peer=%d to peer=%d\n", pindexStalling->GetBlockHash().ToString(),
+                            pindexStalling->nHeight, staller, pto->GetId());
+                        vToDownload.push_back(pindexStalling);
+                        staller = -1;
+                    }
+                }
+                for (const CBlockIndex *pindex : vToDownload) {
+                    uint32_t nFetchFlags = GetFetchFlags(pto);
+                    vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
+                    LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
+                        pindex->nHeight, pto->GetId());
+                }
+                if (state.nBlocksInFlight == 0 && staller != -1) {
+                    if (State(staller)->nStallingSince == 0) {
+                        State(staller)->nStallingSince = nNow;
+                        LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
+                    }
                 }
             }
-        }
 
-        //
-        // Message: getdata (non-blocks)
-        //
+            //
+            // Message: getdata (non-blocks)
+            //
 
-        // For robustness, expire old requests after a long timeout, so that
-        // we can resume downloading inventory from a peer even if they
-        // were unresponsive in the past.
-        // Eventually we should consider disconnecting peers, but this is
-        // conservative.
-        if (state.m_inv_download.m_check_expiry_timer <= current_time) {
-            for (auto it=state.m_inv_download.m_inv_in_flight.begin(); it != state.m_inv_download.m_inv_in_flight.end();) {
-                if (it->second <= current_time - INV_EXPIRY_INTERVAL) {
-                    LogPrint(BCLog::NET, "timeout of inflight tx %s from peer=%d\n", it->first.ToString(), pto->GetId());
-                    state.m_inv_download.m_inv_announced.erase(it->first);
-                    state.m_inv_download.m_inv_in_flight.erase(it++);
-                } else {
-                    ++it;
+            // For robustness, expire old requests after a long timeout, so that
+            // we can resume downloading inventory from a peer even if they
+            // were unresponsive in the past.
+            // Eventually we should consider disconnecting peers, but this is
+            // conservative.
+            if (state.m_inv_download.m_check_expiry_timer <= current_time) {
+                for (auto it=state.m_inv_download.m_inv_in_flight.begin(); it != state.m_inv_download.m_inv_in_flight.end();) {
+                    if (it->second <= current_time - INV_EXPIRY_INTERVAL) {
+                        LogPrint(BCLog::NET, "timeout of inflight tx %s from peer=%d\n", it->first.ToString(), pto->GetId());
+                        state.m_inv_download.m_inv_announced.erase(it->first);
+                        state.m_inv_download.m_inv_in_flight.erase(it++);
+                    } else {
+                        ++it;
+                    }
                 }
+                // On average, we do this check every INV_EXPIRY_INTERVAL. Randomize
+                // so that we're not doing this for all peers at the same time.
+                state.m_inv_download.m_check_expiry_timer = current_time + INV_EXPIRY_INTERVAL / 2 + GetRandMicros(INV_EXPIRY_INTERVAL);
             }
-            // On average, we do this check every INV_EXPIRY_INTERVAL. Randomize
-            // so that we're not doing this for all peers at the same time.
-            state.m_inv_download.m_check_expiry_timer = current_time + INV_EXPIRY_INTERVAL / 2 + GetRandMicros(INV_EXPIRY_INTERVAL);
-        }
-
-        auto& inv_process_time = state.m_inv_download.m_inv_process_time;
-        while (!inv_process_time.empty() && inv_process_time.begin()->first <= current_time && state.m_inv_download.m_inv_in_flight.size() < MAX_PEER_INV_IN_FLIGHT) {
-            const CInv _inv = inv_process_time.begin()->second;
-            const CInv& inv = _inv.type == MSG_TX ? CInv(MSG_TX | GetFetchFlags(pto), _inv.hash) : _inv;
-            // Erase this entry from tx_process_time (it may be added back for
-            // processing at a later time, see below)
-            inv_process_time.erase(inv_process_time.begin());
-            if (!AlreadyHave(inv)) {
-                // If this inventory was last requested more than 1 minute ago,
-                // then request.
-                const auto last_request_time = GetInvRequestTime(inv.hash);
-                if (last_request_time <= current_time - GETDATA_INV_INTERVAL) {
-                    LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->GetId());
-                    vGetData.push_back(inv);
-                    if (vGetData.size() >= MAX_GETDATA_SZ) {
-                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
-                        vGetData.clear();
+
+            auto& inv_process_time = state.m_inv_download.m_inv_process_time;
+            while (!inv_process_time.empty() && inv_process_time.begin()->first <= current_time && state.m_inv_download.m_inv_in_flight.size() < MAX_PEER_INV_IN_FLIGHT) {
+                const CInv _inv = inv_process_time.begin()->second;
+                const CInv& inv = _inv.type == MSG_TX ? CInv(MSG_TX | GetFetchFlags(pto), _inv.hash) : _inv;
+                // Erase this entry from tx_process_time (it may be added back for
+                // processing at a later time, see below)
+                inv_process_time.erase(inv_process_time.begin());
+                if (!AlreadyHave(inv)) {
+                    // If this inventory was last requested more than 1 minute ago,
+                    // then request.
+                    const auto last_request_time = GetInvRequestTime(inv.hash);
+                    if (last_request_time <= current_time - GETDATA_INV_INTERVAL) {
+                        LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->GetId());
+                        vGetData.push_back(inv);
+                        if (vGetData.size() >= MAX_GETDATA_SZ) {
+                            connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+                            vGetData.clear();
+                        }
+                        UpdateInvRequestTime(inv.hash, current_time);
+                        state.m_inv_download.m_inv_in_flight.emplace(inv.hash, current_time);
+                    } else {
+                        // This inventory is in flight from someone else; queue
+                        // up processing to happen after the download times out
+                        // (with a slight delay for inbound peers, to prefer
+                        // requests to outbound peers).
+                        const auto next_process_time = CalculateInvGetDataTime(inv.hash, current_time, !state.fPreferredDownload);
+                        inv_process_time.emplace(next_process_time, inv);
                     }
-                    UpdateInvRequestTime(inv.hash, current_time);
-                    state.m_inv_download.m_inv_in_flight.emplace(inv.hash, current_time);
                 } else {
-                    // This inventory is in flight from someone else; queue
-                    // up processing to happen after the download times out
-                    // (with a slight delay for inbound peers, to prefer
-                    // requests to outbound peers).
-                    const auto next_process_time = CalculateInvGetDataTime(inv.hash, current_time, !state.fPreferredDownload);
-                    inv_process_time.emplace(next_process_time, inv);
+                    // We have already seen this inventory, no need to download.
+                    state.m_inv_download.m_inv_announced.erase(inv.hash);
+                    state.m_inv_download.m_inv_in_flight.erase(inv.hash);
                 }
-            } else {
-                // We have already seen this inventory, no need to download.
-                state.m_inv_download.m_inv_announced.erase(inv.hash);
-                state.m_inv_download.m_inv_in_flight.erase(inv.hash);
             }
-        }
 
 
-        if (!vGetData.empty())
-            connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+            if (!vGetData.empty())
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+        }
 
         //
         // Message: feefilter
@@ -4294,7 +4494,13 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             if (timeNow > pto->nextSendTimeFeeFilter) {
                 static CFeeRate default_feerate(DEFAULT_MIN_RELAY_TX_FEE);
                 static FeeFilterRounder filterRounder(default_feerate);
-                CAmount filterToSend = filterRounder.round(currentFilter);
+                // The rounder's randomness is shared by all message handler threads
+                static CCriticalSection cs_filterRounder;
+                CAmount filterToSend;
+                {
+                    LOCK(cs_filterRounder);
+                    filterToSend = filterRounder.round(currentFilter);
+                }
                 // We always have a fee filter of at least minRelayTxFee
                 filterToSend = std::max(filterToSend, ::minRelayTxFee.GetFeePerK());
                 if (filterToSend != pto->lastSentFeeFilter) {
@@ -20,6 +20,8 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61{true};
+/** Default for -adaptivedownload, sizing the block download window and requests per peer from measured peer speed */
+static const bool DEFAULT_ADAPTIVE_DOWNLOAD = true;
 
 class PeerLogicValidation final : public CValidationInterface, public NetEventsInterface {
 private:
@@ -28,7 +30,7 @@ private:
 
     bool SendRejectsAndCheckIfBanned(CNode* pnode, bool enable_bip61) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 public:
-    PeerLogicValidation(CConnman* connman, BanMan* banman, CScheduler &scheduler, bool enable_bip61);
+    PeerLogicValidation(CConnman* connman, BanMan* banman, CScheduler &scheduler, bool enable_bip61, bool adaptive_download);
 
     /**
      * Overridden from CValidationInterface.
@@ -78,6 +80,9 @@ private:
 
     /** Enable BIP61 (sending reject messages) */
     const bool m_enable_bip61;
+
+    /** Size block downloads from measured peer speed rather than fixed limits */
+    const bool m_adaptive_download;
 };
 
 struct CNodeStateStats {
@@ -90,6 +95,9 @@ struct CNodeStateStats {
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
+/** Forget that inv was announced by or requested from a peer, when it arrived some other way */
+void EraseObjectRequest(NodeId nodeid, const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="") EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
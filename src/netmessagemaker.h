@@ -29,6 +29,15 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** Wrap an already serialized payload, taking ownership without copying it */
+    CSerializedNetMsg MakeRaw(std::string sCommand, std::vector<unsigned char>&& payload) const
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.data = std::move(payload);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
@@ -49,6 +49,7 @@ const char *MASTERNODEPAYMENTSYNC="mnget";
 const char *MNQUORUM="mn quorum"; // not implemented
 const char *MNANNOUNCE="mnb";
 const char *MNPING="mnp";
+const char *MNPINGBATCH="mnpings";
 const char *CJACCEPT="cja";
 const char *CJTXIN="cji";
 const char *CJFINALTX="cjf";
@@ -57,8 +58,10 @@ const char *CJCOMPLETE="cjc";
 const char *CJSTATUSUPDATE="cjsu";
 const char *CJQUEUE="cjq";
 const char *DSEG="dseg";
+const char *MNLISTRECON="dsegrecon";
 const char *SYNCSTATUSCOUNT="ssc";
 const char *MNGOVERNANCESYNC="govsync";
+const char *MNGOVERNANCERECON="govrecon";
 const char *MNGOVERNANCEOBJECT="govobj";
 const char *MNGOVERNANCEOBJECTVOTE="govobjvote";
 const char *MNVERIFY="mnv";
@@ -101,6 +104,7 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::MASTERNODEPAYMENTSYNC,
     NetMsgType::MNANNOUNCE,
     NetMsgType::MNPING,
+    NetMsgType::MNPINGBATCH,
     NetMsgType::CJACCEPT,
     NetMsgType::CJTXIN,
     NetMsgType::CJFINALTX,
@@ -109,8 +113,10 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::CJSTATUSUPDATE,
     NetMsgType::CJQUEUE,
     NetMsgType::DSEG,
+    NetMsgType::MNLISTRECON,
     NetMsgType::SYNCSTATUSCOUNT,
     NetMsgType::MNGOVERNANCESYNC,
+    NetMsgType::MNGOVERNANCERECON,
     NetMsgType::MNGOVERNANCEOBJECT,
     NetMsgType::MNGOVERNANCEOBJECTVOTE,
     NetMsgType::MNVERIFY,
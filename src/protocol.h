@@ -246,6 +246,11 @@ extern const char *MASTERNODEPAYMENTVOTE;
 extern const char *MASTERNODEPAYMENTSYNC;
 extern const char *MNANNOUNCE;
 extern const char *MNPING;
+/**
+ * The mnpings message pushes a batch of masternode pings in compact
+ * encoding to peers advertising NODE_COMPACT_MNPING.
+ */
+extern const char *MNPINGBATCH;
 extern const char *CJACCEPT;
 extern const char *CJTXIN;
 extern const char *CJFINALTX;
@@ -254,8 +259,18 @@ extern const char *CJCOMPLETE;
 extern const char *CJSTATUSUPDATE;
 extern const char *CJQUEUE;
 extern const char *DSEG;
+/**
+ * The dsegrecon message asks for the masternode list like dseg, with a sketch
+ * of the announcements and pings we have so only those we lack are announced.
+ */
+extern const char *MNLISTRECON;
 extern const char *SYNCSTATUSCOUNT;
 extern const char *MNGOVERNANCESYNC;
+/**
+ * The govrecon message asks for governance objects, or the votes of one
+ * object, like govsync, with a sketch of ours instead of a bloom filter.
+ */
+extern const char *MNGOVERNANCERECON;
 extern const char *MNGOVERNANCEOBJECT;
 extern const char *MNGOVERNANCEOBJECTVOTE;
 extern const char *MNVERIFY;
@@ -285,6 +300,12 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_COMPACT_MNPING means the node accepts masternode pings pushed in
+    // compact batches (mnpings) instead of announced one by one by inv.
+    NODE_COMPACT_MNPING = (1 << 5),
+    // NODE_SYNC_RECON means the node can sync the masternode list and governance
+    // data from a sketch of what the requesting peer already has.
+    NODE_SYNC_RECON = (1 << 6),
     // NODE_NETWORK_LIMITED means the same as NODE_NETWORK with the limitation of only
     // serving the last 288 (2 day) blocks
     // See BIP159 for details on how this is implemented.
@@ -885,6 +885,12 @@ QString formatServicesStr(quint64 mask)
             case NODE_XTHIN:
                 strList.append("XTHIN");
                 break;
+            case NODE_COMPACT_MNPING:
+                strList.append("COMPACT_MNPING");
+                break;
+            case NODE_SYNC_RECON:
+                strList.append("SYNC_RECON");
+                break;
             default:
                 strList.append(QString("%1[%2]").arg("UNKNOWN").arg(check));
             }
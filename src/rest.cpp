@@ -9,6 +9,8 @@
 #include <core_io.h>
 #include <httpserver.h>
 #include <index/txindex.h>
+#include <modules/masternode/masternode_man.h>
+#include <modules/platform/funding.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <rpc/blockchain.h>
@@ -25,6 +27,9 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const int MAX_REST_HEADERS = 2000; //allow a max of 2000 headers to be queried at once
+static const int MAX_REST_BLOCKS = 1000; //allow a max of 1000 blocks to be queried at once
+static const size_t REST_CHUNK_SIZE = 64 * 1024; //size of the chunks a block range is sent in
 
 enum class RetFormat {
     UNDEF,
@@ -114,43 +119,72 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
-static bool rest_headers(HTTPRequest* req,
-                         const std::string& strURIPart)
+/** Look up the blocks of the active chain from "<HEIGHT>/<COUNT>", fewer if the chain ends first */
+static bool ParseHeightRange(HTTPRequest* req, const std::string& param, int max_count,
+                             const CBlockIndex*& tip, std::vector<const CBlockIndex*>& range)
 {
-    if (!CheckWarmup(req))
-        return false;
-    std::string param;
-    const RetFormat rf = ParseDataFormat(param, strURIPart);
     std::vector<std::string> path;
     boost::split(path, param, boost::is_any_of("/"));
-
     if (path.size() != 2)
-        return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+        return RESTERR(req, HTTP_BAD_REQUEST, "No count specified. Use <HEIGHT>/<COUNT>.<ext>.");
+
+    int32_t height, count;
+    if (!ParseInt32(path[0], &height) || height < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[0]));
+    if (!ParseInt32(path[1], &count) || count < 1 || count > max_count)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + SanitizeString(path[1]));
+
+    LOCK(cs_main);
+    tip = chainActive.Tip();
+    if (height > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+    const int end = std::min(chainActive.Height(), height + count - 1);
+    range.reserve(end - height + 1);
+    for (int i = height; i <= end; i++) {
+        range.push_back(chainActive[i]);
+    }
+    return true;
+}
 
-    long count = strtol(path[0].c_str(), nullptr, 10);
-    if (count < 1 || count > 2000)
-        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
+/** Reply with serialized data, in the formats that carry it as it is */
+static bool WriteSerialized(HTTPRequest* req, const RetFormat rf, const CDataStream& ss)
+{
+    switch (rf) {
+    case RetFormat::BINARY: {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ss.str());
+        return true;
+    }
 
-    std::string hashStr = path[1];
-    uint256 hash;
-    if (!ParseHashStr(hashStr, hash))
-        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+    case RetFormat::HEX: {
+        std::string strHex = HexStr(ss.begin(), ss.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
 
-    const CBlockIndex* tip = nullptr;
-    std::vector<const CBlockIndex *> headers;
-    headers.reserve(count);
-    {
-        LOCK(cs_main);
-        tip = chainActive.Tip();
-        const CBlockIndex* pindex = LookupBlockIndex(hash);
-        while (pindex != nullptr && chainActive.Contains(pindex)) {
-            headers.push_back(pindex);
-            if (headers.size() == (unsigned long)count)
-                break;
-            pindex = chainActive.Next(pindex);
-        }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
     }
+    }
+}
+
+/**
+ * Sends what has been serialized into ss so far as the next chunk of a reply
+ * started with StartReplyChunks, and empties ss for the rest.
+ */
+static bool WriteSerializedChunk(HTTPRequest* req, const RetFormat rf, CDataStream& ss, bool fLast)
+{
+    std::string strChunk = rf == RetFormat::BINARY ? ss.str() : HexStr(ss.begin(), ss.end());
+    ss.clear();
+    if (fLast && rf == RetFormat::HEX)
+        strChunk += "\n";
+    return strChunk.empty() || req->WriteReplyChunk(strChunk);
+}
 
+static bool WriteHeaders(HTTPRequest* req, const RetFormat rf, const CBlockIndex* tip,
+                         const std::vector<const CBlockIndex*>& headers)
+{
     switch (rf) {
     case RetFormat::BINARY: {
         CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
@@ -191,6 +225,46 @@ static bool rest_headers(HTTPRequest* req,
     }
 }
 
+static bool rest_headers(HTTPRequest* req,
+                         const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
+
+    long count = strtol(path[0].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_REST_HEADERS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
+
+    std::string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    const CBlockIndex* tip = nullptr;
+    std::vector<const CBlockIndex *> headers;
+    headers.reserve(count);
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+        const CBlockIndex* pindex = LookupBlockIndex(hash);
+        while (pindex != nullptr && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    return WriteHeaders(req, rf, tip, headers);
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -204,7 +278,11 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
+    // Binary and hex replies are served from the stored bytes when they
+    // match the requested serialization, skipping deserialization.
+    const bool fRaw = rf == RetFormat::BINARY || rf == RetFormat::HEX;
+    std::shared_ptr<const CBlock> pblock;
+    std::shared_ptr<const std::vector<uint8_t>> block_data;
     CBlockIndex* pblockindex = nullptr;
     CBlockIndex* tip = nullptr;
     {
@@ -218,31 +296,48 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (fRaw && RawBlockMatchesSerialization(pblockindex, RPCSerializationFlags(), Params().GetConsensus())) {
+            block_data = ReadRawBlockCached(pblockindex, Params().MessageStart());
+            if (!block_data)
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else {
+            pblock = ReadBlockCached(pblockindex, Params().GetConsensus());
+            if (!pblock)
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
     }
 
     switch (rf) {
     case RetFormat::BINARY: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string binaryBlock = ssBlock.str();
+        std::string binaryBlock;
+        if (block_data) {
+            binaryBlock.assign(block_data->begin(), block_data->end());
+        } else {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << *pblock;
+            binaryBlock = ssBlock.str();
+        }
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RetFormat::HEX: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex;
+        if (block_data) {
+            strHex = HexStr(block_data->begin(), block_data->end()) + "\n";
+        } else {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << *pblock;
+            strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        }
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RetFormat::JSON: {
-        UniValue objBlock = blockToJSON(block, tip, pblockindex, showTxDetails);
+        UniValue objBlock = blockToJSON(*pblock, tip, pblockindex, showTxDetails);
         std::string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
@@ -621,6 +716,175 @@ static bool rest_blockhash_by_height(HTTPRequest* req,
     }
 }
 
+static bool rest_headers_by_height(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    const CBlockIndex* tip = nullptr;
+    std::vector<const CBlockIndex*> headers;
+    if (!ParseHeightRange(req, param, MAX_REST_HEADERS, tip, headers))
+        return false;
+
+    return WriteHeaders(req, rf, tip, headers);
+}
+
+static bool rest_blocks_by_height(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    const CBlockIndex* tip = nullptr;
+    std::vector<const CBlockIndex*> range;
+    if (!ParseHeightRange(req, param, MAX_REST_BLOCKS, tip, range))
+        return false;
+    // Whether the stored bytes can be sent as they are, decided under cs_main
+    // with the rest of the block index lookups so that the reads don't need it
+    std::vector<bool> vRawMatches;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex : range) {
+            if (IsBlockPruned(pindex))
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            vRawMatches.push_back(RawBlockMatchesSerialization(pindex, RPCSerializationFlags(), Params().GetConsensus()));
+        }
+    }
+
+    // The blocks are sent as they are read, with WriteReplyChunk waiting for
+    // the client to keep up, so the reply can only be cut short if one of
+    // them can't be read after all or the client goes away
+    req->WriteHeader("Content-Type", rf == RetFormat::BINARY ? "application/octet-stream" : "text/plain");
+    req->StartReplyChunks(HTTP_OK);
+    std::string strChunk;
+    for (size_t i = 0; i < range.size(); i++) {
+        const CBlockIndex* pindex = range[i];
+        std::string strBlock;
+        if (vRawMatches[i]) {
+            std::shared_ptr<const std::vector<uint8_t>> block_data = ReadRawBlockCached(pindex, Params().MessageStart());
+            if (block_data) strBlock.assign(block_data->begin(), block_data->end());
+        } else {
+            std::shared_ptr<const CBlock> pblock = ReadBlockCached(pindex, Params().GetConsensus());
+            if (pblock) {
+                CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+                ssBlock << *pblock;
+                strBlock = ssBlock.str();
+            }
+        }
+        if (strBlock.empty()) {
+            LogPrintf("%s: can't read block %s, reply cut short\n", __func__, pindex->GetBlockHash().ToString());
+            break;
+        }
+        strChunk += rf == RetFormat::BINARY ? strBlock : HexStr(strBlock.begin(), strBlock.end());
+        if (strChunk.size() >= REST_CHUNK_SIZE) {
+            if (!req->WriteReplyChunk(strChunk))
+                break;
+            strChunk.clear();
+        }
+    }
+    if (rf == RetFormat::HEX)
+        strChunk += "\n";
+    if (!strChunk.empty())
+        req->WriteReplyChunk(strChunk);
+    req->EndReplyChunks();
+    return true;
+}
+
+static bool rest_masternodes(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI: " + SanitizeString(param));
+
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    // Serialized the same way as the whole map, one entry at a time, so only
+    // the copy of the list and a chunk of output are held at once
+    const std::map<COutPoint, CMasternode> mapMasternodes = mnodeman.GetFullMasternodeMap();
+    req->WriteHeader("Content-Type", rf == RetFormat::BINARY ? "application/octet-stream" : "text/plain");
+    req->StartReplyChunks(HTTP_OK);
+    CDataStream ssMasternodes(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ssMasternodes, mapMasternodes.size());
+    bool fOk = true;
+    for (const auto& mnpair : mapMasternodes) {
+        ssMasternodes << mnpair;
+        if (ssMasternodes.size() >= REST_CHUNK_SIZE && !(fOk = WriteSerializedChunk(req, rf, ssMasternodes, false)))
+            break;
+    }
+    if (fOk)
+        WriteSerializedChunk(req, rf, ssMasternodes, true);
+    req->EndReplyChunks();
+    return true;
+}
+
+static bool rest_governance_objects(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI: " + SanitizeString(param));
+
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    // The count leads the objects, so they are serialized in one go under
+    // funding.cs to keep the two consistent; only the sending is chunked,
+    // after the lock is released
+    CDataStream ssObjects(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(funding.cs);
+        std::vector<const CGovernanceObject*> objs = funding.GetAllNewerThan(0);
+        WriteCompactSize(ssObjects, objs.size());
+        for (const CGovernanceObject* pGovObj : objs) {
+            ssObjects << *pGovObj;
+        }
+    }
+    req->WriteHeader("Content-Type", rf == RetFormat::BINARY ? "application/octet-stream" : "text/plain");
+    req->StartReplyChunks(HTTP_OK);
+    bool fOk = true;
+    while (fOk && ssObjects.size() > REST_CHUNK_SIZE) {
+        CDataStream ssChunk(ssObjects.begin(), ssObjects.begin() + REST_CHUNK_SIZE, SER_NETWORK, PROTOCOL_VERSION);
+        ssObjects.ignore(REST_CHUNK_SIZE);
+        fOk = WriteSerializedChunk(req, rf, ssChunk, false);
+    }
+    if (fOk)
+        WriteSerializedChunk(req, rf, ssObjects, true);
+    req->EndReplyChunks();
+    return true;
+}
+
+static bool rest_governance_votes(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    CDataStream ssVotes(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(funding.cs);
+        if (!funding.HaveObjectForHash(hash))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        ssVotes << funding.GetMatchingVotes(hash);
+    }
+    return WriteSerialized(req, rf, ssVotes);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -634,6 +898,11 @@ static const struct {
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/headersbyheight/", rest_headers_by_height},
+      {"/rest/blocksbyheight/", rest_blocks_by_height},
+      {"/rest/masternodes", rest_masternodes},
+      {"/rest/governance/objects", rest_governance_objects},
+      {"/rest/governance/votes/", rest_governance_votes},
 };
 
 void StartREST()
@@ -10,6 +10,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <checkqueue.h>
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
@@ -20,6 +21,7 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
@@ -173,8 +175,8 @@ static UniValue getblockcount(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    const CBlockIndex* tip = GetPublishedChainTip();
+    return tip ? tip->nHeight : -1;
 }
 
 static UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -193,8 +195,10 @@ static UniValue getbestblockhash(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    const CBlockIndex* tip = GetPublishedChainTip();
+    if (!tip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No block in the active chain yet");
+    return tip->GetBlockHash().GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -446,9 +450,8 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
 
     UniValue spent(UniValue::VARR);
     const CTxMemPool::txiter &it = mempool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries &setChildren = mempool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const CTxMemPoolEntry* child : mempool.GetMemPoolChildren(it)) {
+        spent.push_back(child->GetTx().GetHash().ToString());
     }
 
     info.pushKV("spentby", spent);
@@ -465,9 +468,12 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
     info.pushKV("bip125-replaceable", rbfStatus);
 }
 
-UniValue mempoolToJSON(bool fVerbose)
+/** Entries described per hold of mempool.cs while a result is streamed */
+static const size_t MEMPOOL_STREAM_BATCH = 1000;
+
+UniValue mempoolToJSON(bool fVerbose, JSONStreamWriter* stream)
 {
-    if (fVerbose)
+    if (fVerbose && !stream)
     {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
@@ -480,6 +486,41 @@ UniValue mempoolToJSON(bool fVerbose)
         }
         return o;
     }
+    else if (fVerbose)
+    {
+        // A slow client must not hold up the mempool, so describe the entries
+        // in batches under the lock and write each batch out without it.
+        // Entries removed in the meantime are left out.
+        std::vector<uint256> vtxid;
+        {
+            LOCK(mempool.cs);
+            vtxid.reserve(mempool.mapTx.size());
+            for (const CTxMemPoolEntry& e : mempool.mapTx) {
+                vtxid.push_back(e.GetTx().GetHash());
+            }
+        }
+
+        JSONObjectResult o(stream);
+        std::vector<std::pair<std::string, UniValue>> batch;
+        for (size_t i = 0; i < vtxid.size(); i += MEMPOOL_STREAM_BATCH)
+        {
+            batch.clear();
+            {
+                LOCK(mempool.cs);
+                for (size_t j = i; j < std::min(i + MEMPOOL_STREAM_BATCH, vtxid.size()); j++) {
+                    const auto it = mempool.mapTx.find(vtxid[j]);
+                    if (it == mempool.mapTx.end()) continue;
+                    UniValue info(UniValue::VOBJ);
+                    entryToJSON(info, *it);
+                    batch.emplace_back(vtxid[j].ToString(), std::move(info));
+                }
+            }
+            for (const auto& entry : batch) {
+                o.pushKV(entry.first, entry.second);
+            }
+        }
+        return o.Finish();
+    }
     else
     {
         std::vector<uint256> vtxid;
@@ -525,7 +566,7 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    return mempoolToJSON(fVerbose, request.stream);
 }
 
 static UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -722,13 +763,13 @@ static UniValue getblockhash(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-
+    // The ancestors of the tip don't change, so no lock is needed to find them
+    const CBlockIndex* tip = GetPublishedChainTip();
     int nHeight = request.params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (!tip || nHeight < 0 || nHeight > tip->nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = tip->GetAncestor(nHeight);
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -779,13 +820,8 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     if (!request.params[1].isNull())
         fVerbose = request.params[1].get_bool();
 
-    const CBlockIndex* pblockindex;
-    const CBlockIndex* tip;
-    {
-        LOCK(cs_main);
-        pblockindex = LookupBlockIndex(hash);
-        tip = chainActive.Tip();
-    }
+    const CBlockIndex* pblockindex = LookupBlockIndexNoCsMain(hash);
+    const CBlockIndex* tip = GetPublishedChainTip();
 
     if (!pblockindex) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
@@ -799,17 +835,23 @@ static UniValue getblockheader(const JSONRPCRequest& request)
         return strHex;
     }
 
-    return blockheaderToJSON(tip, pblockindex);
+    // Blocks in the published chain had nTx set before it was published,
+    // for any other block it may still be being set under cs_main
+    if (tip && tip->GetAncestor(pblockindex->nHeight) == pblockindex)
+        return blockheaderToJSON(tip, pblockindex);
+    // The published tip may be behind the active chain, or not there yet
+    LOCK(cs_main);
+    return blockheaderToJSON(chainActive.Tip(), pblockindex);
 }
 
-static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
+static std::shared_ptr<const CBlock> GetBlockChecked(const CBlockIndex* pblockindex)
 {
-    CBlock block;
     if (IsBlockPruned(pblockindex)) {
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
     }
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
+    std::shared_ptr<const CBlock> pblock = ReadBlockCached(pblockindex, Params().GetConsensus());
+    if (!pblock) {
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -818,7 +860,21 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
     }
 
-    return block;
+    return pblock;
+}
+
+static std::shared_ptr<const std::vector<uint8_t>> GetRawBlockChecked(const CBlockIndex* pblockindex)
+{
+    if (IsBlockPruned(pblockindex)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> block_data = ReadRawBlockCached(pblockindex, Params().MessageStart());
+    if (!block_data) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+
+    return block_data;
 }
 
 static UniValue getblock(const JSONRPCRequest& request)
@@ -879,8 +935,6 @@ static UniValue getblock(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-
     uint256 hash(ParseHashV(request.params[0], "blockhash"));
 
     int verbosity = 1;
@@ -891,22 +945,59 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    const CBlockIndex* pblockindex = LookupBlockIndex(hash);
-    if (!pblockindex) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-    }
+    std::shared_ptr<const CBlock> pblock;
+    UniValue result;
+    {
+        LOCK(cs_main);
 
-    const CBlock block = GetBlockChecked(pblockindex);
+        const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
 
-    if (verbosity <= 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        if (verbosity <= 0 && RawBlockMatchesSerialization(pblockindex, RPCSerializationFlags(), Params().GetConsensus())) {
+            // Hex-encode the stored bytes without deserializing the block
+            const std::shared_ptr<const std::vector<uint8_t>> block_data = GetRawBlockChecked(pblockindex);
+            return HexStr(block_data->begin(), block_data->end());
+        }
+
+        pblock = GetBlockChecked(pblockindex);
+
+        if (verbosity <= 0)
+        {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << *pblock;
+            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+            return strHex;
+        }
+
+        if (verbosity < 2 || !request.stream) {
+            return blockToJSON(*pblock, chainActive.Tip(), pblockindex, verbosity >= 2);
+        }
+
+        result = blockToJSON(*pblock, chainActive.Tip(), pblockindex, false);
     }
 
-    return blockToJSON(block, chainActive.Tip(), pblockindex, verbosity >= 2);
+    // Write the transactions one by one, never holding all of them as JSON.
+    // The client may read slowly, so this is done without cs_main.
+    JSONStreamWriter& stream = *request.stream;
+    stream.BeginObject();
+    for (size_t i = 0; i < result.size(); i++) {
+        stream.Key(result.getKeys()[i]);
+        if (result.getKeys()[i] != "tx") {
+            stream.Value(result.getValues()[i]);
+            continue;
+        }
+        stream.BeginArray();
+        for (const auto& tx : pblock->vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
+            stream.Value(objTx);
+        }
+        stream.EndArray();
+    }
+    stream.EndObject();
+    return NullUniValue;
 }
 
 struct CCoinsStats
@@ -1523,6 +1614,68 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+static UniValue getscriptcheckinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getscriptcheckinfo",
+                "\nReturns timing counters of the parallel script verification queue (see -par and -parworkstealing).\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"threads\": xxxxx,              (numeric) Number of script verification threads, including the validation thread\n"
+            "  \"workstealing\": true|false,    (boolean) Whether the queue uses per-thread deques with work stealing\n"
+            "  \"batchsize\": xxxxx,            (numeric) Maximum number of checks taken by a thread at once\n"
+            "  \"blocks\": xxxxx,               (numeric) Number of blocks verified through the queue\n"
+            "  \"checks\": xxxxx,               (numeric) Total number of script checks queued\n"
+            "  \"checks_per_block\": x.xxx,     (numeric) Average number of script checks per block\n"
+            "  \"last_block_checks\": xxxxx,    (numeric) Number of script checks queued for the last block\n"
+            "  \"wait_ms\": x.xxx,              (numeric) Total time the validation thread waited for other threads to finish\n"
+            "  \"last_block_wait_ms\": x.xxx,   (numeric) Time the validation thread waited for other threads in the last block\n"
+            "  \"threadstats\": [               (array) Per-thread counters, the validation thread first\n"
+            "    {\n"
+            "      \"checks\": xxxxx,           (numeric) Number of checks executed\n"
+            "      \"batches\": xxxxx,          (numeric) Number of batches executed\n"
+            "      \"steals\": xxxxx,           (numeric) Number of batches stolen from other threads\n"
+            "      \"busy_ms\": x.xxx,          (numeric) Time spent executing checks\n"
+            "      \"idle_ms\": x.xxx           (numeric) Time spent waiting for work\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getscriptcheckinfo", "")
+            + HelpExampleRpc("getscriptcheckinfo", "")
+                },
+            }.ToString());
+
+    const CCheckQueueStats stats = GetScriptCheckQueueStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("threads", nScriptCheckThreads);
+    ret.pushKV("workstealing", stats.fWorkStealing);
+    ret.pushKV("batchsize", (int64_t)stats.nBatchSize);
+    ret.pushKV("blocks", (int64_t)stats.nBlocks);
+    ret.pushKV("checks", (int64_t)stats.nChecks);
+    ret.pushKV("checks_per_block", stats.nBlocks ? (double)stats.nChecks / stats.nBlocks : 0.0);
+    ret.pushKV("last_block_checks", (int64_t)stats.nLastBlockChecks);
+    ret.pushKV("wait_ms", stats.nMasterWaitMicros * 0.001);
+    ret.pushKV("last_block_wait_ms", stats.nLastMasterWaitMicros * 0.001);
+    UniValue threads(UniValue::VARR);
+    for (const CCheckQueueWorkerStats& worker : stats.vWorkers) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("checks", (int64_t)worker.nChecks);
+        obj.pushKV("batches", (int64_t)worker.nBatches);
+        obj.pushKV("steals", (int64_t)worker.nSteals);
+        obj.pushKV("busy_ms", worker.nBusyMicros * 0.001);
+        obj.pushKV("idle_ms", worker.nIdleMicros * 0.001);
+        threads.push_back(obj);
+    }
+    ret.pushKV("threadstats", threads);
+
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1873,7 +2026,8 @@ static UniValue getblockstats(const JSONRPCRequest& request)
         }
     }
 
-    const CBlock block = GetBlockChecked(pindex);
+    const std::shared_ptr<const CBlock> pblock = GetBlockChecked(pindex);
+    const CBlock& block = *pblock;
 
     const bool do_all = stats.size() == 0; // Calculate everything if nothing selected (default)
     const bool do_mediantxsize = do_all || stats.count("mediantxsize") != 0;
@@ -2314,6 +2468,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getscriptcheckinfo",     &getscriptcheckinfo,     {} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
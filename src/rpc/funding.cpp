@@ -16,11 +16,15 @@
 #include <modules/masternode/masternode_config.h>
 #include <modules/masternode/masternode_man.h>
 #include <messagesigner.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <util/system.h>
 #include <util/strencodings.h>
 #include <util/moneystr.h>
 
+/** Governance objects described per hold of the locks while listing them */
+static const size_t GOVOBJ_STREAM_BATCH = 100;
+
 UniValue gobject(const JSONRPCRequest& request)
 {
     std::string strCommand;
@@ -543,60 +547,80 @@ UniValue gobject(const JSONRPCRequest& request)
         int nStartTime = 0; //list
         if(strCommand == "diff") nStartTime = funding.GetLastDiffTime();
 
-        // SETUP BLOCK INDEX VARIABLE / RESULTS VARIABLE
+        // GET MATCHING GOVERNANCE OBJECTS
 
-        UniValue objResult(UniValue::VOBJ);
+        std::vector<uint256> vHashes;
+        {
+            LOCK(funding.cs);
 
-        // GET MATCHING GOVERNANCE OBJECTS
+            std::vector<const CGovernanceObject*> objs = funding.GetAllNewerThan(nStartTime);
+            funding.UpdateLastDiffTime(GetTime());
 
-        LOCK2(cs_main, funding.cs);
+            for (const auto& pGovObj : objs)
+            {
+                if(strCachedSignal == "valid" && !pGovObj->IsSetCachedValid()) continue;
+                if(strCachedSignal == "funding" && !pGovObj->IsSetCachedFunding()) continue;
+                if(strCachedSignal == "delete" && !pGovObj->IsSetCachedDelete()) continue;
+                if(strCachedSignal == "endorsed" && !pGovObj->IsSetCachedEndorsed()) continue;
+
+                if(strType == "proposals" && pGovObj->GetObjectType() != GOVERNANCE_OBJECT_PROPOSAL) continue;
+                if(strType == "triggers" && pGovObj->GetObjectType() != GOVERNANCE_OBJECT_TRIGGER) continue;
 
-        std::vector<const CGovernanceObject*> objs = funding.GetAllNewerThan(nStartTime);
-        funding.UpdateLastDiffTime(GetTime());
+                vHashes.push_back(pGovObj->GetHash());
+            }
+        }
 
         // CREATE RESULTS FOR USER
 
-        for (const auto& pGovObj : objs)
+        // The result may be streamed to a slow client, so the objects are
+        // described in batches under the locks and written out without them
+        JSONObjectResult objResult(request.stream);
+        std::vector<std::pair<std::string, UniValue>> vBatch;
+        for (size_t i = 0; i < vHashes.size(); i += GOVOBJ_STREAM_BATCH)
         {
-            if(strCachedSignal == "valid" && !pGovObj->IsSetCachedValid()) continue;
-            if(strCachedSignal == "funding" && !pGovObj->IsSetCachedFunding()) continue;
-            if(strCachedSignal == "delete" && !pGovObj->IsSetCachedDelete()) continue;
-            if(strCachedSignal == "endorsed" && !pGovObj->IsSetCachedEndorsed()) continue;
-
-            if(strType == "proposals" && pGovObj->GetObjectType() != GOVERNANCE_OBJECT_PROPOSAL) continue;
-            if(strType == "triggers" && pGovObj->GetObjectType() != GOVERNANCE_OBJECT_TRIGGER) continue;
-
-            UniValue bObj(UniValue::VOBJ);
-            bObj.pushKV("DataHex",  pGovObj->GetDataAsHexString());
-            bObj.pushKV("DataString",  pGovObj->GetDataAsPlainString());
-            bObj.pushKV("Hash",  pGovObj->GetHash().ToString());
-            bObj.pushKV("CollateralHash",  pGovObj->GetCollateralHash().ToString());
-            bObj.pushKV("ObjectType", pGovObj->GetObjectType());
-            bObj.pushKV("CreationTime", pGovObj->GetCreationTime());
-            const COutPoint& masternodeOutpoint = pGovObj->GetMasternodeOutpoint();
-            if(masternodeOutpoint != COutPoint()) {
-                bObj.pushKV("SigningMasternode", masternodeOutpoint.ToStringShort());
+            vBatch.clear();
+            {
+                LOCK2(cs_main, funding.cs);
+                for (size_t j = i; j < std::min(i + GOVOBJ_STREAM_BATCH, vHashes.size()); j++) {
+                    const CGovernanceObject* pGovObj = funding.FindGovernanceObject(vHashes[j]);
+                    if (!pGovObj) continue;
+
+                    UniValue bObj(UniValue::VOBJ);
+                    bObj.pushKV("DataHex",  pGovObj->GetDataAsHexString());
+                    bObj.pushKV("DataString",  pGovObj->GetDataAsPlainString());
+                    bObj.pushKV("Hash",  pGovObj->GetHash().ToString());
+                    bObj.pushKV("CollateralHash",  pGovObj->GetCollateralHash().ToString());
+                    bObj.pushKV("ObjectType", pGovObj->GetObjectType());
+                    bObj.pushKV("CreationTime", pGovObj->GetCreationTime());
+                    const COutPoint& masternodeOutpoint = pGovObj->GetMasternodeOutpoint();
+                    if(masternodeOutpoint != COutPoint()) {
+                        bObj.pushKV("SigningMasternode", masternodeOutpoint.ToStringShort());
+                    }
+
+                    // REPORT STATUS FOR FUNDING VOTES SPECIFICALLY
+                    bObj.pushKV("AbsoluteYesCount",  pGovObj->GetAbsoluteYesCount(VOTE_SIGNAL_FUNDING));
+                    bObj.pushKV("YesCount",  pGovObj->GetYesCount(VOTE_SIGNAL_FUNDING));
+                    bObj.pushKV("NoCount",  pGovObj->GetNoCount(VOTE_SIGNAL_FUNDING));
+                    bObj.pushKV("AbstainCount",  pGovObj->GetAbstainCount(VOTE_SIGNAL_FUNDING));
+
+                    // REPORT VALIDITY AND CACHING FLAGS FOR VARIOUS SETTINGS
+                    std::string strError = "";
+                    bObj.pushKV("fBlockchainValidity",  pGovObj->IsValidLocally(strError, false));
+                    bObj.pushKV("IsValidReason",  strError.c_str());
+                    bObj.pushKV("fCachedValid",  pGovObj->IsSetCachedValid());
+                    bObj.pushKV("fCachedFunding",  pGovObj->IsSetCachedFunding());
+                    bObj.pushKV("fCachedDelete",  pGovObj->IsSetCachedDelete());
+                    bObj.pushKV("fCachedEndorsed",  pGovObj->IsSetCachedEndorsed());
+
+                    vBatch.emplace_back(vHashes[j].ToString(), std::move(bObj));
+                }
+            }
+            for (const auto& item : vBatch) {
+                objResult.pushKV(item.first, item.second);
             }
-
-            // REPORT STATUS FOR FUNDING VOTES SPECIFICALLY
-            bObj.pushKV("AbsoluteYesCount",  pGovObj->GetAbsoluteYesCount(VOTE_SIGNAL_FUNDING));
-            bObj.pushKV("YesCount",  pGovObj->GetYesCount(VOTE_SIGNAL_FUNDING));
-            bObj.pushKV("NoCount",  pGovObj->GetNoCount(VOTE_SIGNAL_FUNDING));
-            bObj.pushKV("AbstainCount",  pGovObj->GetAbstainCount(VOTE_SIGNAL_FUNDING));
-
-            // REPORT VALIDITY AND CACHING FLAGS FOR VARIOUS SETTINGS
-            std::string strError = "";
-            bObj.pushKV("fBlockchainValidity",  pGovObj->IsValidLocally(strError, false));
-            bObj.pushKV("IsValidReason",  strError.c_str());
-            bObj.pushKV("fCachedValid",  pGovObj->IsSetCachedValid());
-            bObj.pushKV("fCachedFunding",  pGovObj->IsSetCachedFunding());
-            bObj.pushKV("fCachedDelete",  pGovObj->IsSetCachedDelete());
-            bObj.pushKV("fCachedEndorsed",  pGovObj->IsSetCachedEndorsed());
-
-            objResult.pushKV(pGovObj->GetHash().ToString(), bObj);
         }
 
-        return objResult;
+        return objResult.Finish();
     }
 
     // GET SPECIFIC GOVERNANCE ENTRY
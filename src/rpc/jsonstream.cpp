@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <assert.h>
+
+const size_t JSONStreamWriter::CHUNK_SIZE;
+
+void JSONStreamWriter::BeginValue()
+{
+    m_used = true;
+    if (m_after_key) {
+        m_after_key = false;
+        return;
+    }
+    if (!m_has_members.empty()) {
+        if (m_has_members.back()) {
+            m_buffer += ',';
+        }
+        m_has_members.back() = true;
+    }
+}
+
+void JSONStreamWriter::EndValue()
+{
+    if (m_buffer.size() >= CHUNK_SIZE) {
+        Flush();
+    }
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    m_buffer += '{';
+    m_has_members.push_back(false);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!m_has_members.empty() && !m_after_key);
+    m_has_members.pop_back();
+    m_buffer += '}';
+    EndValue();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    m_buffer += '[';
+    m_has_members.push_back(false);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!m_has_members.empty() && !m_after_key);
+    m_has_members.pop_back();
+    m_buffer += ']';
+    EndValue();
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!m_has_members.empty() && !m_after_key);
+    BeginValue();
+    m_buffer += UniValue(key).write();
+    m_buffer += ':';
+    m_after_key = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    m_buffer += value.write();
+    EndValue();
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (!m_buffer.empty()) {
+        m_sink(m_buffer);
+        m_buffer.clear();
+    }
+}
+
+JSONObjectResult::JSONObjectResult(JSONStreamWriter* stream) : m_stream(stream)
+{
+    if (m_stream) {
+        m_stream->BeginObject();
+    }
+}
+
+void JSONObjectResult::pushKV(const std::string& key, const UniValue& val)
+{
+    if (m_stream) {
+        m_stream->Key(key);
+        m_stream->Value(val);
+    } else {
+        m_obj.__pushKV(key, val);
+    }
+}
+
+UniValue JSONObjectResult::Finish()
+{
+    if (m_stream) {
+        m_stream->EndObject();
+        return NullUniValue;
+    }
+    return std::move(m_obj);
+}
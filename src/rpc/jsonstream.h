@@ -0,0 +1,73 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <univalue.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Writes JSON piece by piece instead of as one UniValue tree, handing the
+ * text on in chunks as it grows. Only the values passed to Value() are ever
+ * held as UniValues.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+
+    /** Output is handed to the sink in chunks of about this size */
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    explicit JSONStreamWriter(Sink sink) : m_sink(std::move(sink)) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Start the next member of the current object, to be followed by its value */
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+
+    /** Hand all buffered output to the sink */
+    void Flush();
+    /** Whether anything has been written */
+    bool IsUsed() const { return m_used; }
+
+private:
+    Sink m_sink;
+    std::string m_buffer;
+    //! For each open object or array, whether it has members already
+    std::vector<bool> m_has_members;
+    bool m_after_key{false};
+    bool m_used{false};
+
+    void BeginValue();
+    void EndValue();
+};
+
+/**
+ * The object result of an RPC, either built as a UniValue or, if there is a
+ * stream to take it (see JSONRPCRequest::stream), written to it member by member.
+ */
+class JSONObjectResult
+{
+public:
+    explicit JSONObjectResult(JSONStreamWriter* stream);
+
+    /** Add a member, whose key must not be in the object yet */
+    void pushKV(const std::string& key, const UniValue& val);
+    /** The object, or null if it went to the stream */
+    UniValue Finish();
+
+private:
+    JSONStreamWriter* const m_stream;
+    UniValue m_obj{UniValue::VOBJ};
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
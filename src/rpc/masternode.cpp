@@ -14,6 +14,7 @@
 #include <modules/masternode/masternode_config.h>
 #include <modules/masternode/masternode_man.h>
 #include <modules/coinjoin/coinjoin_server.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <util/system.h>
 #include <util/moneystr.h>
@@ -84,13 +85,22 @@ UniValue masternode(const JSONRPCRequest& request)
         if (request.params.size() > 2)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Too many parameters");
 
-        int nCount;
-        masternode_info_t mnInfo;
-        mnodeman.GetNextMasternodeInQueueForPayment(true, nCount, mnInfo);
-
-        int total = mnodeman.size();
-        int cj = mnodeman.CountEnabled(MIN_COINJOIN_PEER_PROTO_VERSION);
-        int enabled = mnodeman.CountEnabled();
+        int nCount, total, cj, enabled;
+        std::shared_ptr<const CMasternodeListSnapshot> pSnapshot = mnodeman.GetListSnapshot();
+        if (pSnapshot) {
+            // As of the last change to the list, without waiting for validation or the masternode list
+            nCount = pSnapshot->nQualify;
+            total = pSnapshot->nTotal;
+            cj = pSnapshot->nEnabledCJ;
+            enabled = pSnapshot->nEnabled;
+        } else {
+            masternode_info_t mnInfo;
+            mnodeman.GetNextMasternodeInQueueForPayment(true, nCount, mnInfo);
+
+            total = mnodeman.size();
+            cj = mnodeman.CountEnabled(MIN_COINJOIN_PEER_PROTO_VERSION);
+            enabled = mnodeman.CountEnabled();
+        }
 
         if (request.params.size() == 1) {
             UniValue obj(UniValue::VOBJ);
@@ -396,7 +406,7 @@ UniValue masternodelist(const JSONRPCRequest& request)
         mnodeman.UpdateLastPaid(pindex);
     }
 
-    UniValue obj(UniValue::VOBJ);
+    JSONObjectResult obj(request.stream);
     if (strMode == "rank") {
         CMasternodeMan::rank_pair_vec_t vMasternodeRanks;
         mnodeman.GetMasternodeRanks(vMasternodeRanks);
@@ -516,7 +526,7 @@ UniValue masternodelist(const JSONRPCRequest& request)
             }
         }
     }
-    return obj;
+    return obj.Finish();
 }
 
 bool DecodeHexVecMnb(std::vector<CMasternodeBroadcast>& vecMnb, std::string strHexMnb) {
@@ -517,6 +517,10 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
             WAIT_LOCK(g_best_block_mutex, lock);
             while (g_best_block == hashWatchedChain && IsRPCRunning())
             {
+                // A template paying materially more fees is worth switching to right away,
+                // without waiting for the mempool check below
+                if (g_block_template_cache && g_block_template_cache->FeesImproved(hashWatchedChain))
+                    break;
                 if (g_best_block_cv.wait_until(lock, checktxtime) == std::cv_status::timeout)
                 {
                     // Timeout: Check transactions for update
@@ -542,7 +546,20 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
+    static std::shared_ptr<const CBlockTemplate> pblocktemplateCached;
+    unsigned int nTransactionsUpdatedCached = 0;
+    std::shared_ptr<const CBlockTemplate> pcached = g_block_template_cache ? g_block_template_cache->Get(chainActive.Tip(), nTransactionsUpdatedCached) : nullptr;
+    if (pcached) {
+        // Kept up to date in the background
+        if (pcached != pblocktemplateCached || pindexPrev != chainActive.Tip()) {
+            pblocktemplateCached = pcached;
+            pblocktemplate.reset(new CBlockTemplate(*pcached));
+            nTransactionsUpdatedLast = nTransactionsUpdatedCached;
+            pindexPrev = chainActive.Tip();
+            nStart = GetTime();
+        }
+    }
+    else if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -563,6 +580,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         pindexPrev = pindexPrevNew;
     }
     assert(pindexPrev);
+    if (g_block_template_cache) g_block_template_cache->SetServed(*pblocktemplate);
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
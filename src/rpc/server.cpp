@@ -6,6 +6,7 @@
 #include <rpc/server.h>
 
 #include <fs.h>
+#include <httpserver.h>
 #include <key_io.h>
 #include <random.h>
 #include <rpc/util.h>
@@ -20,6 +21,7 @@
 #include <boost/algorithm/string/split.hpp>
 
 #include <memory> // for unique_ptr
+#include <set>
 #include <unordered_map>
 
 static CCriticalSection cs_rpcWarmup;
@@ -304,7 +306,16 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
             "    \"method\"       (string)  The name of the RPC command \n"
             "    \"duration\"     (numeric)  The running time in microseconds\n"
             "   },...\n"
-            "  ]\n"
+            "  ],\n"
+            " \"work_queue\" (object) The HTTP work queue, if the HTTP server is running\n"
+            "  {\n"
+            "   \"depth\"        (numeric) The number of requests waiting for a worker thread\n"
+            "   \"max_depth\"    (numeric) The number of requests that can wait (see -rpcworkqueue)\n"
+            "   \"rejected\"     (numeric) The number of requests rejected because the queue was full\n"
+            "   \"queue_time\"   (array) Entry i is the number of requests that waited less than 2^i\n"
+            "                          microseconds for a worker thread, but not less than half that\n"
+            "   \"service_time\" (array) The same for the time worker threads took to handle requests\n"
+            "  }\n"
             "}\n"
                 },
                 RPCExamples{
@@ -326,6 +337,21 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
     UniValue result(UniValue::VOBJ);
     result.pushKV("active_commands", active_commands);
 
+    HTTPWorkQueueStats stats;
+    if (GetHTTPWorkQueueStats(stats)) {
+        UniValue work_queue(UniValue::VOBJ);
+        work_queue.pushKV("depth", (uint64_t)stats.nDepth);
+        work_queue.pushKV("max_depth", (uint64_t)stats.nMaxDepth);
+        work_queue.pushKV("rejected", stats.nRejected);
+        UniValue queue_time(UniValue::VARR);
+        for (uint64_t count : stats.vQueueTime) queue_time.push_back(count);
+        work_queue.pushKV("queue_time", queue_time);
+        UniValue service_time(UniValue::VARR);
+        for (uint64_t count : stats.vServiceTime) service_time.push_back(count);
+        work_queue.pushKV("service_time", service_time);
+        result.pushKV("work_queue", work_queue);
+    }
+
     return result;
 }
 
@@ -486,11 +512,63 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
+/**
+ * Methods that only read state, so calls to them within a batch may run at
+ * the same time as each other.
+ */
+static const std::set<std::string> setParallelBatchMethods = {
+    "decoderawtransaction",
+    "decodescript",
+    "getbestblockhash",
+    "getblock",
+    "getblockcount",
+    "getblockhash",
+    "getblockheader",
+    "getblockstats",
+    "getchaintips",
+    "getdifficulty",
+    "getmempoolancestors",
+    "getmempooldescendants",
+    "getmempoolentry",
+    "getrawmempool",
+    "getrawtransaction",
+    "gettxout",
+    "gettxoutproof",
+    "verifytxoutproof",
+};
+
+static bool IsParallelBatchCall(const UniValue& req)
+{
+    if (!req.isObject()) return false;
+    const UniValue& method = find_value(req, "method");
+    return method.isStr() && setParallelBatchMethods.count(method.get_str());
+}
+
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
+    // Runs of read-only calls are spread over the HTTP worker threads. Any
+    // other call runs on its own, after the calls before it and before the
+    // calls after it, so a batch sees its own changes in order.
+    std::vector<UniValue> vRet(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t reqEnd = reqIdx;
+        while (reqEnd < vReq.size() && IsParallelBatchCall(vReq[reqEnd]))
+            reqEnd++;
+        if (reqEnd - reqIdx > 1) {
+            HTTPRunParallel(reqEnd - reqIdx, [&](size_t i) {
+                vRet[reqIdx + i] = JSONRPCExecOne(jreq, vReq[reqIdx + i]);
+            });
+            reqIdx = reqEnd;
+        } else {
+            vRet[reqIdx] = JSONRPCExecOne(jreq, vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    for (const UniValue& reply : vRet)
+        ret.push_back(reply);
 
     return ret.write() + "\n";
 }
@@ -20,6 +20,7 @@
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 
 class CRPCCommand;
+class JSONStreamWriter;
 
 namespace RPCServer
 {
@@ -46,8 +47,10 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /** Where large results can be written as they are produced, if the caller supports it */
+    JSONStreamWriter* stream;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), stream(nullptr) {}
     void parse(const UniValue& valRequest);
 };
 
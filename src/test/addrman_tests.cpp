@@ -6,9 +6,11 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include <clientversion.h>
 #include <hash.h>
 #include <netbase.h>
 #include <random.h>
+#include <streams.h>
 
 class CAddrManTest : public CAddrMan
 {
@@ -408,6 +410,45 @@ BOOST_AUTO_TEST_CASE(addrman_getaddr)
     BOOST_CHECK_EQUAL(addrman.size(), 2006U);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_add_batch)
+{
+    CAddrManTest addrmanBatch;
+    CAddrManTest addrmanSingle;
+
+    std::vector<CAddress> vAddr;
+    for (unsigned int i = 1; i < 600; i++) {
+        std::string strAddr = std::to_string(i % 256) + "." + std::to_string(i / 256 + 1) + ".3.4";
+        CAddress addr = CAddress(ResolveService(strAddr, 8333 + i % 3), NODE_NONE);
+        addr.nTime = GetAdjustedTime() - 60 * 60 * 24;
+        vAddr.push_back(addr);
+    }
+    // Newer announcements of known addresses, some on another port, and an unroutable one
+    for (unsigned int i = 1; i < 100; i++) {
+        std::string strAddr = std::to_string(i % 256) + "." + std::to_string(i / 256 + 1) + ".3.4";
+        CAddress addr = CAddress(ResolveService(strAddr, i % 2 ? 9999 : 8333 + i % 3), NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        vAddr.push_back(addr);
+    }
+    vAddr.push_back(CAddress(ResolveService("10.0.0.1", 8333), NODE_NONE));
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    // Adding addresses in one batch places them exactly as adding them one by one does
+    BOOST_CHECK(addrmanBatch.Add(vAddr, source));
+    for (const CAddress& addr : vAddr) {
+        addrmanSingle.Add(addr, source);
+    }
+    BOOST_CHECK(addrmanBatch.size() > 500);
+    BOOST_CHECK_EQUAL(addrmanBatch.size(), addrmanSingle.size());
+
+    CDataStream ssBatch(SER_DISK, CLIENT_VERSION), ssSingle(SER_DISK, CLIENT_VERSION);
+    ssBatch << addrmanBatch;
+    ssSingle << addrmanSingle;
+    BOOST_CHECK(ssBatch.str() == ssSingle.str());
+
+    addrmanBatch.Clear();
+    BOOST_CHECK_EQUAL(addrmanBatch.size(), 0U);
+}
+
 
 BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket)
 {
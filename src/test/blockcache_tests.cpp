@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+#include <streams.h>
+#include <version.h>
+#include <test/test_bagicoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce)
+{
+    auto pblock = std::make_shared<CBlock>();
+    pblock->nNonce = nNonce;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nNonce;
+    pblock->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CRecentBlockCache cache(2);
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    for (uint32_t i = 0; i < 3; i++) {
+        blocks.push_back(MakeBlock(i));
+    }
+    const uint256 hash0 = InsecureRand256(), hash1 = InsecureRand256(), hash2 = InsecureRand256();
+
+    cache.Insert(hash0, blocks[0]);
+    cache.Insert(hash1, blocks[1]);
+    // Touch block 0 so block 1 is evicted first
+    BOOST_CHECK(cache.Get(hash0) == blocks[0]);
+    cache.Insert(hash2, blocks[2]);
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+    BOOST_CHECK(cache.Get(hash0) == blocks[0]);
+    BOOST_CHECK(cache.Get(hash1) == nullptr);
+    BOOST_CHECK(cache.Get(hash2) == blocks[2]);
+
+    cache.SetMaxBlocks(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK(cache.Get(hash2) == blocks[2]);
+
+    cache.SetMaxBlocks(0);
+    cache.Insert(hash1, blocks[1]);
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK(cache.Get(hash1) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_serialized)
+{
+    CRecentBlockCache cache(4);
+    std::shared_ptr<const CBlock> pblock = MakeBlock(42);
+    const uint256 hash = pblock->GetHash();
+    BOOST_CHECK(cache.GetSerialized(hash) == nullptr);
+
+    cache.Insert(hash, pblock);
+    std::shared_ptr<const std::vector<unsigned char>> serialized = cache.GetSerialized(hash);
+    BOOST_REQUIRE(serialized);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *pblock;
+    BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == *serialized);
+    // The serialization is computed once and shared
+    BOOST_CHECK(cache.GetSerialized(hash) == serialized);
+
+    cache.Clear();
+    BOOST_CHECK(cache.GetSerialized(hash) == nullptr);
+    BOOST_CHECK_EQUAL(serialized->size(), ss.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -68,4 +68,32 @@ BOOST_AUTO_TEST_CASE(get_difficulty_for_very_high_target)
     TestDifficulty(0x12345678, 5913134931067755359633408.0);
 }
 
+BOOST_AUTO_TEST_CASE(block_index_arena)
+{
+    CBlockIndexArena arena;
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+
+    CBlockHeader header;
+    header.nTime = 1269211443;
+    header.nBits = 0x1d00ffff;
+    std::vector<CBlockIndex*> entries;
+    for (size_t i = 0; i < CBlockIndexArena::CHUNK_ENTRIES + 10; i++) {
+        entries.push_back(i % 2 ? arena.Allocate(header) : arena.Allocate());
+        entries.back()->nHeight = i;
+    }
+    BOOST_CHECK_EQUAL(arena.size(), CBlockIndexArena::CHUNK_ENTRIES + 10);
+
+    // Entries stay where they were allocated as the arena grows
+    for (size_t i = 0; i < entries.size(); i++) {
+        BOOST_CHECK_EQUAL(entries[i]->nHeight, (int)i);
+        BOOST_CHECK_EQUAL(entries[i]->nTime, i % 2 ? header.nTime : 0U);
+        BOOST_CHECK(entries[i]->pprev == nullptr);
+    }
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+    BOOST_CHECK_EQUAL(arena.Allocate()->nHeight, 0);
+    BOOST_CHECK_EQUAL(arena.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
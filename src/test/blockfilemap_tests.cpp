@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+#include <test/test_bagicoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BasicTestingSetup)
+
+#ifndef WIN32
+static void AppendToFile(const fs::path& path, const std::string& data)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_lru)
+{
+    fs::path dir = SetDataDir("blockfilemap_lru");
+    for (int i = 0; i < 3; i++) {
+        AppendToFile(dir / strprintf("blk%05u.dat", i), strprintf("block file %d", i));
+    }
+
+    CBlockFileMapCache cache(2);
+    BOOST_CHECK(cache.IsEnabled());
+    std::shared_ptr<const CMappedBlockFile> file0 = cache.Get(0, dir / "blk00000.dat", 1);
+    BOOST_REQUIRE(file0);
+    BOOST_CHECK_EQUAL(std::string((const char*)file0->GetSpan().data(), file0->size()), "block file 0");
+    BOOST_CHECK(cache.Get(1, dir / "blk00001.dat", 1));
+    // Touch file 0 so file 1 is the least recently used one
+    BOOST_CHECK(cache.Get(0, dir / "blk00000.dat", 1) == file0);
+    BOOST_CHECK(cache.Get(2, dir / "blk00002.dat", 1));
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+    BOOST_CHECK(cache.Get(0, dir / "blk00000.dat", 1) == file0);
+
+    // Evicted and erased mappings stay valid while referenced
+    cache.Erase(0);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK_EQUAL(std::string((const char*)file0->GetSpan().data(), file0->size()), "block file 0");
+
+    // Missing or short files are not mapped
+    BOOST_CHECK(!cache.Get(3, dir / "blk00003.dat", 1));
+    BOOST_CHECK(!cache.Get(0, dir / "blk00000.dat", 100));
+
+    cache.SetMaxFiles(0);
+    BOOST_CHECK(!cache.IsEnabled());
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK(!cache.Get(0, dir / "blk00000.dat", 1));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_growth)
+{
+    fs::path dir = SetDataDir("blockfilemap_growth");
+    fs::path path = dir / "blk00000.dat";
+    AppendToFile(path, "first");
+
+    CBlockFileMapCache cache(1);
+    std::shared_ptr<const CMappedBlockFile> before = cache.Get(0, path, 5);
+    BOOST_REQUIRE(before);
+    BOOST_CHECK_EQUAL(before->size(), 5U);
+
+    // Asking for more than is mapped remaps the grown file
+    AppendToFile(path, "second");
+    std::shared_ptr<const CMappedBlockFile> after = cache.Get(0, path, 11);
+    BOOST_REQUIRE(after);
+    BOOST_CHECK_EQUAL(std::string((const char*)after->GetSpan().data(), after->size()), "firstsecond");
+    BOOST_CHECK_EQUAL(before->size(), 5U);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
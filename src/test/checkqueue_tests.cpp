@@ -146,9 +146,11 @@ typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
 /** This test case checks that the CCheckQueue works properly
  * with each specified size_t Checks pushed.
  */
-static void Correct_Queue_range(std::vector<size_t> range)
+static void Correct_Queue_range(std::vector<size_t> range, bool fWorkStealing = false)
 {
     auto small_queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
+    if (fWorkStealing)
+        small_queue->EnableWorkStealing(nScriptCheckThreads + 1);
     boost::thread_group tg;
     for (auto x = 0; x < nScriptCheckThreads; ++x) {
        tg.create_thread([&]{small_queue->Thread();});
@@ -209,6 +211,17 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
     Correct_Queue_range(range);
 }
 
+/** Test that the work-stealing mode runs every check exactly once
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_WorkStealing)
+{
+    std::vector<size_t> range;
+    range.reserve(100000/1000);
+    for (size_t i = 0; i < 100000; i += std::max((size_t)1, (size_t)InsecureRandRange(std::min((size_t)1000, ((size_t)100000) - i))))
+        range.push_back(i);
+    Correct_Queue_range(range, true);
+}
+
 
 /** Test that failing checks are caught */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
@@ -269,6 +282,66 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
     tg.join_all();
 }
 
+/** Test that the work-stealing mode catches failures and clears them for the next block */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_WorkStealing_Failure)
+{
+    auto fail_queue = MakeUnique<Failing_Queue>(QUEUE_BATCH_SIZE);
+    fail_queue->EnableWorkStealing(nScriptCheckThreads + 1);
+    boost::thread_group tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+       tg.create_thread([&]{fail_queue->Thread();});
+    }
+
+    for (auto times = 0; times < 100; ++times) {
+        for (const bool end_fails : {true, false}) {
+            CCheckQueueControl<FailingCheck> control(fail_queue.get());
+            {
+                std::vector<FailingCheck> vChecks;
+                vChecks.resize(1000, false);
+                vChecks[InsecureRandRange(1000)] = end_fails;
+                control.Add(vChecks);
+            }
+            bool r = control.Wait();
+            BOOST_REQUIRE(r != end_fails);
+        }
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+/** Test that the per-block and per-thread counters add up */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Stats)
+{
+    for (const bool fWorkStealing : {false, true}) {
+        auto queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
+        if (fWorkStealing)
+            queue->EnableWorkStealing(nScriptCheckThreads + 1);
+        boost::thread_group tg;
+        for (auto x = 0; x < nScriptCheckThreads; ++x) {
+           tg.create_thread([&]{queue->Thread();});
+        }
+        for (size_t nBlock = 0; nBlock < 10; ++nBlock) {
+            CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+            std::vector<FakeCheckCheckCompletion> vChecks(100 * nBlock);
+            control.Add(vChecks);
+            BOOST_REQUIRE(control.Wait());
+        }
+        tg.interrupt_all();
+        tg.join_all();
+
+        CCheckQueueStats stats = queue->GetStats();
+        BOOST_CHECK_EQUAL(stats.fWorkStealing, fWorkStealing);
+        BOOST_CHECK_EQUAL(stats.nBlocks, 10U);
+        BOOST_CHECK_EQUAL(stats.nChecks, 4500U);
+        BOOST_CHECK_EQUAL(stats.nLastBlockChecks, 900U);
+        BOOST_CHECK_EQUAL(stats.vWorkers.size(), (size_t)nScriptCheckThreads + 1);
+        uint64_t nExecuted = 0;
+        for (const CCheckQueueWorkerStats& worker : stats.vWorkers)
+            nExecuted += worker.nChecks;
+        BOOST_CHECK_EQUAL(nExecuted, 4500U);
+    }
+}
+
 // Test that unique checks are actually all called individually, rather than
 // just one check being called repeatedly. Test that checks are not called
 // more than once as well
@@ -6,6 +6,7 @@
 
 #include <banman.h>
 #include <chainparams.h>
+#include <interfaces/modules.h>
 #include <keystore.h>
 #include <net.h>
 #include <net_processing.h>
@@ -14,35 +15,26 @@
 #include <serialize.h>
 #include <util/system.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/test_bagicoin.h>
 
+#include <atomic>
+#include <chrono>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 
-struct CConnmanTest : public CConnman {
-    using CConnman::CConnman;
-    void AddNode(CNode& node)
-    {
-        LOCK(cs_vNodes);
-        vNodes.push_back(&node);
-    }
-    void ClearNodes()
-    {
-        LOCK(cs_vNodes);
-        for (CNode* node : vNodes) {
-            delete node;
-        }
-        vNodes.clear();
-    }
-};
-
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
 extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-extern void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
+extern int GetBlocksInTransitTarget(NodeId nodeid, int64_t nPingUsec);
+extern unsigned int GetBlockDownloadWindow();
+extern bool IsStallingBlockOverdue(NodeId nodeid, NodeId staller, const uint256& hash, int64_t nNow);
+extern void MarkBlockAsInFlightAt(NodeId nodeid, const CBlockIndex* pindex, int64_t nTime);
+extern bool MarkBlockAsReceivedAt(const uint256& hash, NodeId nodeFrom, int64_t nTime);
 
 struct COrphanTx {
     CTransactionRef tx;
@@ -76,7 +68,7 @@ BOOST_FIXTURE_TEST_SUITE(denialofservice_tests, TestingSetup)
 BOOST_AUTO_TEST_CASE(outbound_slow_chain_eviction)
 {
     auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
-    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false, false);
 
     // Mock an outbound peer
     CAddress addr1(ip(0xa0b0c001), NODE_NONE);
@@ -146,7 +138,7 @@ static void AddRandomOutboundPeer(std::vector<CNode *> &vNodes, PeerLogicValidat
 BOOST_AUTO_TEST_CASE(stale_tip_peer_management)
 {
     auto connman = MakeUnique<CConnmanTest>(0x1337, 0x1337);
-    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false, false);
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     constexpr int nMaxOutbound = 8;
@@ -219,7 +211,7 @@ BOOST_AUTO_TEST_CASE(DoS_banning)
 {
     auto banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
     auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
-    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), banman.get(), scheduler, false);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), banman.get(), scheduler, false, false);
 
     banman->ClearBanned();
     CAddress addr1(ip(0xa0b0c001), NODE_NONE);
@@ -274,7 +266,7 @@ BOOST_AUTO_TEST_CASE(DoS_banscore)
 {
     auto banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
     auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
-    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), banman.get(), scheduler, false);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), banman.get(), scheduler, false, false);
 
     banman->ClearBanned();
     gArgs.ForceSetArg("-banscore", "111"); // because 11 is my favorite number
@@ -321,7 +313,7 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
 {
     auto banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
     auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
-    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), banman.get(), scheduler, false);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), banman.get(), scheduler, false, false);
 
     banman->ClearBanned();
     int64_t nStartTime = GetTime();
@@ -445,4 +437,243 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+// Block index entries that only need a hash and a height
+struct DownloadTestBlocks {
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    explicit DownloadTestBlocks(int nBlocks) : vHashes(nBlocks), vIndex(nBlocks)
+    {
+        for (int i = 0; i < nBlocks; i++) {
+            vHashes[i] = InsecureRand256();
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].nHeight = i + 1;
+        }
+    }
+};
+
+// Request nBlocks blocks from a peer at nTime, and have them arrive nInterval apart
+static void DownloadBlocks(NodeId nodeid, DownloadTestBlocks& blocks, int& nNext, int nBlocks, int64_t& nTime, int64_t nInterval)
+{
+    for (int i = 0; i < nBlocks; i++) {
+        MarkBlockAsInFlightAt(nodeid, &blocks.vIndex[nNext + i], nTime);
+    }
+    for (int i = 0; i < nBlocks; i++) {
+        nTime += nInterval;
+        BOOST_CHECK(MarkBlockAsReceivedAt(blocks.vHashes[nNext + i], nodeid, nTime));
+    }
+    nNext += nBlocks;
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_download_window)
+{
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false, true);
+
+    CAddress addr1(ip(0xa0b0c001), NODE_NONE);
+    CNode dummyNode1(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr1, 0, 0, CAddress(), "", true);
+    peerLogic->InitializeNode(&dummyNode1);
+    CAddress addr2(ip(0xa0b0c002), NODE_NONE);
+    CNode dummyNode2(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr2, 1, 1, CAddress(), "", true);
+    peerLogic->InitializeNode(&dummyNode2);
+
+    DownloadTestBlocks blocks(64);
+    int nNext = 0;
+    int64_t nTime = 1000000000;
+    LOCK(cs_main);
+
+    // Without measurements, the fixed limits apply
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(dummyNode1.GetId(), 100000), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(), BLOCK_DOWNLOAD_WINDOW);
+
+    // A peer delivering a block every 5ms keeps two round trips' worth in flight,
+    // and the window grows to the 2000 blocks it delivers in 10 seconds
+    DownloadBlocks(dummyNode1.GetId(), blocks, nNext, 8, nTime, 5000);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(dummyNode1.GetId(), 100000), 2 * (100000 / 5000 + 1));
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(dummyNode1.GetId(), std::numeric_limits<int64_t>::max()), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(dummyNode1.GetId(), 1000000), MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(), 2000U);
+
+    // Both peers together
+    DownloadBlocks(dummyNode2.GetId(), blocks, nNext, 8, nTime, 5000);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(), 4000U);
+
+    // The second peer slowing down to a block every 100ms moves its average, and the window shrinks
+    DownloadBlocks(dummyNode2.GetId(), blocks, nNext, 1, nTime, 100000);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(), (unsigned int)(10 * (200 + 1000000.0 / ((5000 * 7 + 100000) / 8))));
+    DownloadBlocks(dummyNode2.GetId(), blocks, nNext, 32, nTime, 100000);
+    const unsigned int nWindow = GetBlockDownloadWindow();
+    BOOST_CHECK(nWindow > 2000U && nWindow < 2200U);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(dummyNode2.GetId(), 10000), MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // Blocks that arrive back to back only count the time since the previous one
+    DownloadBlocks(dummyNode1.GetId(), blocks, nNext, 8, nTime, 5000);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(dummyNode1.GetId(), 100000), 2 * (100000 / 5000 + 1));
+
+    // The window stays fixed in prune mode
+    fPruneMode = true;
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(), BLOCK_DOWNLOAD_WINDOW);
+    fPruneMode = false;
+
+    // Without the fast peer, the window drops back to its minimum
+    bool dummy;
+    peerLogic->FinalizeNode(dummyNode1.GetId(), dummy);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(), BLOCK_DOWNLOAD_WINDOW);
+    peerLogic->FinalizeNode(dummyNode2.GetId(), dummy);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_download_reassign)
+{
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false, true);
+
+    CAddress addr1(ip(0xa0b0c001), NODE_NONE);
+    CNode nodeSlow(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr1, 0, 0, CAddress(), "", true);
+    peerLogic->InitializeNode(&nodeSlow);
+    CAddress addr2(ip(0xa0b0c002), NODE_NONE);
+    CNode nodeFast(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr2, 1, 1, CAddress(), "", true);
+    peerLogic->InitializeNode(&nodeFast);
+    CAddress addr3(ip(0xa0b0c003), NODE_NONE);
+    CNode nodeNew(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr3, 2, 2, CAddress(), "", true);
+    peerLogic->InitializeNode(&nodeNew);
+
+    DownloadTestBlocks blocks(32);
+    int nNext = 0;
+    int64_t nTime = 1000000000;
+    LOCK(cs_main);
+    DownloadBlocks(nodeSlow.GetId(), blocks, nNext, 1, nTime, 100000);
+    DownloadBlocks(nodeFast.GetId(), blocks, nNext, 1, nTime, 5000);
+
+    // 16 blocks in flight from the slow peer are expected within 1.6 seconds
+    const int64_t nRequested = nTime;
+    const CBlockIndex* pindexStalling = &blocks.vIndex[nNext];
+    for (int i = 0; i < 16; i++) {
+        MarkBlockAsInFlightAt(nodeSlow.GetId(), &blocks.vIndex[nNext++], nRequested);
+    }
+    const uint256& hash = pindexStalling->GetBlockHash();
+    BOOST_CHECK(!IsStallingBlockOverdue(nodeFast.GetId(), nodeSlow.GetId(), hash, nRequested + 3000000));
+    BOOST_CHECK(IsStallingBlockOverdue(nodeFast.GetId(), nodeSlow.GetId(), hash, nRequested + 3300000));
+    // Only a peer that has been delivering faster takes it over
+    BOOST_CHECK(!IsStallingBlockOverdue(nodeNew.GetId(), nodeSlow.GetId(), hash, nRequested + 3300000));
+    BOOST_CHECK(!IsStallingBlockOverdue(nodeSlow.GetId(), nodeFast.GetId(), hash, nRequested + 3300000));
+
+    // Requesting it from the fast peer takes it off the slow peer's queue
+    MarkBlockAsInFlightAt(nodeFast.GetId(), pindexStalling, nRequested + 3300000);
+    CNodeStateStats statsSlow;
+    BOOST_CHECK(GetNodeStateStats(nodeSlow.GetId(), statsSlow));
+    BOOST_CHECK_EQUAL(statsSlow.vHeightInFlight.size(), 15U);
+    BOOST_CHECK(std::find(statsSlow.vHeightInFlight.begin(), statsSlow.vHeightInFlight.end(), pindexStalling->nHeight) == statsSlow.vHeightInFlight.end());
+    CNodeStateStats statsFast;
+    BOOST_CHECK(GetNodeStateStats(nodeFast.GetId(), statsFast));
+    BOOST_CHECK_EQUAL(statsFast.vHeightInFlight.size(), 1U);
+    BOOST_CHECK_EQUAL(statsFast.vHeightInFlight[0], pindexStalling->nHeight);
+    BOOST_CHECK(!IsStallingBlockOverdue(nodeFast.GetId(), nodeSlow.GetId(), hash, nRequested + 3300000));
+
+    // The slow peer delivering it after all clears the request, without counting towards either peer's speed
+    BOOST_CHECK(MarkBlockAsReceivedAt(hash, nodeSlow.GetId(), nRequested + 3400000));
+    CNodeStateStats statsAfter;
+    BOOST_CHECK(GetNodeStateStats(nodeFast.GetId(), statsAfter));
+    BOOST_CHECK(statsAfter.vHeightInFlight.empty());
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(nodeSlow.GetId(), 1000000), 2 * (1000000 / 100000 + 1));
+    BOOST_CHECK_EQUAL(GetBlocksInTransitTarget(nodeFast.GetId(), 100000), 2 * (100000 / 5000 + 1));
+    BOOST_CHECK(!MarkBlockAsReceivedAt(hash, nodeFast.GetId(), nRequested + 3400000));
+
+    bool dummy;
+    peerLogic->FinalizeNode(nodeSlow.GetId(), dummy);
+    peerLogic->FinalizeNode(nodeFast.GetId(), dummy);
+    peerLogic->FinalizeNode(nodeNew.GetId(), dummy);
+}
+
+class ModuleMessageCounter : public CValidationInterface
+{
+public:
+    std::atomic<int> nCalls{0};
+
+protected:
+    void ProcessModuleMessage(CNode* pfrom, const NetMsgDest& dest, const std::string& strCommand, CDataStream& vRecv, CConnman* connman) override
+    {
+        nCalls++;
+    }
+};
+
+// Several message handler threads send to their own peers at once, while
+// inventory is relayed to all of them and each hands module messages over
+BOOST_AUTO_TEST_CASE(sendmessages_handler_threads)
+{
+    static const int THREADS = 4;
+    static const int NODES_PER_THREAD = 2;
+    static const int ITEMS = 200;
+
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false, false);
+    ModuleMessageCounter counter;
+    RegisterValidationInterface(&counter);
+
+    std::vector<std::unique_ptr<CNode>> vNodes;
+    for (int i = 0; i < THREADS * NODES_PER_THREAD; i++) {
+        CAddress addr(ip(0xa0b0c100 + i), NODE_NONE);
+        vNodes.emplace_back(new CNode(id++, ServiceFlags(NODE_NETWORK), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ false));
+        CNode& node = *vNodes.back();
+        node.SetSendVersion(PROTOCOL_VERSION);
+        peerLogic->InitializeNode(&node);
+        node.nVersion = PROTOCOL_VERSION;
+        node.fSuccessfullyConnected = true;
+    }
+    auto sendMessages = [&](CNode& node) {
+        LOCK(node.cs_sendProcessing);
+        BOOST_CHECK(peerLogic->SendMessages(&node));
+    };
+
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < ITEMS; i++) {
+        vHashes.push_back(InsecureRand256());
+    }
+    std::atomic<bool> fRelayed{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t] {
+            do {
+                for (int i = 0; i < NODES_PER_THREAD; i++) {
+                    CNode& node = *vNodes[t * NODES_PER_THREAD + i];
+                    sendMessages(node);
+                    CDataStream ssEmpty(SER_NETWORK, PROTOCOL_VERSION);
+                    GetMainSignals().ProcessModuleMessage(&node, NetMsgDest::MSG_ALL, NetMsgType::DSEG, ssEmpty, connman.get());
+                }
+            } while (!fRelayed);
+        });
+    }
+    for (const uint256& hash : vHashes) {
+        connman->RelayInv(CInv(MSG_GOVERNANCE_OBJECT, hash));
+    }
+    fRelayed = true;
+    for (auto& thread : threads) thread.join();
+
+    // A pass waits for cs_main rather than being skipped
+    const CInv invLast(MSG_GOVERNANCE_OBJECT, InsecureRand256());
+    connman->RelayInv(invLast);
+    vHashes.push_back(invLast.hash);
+    {
+        LOCK(cs_main);
+        for (auto& node : vNodes) {
+            CNode* pnode = node.get();
+            threads.emplace_back([&sendMessages, pnode] { sendMessages(*pnode); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    for (size_t i = THREADS; i < threads.size(); i++) threads[i].join();
+
+    for (auto& node : vNodes) {
+        LOCK(node->cs_inventory);
+        for (const uint256& hash : vHashes) {
+            BOOST_CHECK(node->filterInventoryKnown.contains(hash));
+        }
+    }
+    BOOST_CHECK(counter.nCalls > 0);
+
+    UnregisterValidationInterface(&counter);
+    bool dummy;
+    for (auto& node : vNodes) {
+        peerLogic->FinalizeNode(node->GetId(), dummy);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iblt.h>
+#include <streams.h>
+#include <test/test_bagicoin.h>
+#include <version.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(iblt_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(iblt_reconcile)
+{
+    std::vector<uint256> vShared, vOnlyTheirs, vOnlyOurs;
+    for (int i = 0; i < 2000; i++) vShared.push_back(InsecureRand256());
+    for (int i = 0; i < 40; i++) vOnlyTheirs.push_back(InsecureRand256());
+    for (int i = 0; i < 60; i++) vOnlyOurs.push_back(InsecureRand256());
+
+    CIblt theirs(CIblt::CellsForSetSize(vShared.size() + vOnlyTheirs.size()));
+    for (const uint256& hash : vShared) theirs.Insert(hash);
+    for (const uint256& hash : vOnlyTheirs) theirs.Insert(hash);
+
+    // Round trip as a peer would receive it
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << theirs;
+    CIblt received;
+    stream >> received;
+    BOOST_CHECK_EQUAL(received.size(), theirs.size());
+
+    std::vector<uint256> vOurs(vShared);
+    vOurs.insert(vOurs.end(), vOnlyOurs.begin(), vOnlyOurs.end());
+    std::set<uint256> setMissing;
+    BOOST_REQUIRE(received.GetMissing(vOurs, setMissing));
+    BOOST_CHECK(setMissing == std::set<uint256>(vOnlyOurs.begin(), vOnlyOurs.end()));
+
+    // Both sides of the difference are listed
+    CIblt ours = CIblt::EmptyLike(received);
+    for (const uint256& hash : vOurs) ours.Insert(hash);
+    BOOST_REQUIRE(ours.Subtract(received));
+    std::set<uint64_t> setPositive, setNegative;
+    BOOST_REQUIRE(ours.Decode(setPositive, setNegative));
+    BOOST_CHECK_EQUAL(setPositive.size(), vOnlyOurs.size());
+    BOOST_CHECK_EQUAL(setNegative.size(), vOnlyTheirs.size());
+    for (const uint256& hash : vOnlyTheirs) {
+        BOOST_CHECK(setNegative.count(received.GetShortID(hash)));
+    }
+
+    // Tables of another salt or size don't subtract
+    BOOST_CHECK(!ours.Subtract(CIblt(ours.size())));
+}
+
+BOOST_AUTO_TEST_CASE(iblt_overflow)
+{
+    // A difference far beyond the capacity of the table is reported, not misread
+    CIblt theirs(CIblt::MIN_CELLS);
+    std::vector<uint256> vOurs;
+    for (int i = 0; i < 1000; i++) vOurs.push_back(InsecureRand256());
+    std::set<uint256> setMissing;
+    BOOST_CHECK(!theirs.GetMissing(vOurs, setMissing));
+
+    // Erasing everything inserted leaves an empty table
+    CIblt iblt(CIblt::MIN_CELLS);
+    for (const uint256& hash : vOurs) iblt.Insert(hash);
+    for (const uint256& hash : vOurs) iblt.Erase(hash);
+    std::set<uint64_t> setPositive, setNegative;
+    BOOST_CHECK(iblt.Decode(setPositive, setNegative));
+    BOOST_CHECK(setPositive.empty() && setNegative.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <modules/masternode/masternode_compact.h>
+#include <streams.h>
+#include <test/test_bagicoin.h>
+#include <version.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_compact_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(mnping_batch_roundtrip)
+{
+    std::vector<std::pair<CMasternodePing, int>> vPings;
+    for (int i = 0; i < 3; i++) {
+        CMasternodePing mnp(COutPoint(InsecureRand256(), i));
+        mnp.blockHash = InsecureRand256();
+        mnp.sigTime = 1500000000 + i;
+        mnp.vchSig = std::vector<unsigned char>(65, i);
+        mnp.fSentinelIsCurrent = i % 2;
+        mnp.nSentinelVersion = 0x010001;
+        mnp.nDaemonVersion = 180000 + i;
+        vPings.emplace_back(mnp, 100 + i);
+    }
+
+    CMasternodePingBatch batch(vPings);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << batch;
+
+    CMasternodePingBatch batch2;
+    stream >> batch2;
+    BOOST_REQUIRE_EQUAL(batch2.vPings.size(), vPings.size());
+    for (size_t i = 0; i < vPings.size(); i++) {
+        const CMasternodePing& mnp = vPings[i].first;
+        // Short ids resolve the same way on both ends
+        BOOST_CHECK_EQUAL(batch2.vPings[i].nShortId, batch.GetShortID(mnp.masternodeOutpoint));
+        BOOST_CHECK_EQUAL(batch2.GetShortID(mnp.masternodeOutpoint), batch.GetShortID(mnp.masternodeOutpoint));
+        BOOST_CHECK_EQUAL(batch2.vPings[i].nBlockHeight, vPings[i].second);
+
+        // Rebuilding from the resolved outpoint and block gives back the signed ping
+        CMasternodePing mnp2 = batch2.GetPing(i, mnp.masternodeOutpoint, mnp.blockHash);
+        BOOST_CHECK(mnp2.GetHash() == mnp.GetHash());
+        BOOST_CHECK(mnp2.vchSig == mnp.vchSig);
+    }
+
+    // Short ids depend on the salt only, so a receiver can reuse what it resolved under it
+    CMasternodePingBatch batch3(vPings);
+    BOOST_CHECK(batch3.GetShortID(vPings[0].first.masternodeOutpoint) != batch.GetShortID(vPings[0].first.masternodeOutpoint));
+    CMasternodePingBatch batch4(std::vector<std::pair<CMasternodePing, int>>(vPings.begin(), vPings.begin() + 1), batch.GetNonce());
+    BOOST_CHECK_EQUAL(batch4.GetNonce(), batch2.GetNonce());
+    BOOST_CHECK_EQUAL(batch4.vPings[0].nShortId, batch2.vPings[0].nShortId);
+}
+
+BOOST_AUTO_TEST_CASE(mnping_batch_limit)
+{
+    std::vector<std::pair<CMasternodePing, int>> vPings(CMasternodePingBatch::MAX_PINGS + 1);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CMasternodePingBatch(vPings);
+    CMasternodePingBatch batch;
+    BOOST_CHECK_THROW(stream >> batch, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
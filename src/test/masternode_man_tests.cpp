@@ -0,0 +1,50 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <modules/masternode/masternode_man.h>
+#include <modules/masternode/masternode_payments.h>
+#include <modules/coinjoin/coinjoin.h>
+#include <netbase.h>
+#include <test/test_bagicoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_man_tests, TestingSetup)
+
+static void CheckSnapshotCounts()
+{
+    std::shared_ptr<const CMasternodeListSnapshot> pSnapshot = mnodeman.GetListSnapshot();
+    BOOST_REQUIRE(pSnapshot);
+    BOOST_CHECK_EQUAL(pSnapshot->nTotal, mnodeman.size());
+    BOOST_CHECK_EQUAL(pSnapshot->nEnabled, mnodeman.CountEnabled());
+    BOOST_CHECK_EQUAL(pSnapshot->nEnabledCJ, mnodeman.CountEnabled(MIN_COINJOIN_PEER_PROTO_VERSION));
+}
+
+BOOST_AUTO_TEST_CASE(list_snapshot_counts)
+{
+    // Two current masternodes and one too old to be paid
+    const int nOldProto = mnpayments.GetMinMasternodePaymentsProto() - 1;
+    for (int i = 0; i < 3; i++) {
+        CService addr;
+        BOOST_CHECK(Lookup(strprintf("1.2.3.%d", i + 1).c_str(), addr, 9999, false));
+        CMasternode mn(addr, COutPoint(InsecureRand256(), i), CPubKey(), CNoDestination(), CPubKey(), i < 2 ? PROTOCOL_VERSION : nOldProto);
+        BOOST_CHECK(mnodeman.Add(mn));
+    }
+
+    // Adding publishes the list
+    CheckSnapshotCounts();
+    BOOST_CHECK_EQUAL(mnodeman.GetListSnapshot()->nTotal, 3);
+    BOOST_CHECK_EQUAL(mnodeman.GetListSnapshot()->nEnabled, 2);
+
+    // A check round changes their states, their collaterals don't exist, and publishes it
+    mnodeman.Check();
+    CheckSnapshotCounts();
+    BOOST_CHECK_EQUAL(mnodeman.GetListSnapshot()->nTotal, 3);
+
+    mnodeman.Clear();
+    CheckSnapshotCounts();
+    BOOST_CHECK_EQUAL(mnodeman.GetListSnapshot()->nTotal, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
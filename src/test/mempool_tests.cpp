@@ -749,4 +749,44 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolLinksTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [tx1] and [tx2] are spent by four children, the last of which spends both
+    CTransactionRef tx1 = make_tx(/* output_values */ {COIN, COIN, COIN, COIN});
+    CTransactionRef tx2 = make_tx(/* output_values */ {COIN});
+    pool.addUnchecked(entry.FromTx(tx1));
+    pool.addUnchecked(entry.FromTx(tx2));
+    std::vector<CTransactionRef> children;
+    for (uint32_t i = 0; i < 3; i++) {
+        children.push_back(make_tx(/* output_values */ {COIN}, /* inputs */ {tx1}, /* input_indices */ {i}));
+    }
+    children.push_back(make_tx(/* output_values */ {COIN}, /* inputs */ {tx1, tx2}, /* input_indices */ {3, 0}));
+    for (const CTransactionRef& tx : children) {
+        pool.addUnchecked(entry.FromTx(tx));
+    }
+
+    // Links are kept in txid order, also beyond those stored inline
+    const CTxMemPoolEntry::Links& links = pool.GetMemPoolChildren(pool.mapTx.find(tx1->GetHash()));
+    BOOST_CHECK_EQUAL(links.size(), 4U);
+    for (size_t i = 1; i < links.size(); i++) {
+        BOOST_CHECK(links[i - 1]->GetTx().GetHash() < links[i]->GetTx().GetHash());
+    }
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(pool.mapTx.find(tx2->GetHash())).size(), 1U);
+    const CTxMemPoolEntry::Links& parents = pool.GetMemPoolParents(pool.mapTx.find(children.back()->GetHash()));
+    BOOST_CHECK_EQUAL(parents.size(), 2U);
+    BOOST_CHECK(parents[0]->GetTx().GetHash() < parents[1]->GetTx().GetHash());
+
+    // Removing the children unlinks them from both parents
+    for (const CTransactionRef& tx : children) {
+        pool.removeRecursive(*tx);
+    }
+    BOOST_CHECK(pool.GetMemPoolChildren(pool.mapTx.find(tx1->GetHash())).empty());
+    BOOST_CHECK(pool.GetMemPoolChildren(pool.mapTx.find(tx2->GetHash())).empty());
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include <miner.h>
 #include <policy/policy.h>
 #include <pubkey.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -521,4 +522,74 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(block_template_cache, TestChain100Setup)
+{
+    BlockTemplateCache cache(Params());
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    unsigned int nTransactionsUpdated = 0;
+
+    // Nothing is cached until a template is asked for
+    BOOST_CHECK(!cache.Get(chainActive.Tip(), nTransactionsUpdated));
+    cache.Update();
+    std::shared_ptr<const CBlockTemplate> pblocktemplate = cache.Get(chainActive.Tip(), nTransactionsUpdated);
+    BOOST_REQUIRE(pblocktemplate);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    BOOST_CHECK_EQUAL(nTransactionsUpdated, mempool.GetTransactionsUpdated());
+
+    // Until rebuilt, the same template is handed out
+    BOOST_CHECK(cache.Get(chainActive.Tip(), nTransactionsUpdated) == pblocktemplate);
+    cache.SetServed(*pblocktemplate);
+    BOOST_CHECK(!cache.FeesImproved(chainActive.Tip()->GetBlockHash()));
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = m_coinbase_txns[0]->vout[0].nValue - CENT;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr, nullptr, true, 0));
+    }
+    BOOST_CHECK(cache.Get(chainActive.Tip(), nTransactionsUpdated) == pblocktemplate);
+
+    // A rebuild picks up the transaction, and its fee is worth a new template
+    cache.Update();
+    std::shared_ptr<const CBlockTemplate> pblocktemplate2 = cache.Get(chainActive.Tip(), nTransactionsUpdated);
+    BOOST_REQUIRE(pblocktemplate2);
+    BOOST_CHECK(pblocktemplate2 != pblocktemplate);
+    BOOST_CHECK_EQUAL(pblocktemplate2->block.vtx.size(), 2U);
+    BOOST_CHECK(cache.FeesImproved(chainActive.Tip()->GetBlockHash()));
+    cache.SetServed(*pblocktemplate2);
+    BOOST_CHECK(!cache.FeesImproved(chainActive.Tip()->GetBlockHash()));
+
+    // A new tip makes the template useless
+    CreateAndProcessBlock({tx}, scriptPubKey);
+    BOOST_CHECK(pblocktemplate2->block.hashPrevBlock != chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(!cache.Get(chainActive.Tip(), nTransactionsUpdated));
+    BOOST_CHECK(!cache.FeesImproved(chainActive.Tip()->GetBlockHash()));
+
+    // The thread rebuilds it once told about the new tip
+    cache.Start();
+    RegisterValidationInterface(&cache);
+    CreateAndProcessBlock({}, scriptPubKey);
+    SyncWithValidationInterfaceQueue();
+    std::shared_ptr<const CBlockTemplate> pblocktemplate3;
+    for (int i = 0; i < 500 && !pblocktemplate3; i++) {
+        pblocktemplate3 = cache.Get(chainActive.Tip(), nTransactionsUpdated);
+        if (!pblocktemplate3) MilliSleep(10);
+    }
+    BOOST_REQUIRE(pblocktemplate3);
+    BOOST_CHECK(pblocktemplate3->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    UnregisterValidationInterface(&cache);
+    cache.Stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
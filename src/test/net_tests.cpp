@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <addrman.h>
+#include <arith_uint256.h>
 #include <test/test_bagicoin.h>
 #include <string>
 #include <boost/test/unit_test.hpp>
@@ -13,7 +14,9 @@
 #include <chainparams.h>
 #include <util/system.h>
 
+#include <atomic>
 #include <memory>
+#include <thread>
 
 class CAddrManSerializationMock : public CAddrMan
 {
@@ -302,5 +305,315 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_AUTO_TEST_CASE(socket_events_mode)
+{
+    SocketEventsMode mode;
+    BOOST_CHECK(ParseSocketEventsMode(GetSocketEventsModeName(DEFAULT_SOCKETEVENTS), mode));
+    BOOST_CHECK_EQUAL(mode, DEFAULT_SOCKETEVENTS);
+    BOOST_CHECK(ParseSocketEventsMode(GetSocketEventsModeName(SOCKETEVENTS_POLL), mode));
+    BOOST_CHECK_EQUAL(mode, SOCKETEVENTS_POLL);
+#ifdef USE_EPOLL
+    BOOST_CHECK(ParseSocketEventsMode("epoll", mode));
+    BOOST_CHECK_EQUAL(mode, SOCKETEVENTS_EPOLL);
+    BOOST_CHECK_EQUAL(GetSupportedSocketEventsModes(), GetSocketEventsModeName(SOCKETEVENTS_POLL) + ", epoll");
+#else
+    BOOST_CHECK(!ParseSocketEventsMode("epoll", mode));
+#endif
+    BOOST_CHECK(!ParseSocketEventsMode("", mode));
+    BOOST_CHECK(!ParseSocketEventsMode("kqueue", mode));
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(socket_events_epoll)
+{
+    CConnmanTest connman(0x1337, 0x1337);
+    BOOST_REQUIRE(connman.InitSocketEvents(SOCKETEVENTS_EPOLL));
+
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode* pnode = new CNode(0, NODE_NETWORK, 0, fds[0], addr, 0, 0, CAddress(), "", true);
+    BOOST_REQUIRE(connman.RegisterEvents(pnode));
+
+    // A new socket can be written to at once, but has nothing to read
+    std::set<SOCKET> recv_set;
+    connman.SocketEventsEpoll(recv_set, true);
+    BOOST_CHECK(recv_set.empty());
+    BOOST_CHECK(pnode->fCanSendData);
+    BOOST_CHECK(!pnode->fHasRecvData);
+
+    // Data from the other end makes it readable
+    const char data[] = "ping";
+    BOOST_REQUIRE_EQUAL(send(fds[1], data, sizeof(data), MSG_NOSIGNAL), (ssize_t)sizeof(data));
+    connman.SocketEventsEpoll(recv_set, true);
+    BOOST_CHECK(pnode->fHasRecvData);
+
+    // Edge-triggered: once cleared it is only reported again for new data
+    pnode->fHasRecvData = false;
+    pnode->fCanSendData = false;
+    connman.SocketEventsEpoll(recv_set, true);
+    BOOST_CHECK(!pnode->fHasRecvData);
+    BOOST_CHECK(!pnode->fCanSendData);
+    BOOST_REQUIRE_EQUAL(send(fds[1], data, sizeof(data), MSG_NOSIGNAL), (ssize_t)sizeof(data));
+    connman.SocketEventsEpoll(recv_set, true);
+    BOOST_CHECK(pnode->fHasRecvData);
+
+    // Reading it all and hanging up the other end is reported too
+    char buf[64];
+    BOOST_CHECK_EQUAL(recv(fds[0], buf, sizeof(buf), MSG_DONTWAIT), (ssize_t)(2 * sizeof(data)));
+    pnode->fHasRecvData = false;
+    shutdown(fds[1], SHUT_WR);
+    connman.SocketEventsEpoll(recv_set, true);
+    BOOST_CHECK(pnode->fHasRecvData);
+
+    // Disconnecting unregisters the socket, even when another descriptor
+    // keeps it open, so events no longer reach the node
+    const int fdNode = dup(fds[0]);
+    BOOST_REQUIRE(fdNode != -1);
+    pnode->CloseSocketDisconnect(&connman);
+    BOOST_CHECK(pnode->fDisconnect);
+    pnode->fHasRecvData = false;
+    pnode->fCanSendData = false;
+    close(fds[1]);
+    connman.SocketEventsEpoll(recv_set, true);
+    BOOST_CHECK(!pnode->fHasRecvData);
+    BOOST_CHECK(!pnode->fCanSendData);
+    BOOST_CHECK(recv_set.empty());
+
+    close(fdNode);
+    delete pnode;
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(shared_net_msg)
+{
+    CSerializedNetMsg msg;
+    msg.command = "ping";
+    msg.data = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<unsigned char> payload = msg.data;
+    CSharedNetMsg shared(std::move(msg));
+    BOOST_CHECK_EQUAL(shared.command, "ping");
+    BOOST_CHECK(*shared.data == payload);
+
+    CMessageHeader hdr(Params().MessageStart());
+    CDataStream ss(*shared.header, SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK_EQUAL(ss.size(), (size_t)CMessageHeader::HEADER_SIZE);
+    ss >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), "ping");
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    BOOST_CHECK(memcmp(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+
+    // Buffers are shared, not copied, between messages built from them
+    CSharedNetMsg other(NetMsgType::PING, shared.data);
+    BOOST_CHECK(other.data == shared.data);
+    BOOST_CHECK(*other.header == *shared.header);
+}
+
+BOOST_AUTO_TEST_CASE(net_message_buffer_pool)
+{
+    CNetMessageBufferPool pool;
+    CSerializeData buffer = pool.Get(100);
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(buffer.capacity(), 128U);
+    const char* storage = buffer.data();
+    buffer.resize(100);
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+
+    // The buffer is reused, emptied, for any size in its class
+    CSerializeData reused = pool.Get(65);
+    BOOST_CHECK(reused.empty());
+    BOOST_CHECK(reused.data() == storage);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+
+    // A larger class can't be served from it
+    pool.Put(std::move(reused));
+    BOOST_CHECK(pool.Get(129).capacity() >= 256U);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+
+    // Buffers outside the pooled sizes are freed
+    CSerializeData huge;
+    huge.reserve(CNetMessageBufferPool::MAX_BUFFER_SIZE * 2);
+    pool.Put(std::move(huge));
+    pool.Put(CSerializeData());
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.Get(CNetMessageBufferPool::MAX_BUFFER_SIZE * 2).capacity(), CNetMessageBufferPool::MAX_BUFFER_SIZE);
+
+    // Each size class is bounded
+    for (int i = 0; i < 10; i++) {
+        CSerializeData large;
+        large.reserve(CNetMessageBufferPool::MAX_BUFFER_SIZE);
+        pool.Put(std::move(large));
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 1U + CNetMessageBufferPool::MAX_BYTES_PER_CLASS / CNetMessageBufferPool::MAX_BUFFER_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(net_message_pooled_payload)
+{
+    // Feed a header for a payload of nMessageSize and its first nFirst bytes
+    auto receive = [](unsigned int nMessageSize, unsigned int nFirst) {
+        std::unique_ptr<CNetMessage> msg = MakeUnique<CNetMessage>(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+        CMessageHeader hdr(Params().MessageStart(), "block", nMessageSize);
+        CDataStream ssHdr(SER_NETWORK, INIT_PROTO_VERSION);
+        ssHdr << hdr;
+        BOOST_CHECK_EQUAL(msg->readHeader(ssHdr.data(), ssHdr.size()), (int)CMessageHeader::HEADER_SIZE);
+        std::vector<char> payload(nFirst, 'x');
+        BOOST_CHECK_EQUAL(msg->readData(payload.data(), payload.size()), (int)nFirst);
+        return msg;
+    };
+
+    // Small payloads fit the pooled buffer exactly
+    std::unique_ptr<CNetMessage> msg = receive(100, 10);
+    BOOST_CHECK_EQUAL(msg->vRecv.size(), 100U);
+
+    // Large ones fill the largest pooled buffer before anything is reallocated
+    msg = receive(1024 * 1024, 1000);
+    BOOST_CHECK_EQUAL(msg->vRecv.size(), CNetMessageBufferPool::MAX_BUFFER_SIZE);
+    BOOST_CHECK_EQUAL(msg->vRecv.capacity(), CNetMessageBufferPool::MAX_BUFFER_SIZE);
+    std::vector<char> payload(CNetMessageBufferPool::MAX_BUFFER_SIZE, 'x');
+    BOOST_CHECK_EQUAL(msg->readData(payload.data(), payload.size()), (int)payload.size());
+    BOOST_CHECK_EQUAL(msg->vRecv.size(), 1000U + 2 * CNetMessageBufferPool::MAX_BUFFER_SIZE);
+}
+
+static std::vector<uint256> InvHashes(const std::vector<CInv>& vInv)
+{
+    std::vector<uint256> hashes;
+    for (const CInv& inv : vInv) {
+        hashes.push_back(inv.hash);
+    }
+    return hashes;
+}
+
+BOOST_AUTO_TEST_CASE(getaddr_cache_per_network)
+{
+    CConnman connman(0x1337, 0x1337);
+    std::vector<CAddress> vAddr;
+    for (int i = 1; i <= 50; i++) {
+        CService serv;
+        BOOST_CHECK(Lookup(strprintf("250.7.%d.%d", i, i).c_str(), serv, 8333, false));
+        CAddress addr(serv, NODE_NETWORK);
+        addr.nTime = GetAdjustedTime();
+        vAddr.push_back(addr);
+    }
+    CService source;
+    BOOST_CHECK(Lookup("252.5.1.1", source, 8333, false));
+    connman.AddNewAddresses(vAddr, CAddress(source, NODE_NONE));
+
+    CService ipv4Peer, ipv4Peer2, onionPeer, bindClear, bindOnion;
+    BOOST_CHECK(Lookup("1.2.3.4", ipv4Peer, 8333, false));
+    BOOST_CHECK(Lookup("5.6.7.8", ipv4Peer2, 8333, false));
+    BOOST_CHECK(Lookup("FD87:D87E:EB43:edb1:8e4:3588:e546:35ca", onionPeer, 8333, false));
+    BOOST_CHECK(Lookup("9.9.9.9", bindClear, 8333, false));
+    BOOST_CHECK(Lookup("127.0.0.1", bindOnion, 8334, false));
+    NodeId id = 0;
+    auto makeNode = [&id](const CService& addr, const CService& bind) {
+        return MakeUnique<CNode>(id++, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(addr, NODE_NONE), 0, 0, CAddress(bind, NODE_NONE), "", /*fInboundIn=*/ true);
+    };
+
+    // Peers arriving the same way share one answer
+    auto pnodeClear = makeNode(ipv4Peer, bindClear);
+    auto pnodeClear2 = makeNode(ipv4Peer2, bindClear);
+    auto pAddrs = connman.GetAddressesCached(*pnodeClear);
+    BOOST_CHECK(!pAddrs->empty());
+    BOOST_CHECK(connman.GetAddressesCached(*pnodeClear2) == pAddrs);
+
+    // Another network, or another local address such as a Tor listener, gets its own
+    auto pnodeOnion = makeNode(onionPeer, bindClear);
+    auto pnodeTor = makeNode(ipv4Peer, bindOnion);
+    auto pAddrsOnion = connman.GetAddressesCached(*pnodeOnion);
+    auto pAddrsTor = connman.GetAddressesCached(*pnodeTor);
+    BOOST_CHECK(pAddrsOnion != pAddrs);
+    BOOST_CHECK(pAddrsTor != pAddrs);
+    BOOST_CHECK(pAddrsTor != pAddrsOnion);
+    BOOST_CHECK(connman.GetAddressesCached(*pnodeTor) == pAddrsTor);
+
+    // All are refreshed once they expire
+    SetMockTime(GetTime() + ADDR_RESPONSE_CACHE_INTERVAL);
+    BOOST_CHECK(connman.GetAddressesCached(*pnodeClear) != pAddrs);
+    BOOST_CHECK(connman.GetAddressesCached(*pnodeTor) != pAddrsTor);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(inv_relay_log)
+{
+    CInvRelayLog log(2);
+    const int64_t nTime = 1000000;
+    const CInv inv1(MSG_TX, InsecureRand256());
+    const CInv inv2(MSG_MASTERNODE_PING, InsecureRand256());
+    const CInv inv3(MSG_GOVERNANCE_OBJECT, InsecureRand256());
+
+    // A peer starting at the end only sees later items
+    log.Append(inv1, PROTOCOL_VERSION, nTime);
+    uint64_t nCursor = log.GetEnd();
+    BOOST_CHECK_EQUAL(nCursor, 1U);
+    log.Append(inv2, PROTOCOL_VERSION, nTime);
+    log.Append(inv3, PROTOCOL_VERSION + 1, nTime);
+
+    std::vector<CInv> vInv;
+    BOOST_CHECK_EQUAL(log.Read(nCursor, PROTOCOL_VERSION, vInv), 0U);
+    BOOST_CHECK(InvHashes(vInv) == std::vector<uint256>{inv2.hash});
+    BOOST_CHECK_EQUAL(nCursor, 3U);
+
+    // Reading again yields nothing new, other cursors are independent
+    vInv.clear();
+    BOOST_CHECK_EQUAL(log.Read(nCursor, PROTOCOL_VERSION, vInv), 0U);
+    BOOST_CHECK(vInv.empty());
+    uint64_t nOtherCursor = 0;
+    BOOST_CHECK_EQUAL(log.Read(nOtherCursor, PROTOCOL_VERSION + 1, vInv), 0U);
+    BOOST_CHECK((InvHashes(vInv) == std::vector<uint256>{inv1.hash, inv2.hash, inv3.hash}));
+
+    // Old items expire a segment at a time, and peers that didn't read them are told
+    log.Append(inv1, PROTOCOL_VERSION, nTime + CInvRelayLog::MAX_AGE + 1);
+    BOOST_CHECK_EQUAL(log.size(), 2U);
+    BOOST_CHECK_EQUAL(log.GetEnd(), 4U);
+    uint64_t nLateCursor = 1;
+    vInv.clear();
+    BOOST_CHECK_EQUAL(log.Read(nLateCursor, PROTOCOL_VERSION, vInv), 1U);
+    BOOST_CHECK(InvHashes(vInv) == std::vector<uint256>{inv1.hash});
+    BOOST_CHECK_EQUAL(nLateCursor, 4U);
+}
+
+BOOST_AUTO_TEST_CASE(inv_relay_log_concurrent_read)
+{
+    static const int READERS = 4;
+    static const uint64_t ITEMS = 20000;
+
+    CInvRelayLog log(64);
+    std::vector<uint256> vHashes;
+    for (uint64_t i = 0; i < ITEMS; i++) {
+        vHashes.push_back(ArithToUint256(arith_uint256(i)));
+    }
+
+    // Readers scan while the writer appends, and must see every item once, in order
+    std::atomic<int> nFailures{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; r++) {
+        readers.emplace_back([&] {
+            uint64_t nCursor = 0;
+            uint64_t nRead = 0;
+            while (nRead < ITEMS) {
+                if (log.Read(nCursor, PROTOCOL_VERSION, [&](const CInv& inv) {
+                        if (inv.hash != vHashes[nRead++]) nFailures++;
+                    }) != 0) {
+                    nFailures++;
+                    return;
+                }
+            }
+            if (nCursor != ITEMS) nFailures++;
+        });
+    }
+    for (uint64_t i = 0; i < ITEMS; i++) {
+        log.Append(CInv(MSG_TX, vHashes[i]), PROTOCOL_VERSION, 1000000);
+    }
+    for (auto& thread : readers) thread.join();
+
+    BOOST_CHECK_EQUAL(nFailures, 0);
+    BOOST_CHECK_EQUAL(log.GetEnd(), ITEMS);
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
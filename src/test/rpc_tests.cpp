@@ -4,6 +4,7 @@
 
 #include <rpc/server.h>
 #include <rpc/client.h>
+#include <rpc/jsonstream.h>
 #include <rpc/util.h>
 
 #include <core_io.h>
@@ -11,6 +12,8 @@
 #include <interfaces/chain.h>
 #include <key_io.h>
 #include <netbase.h>
+#include <txmempool.h>
+#include <validation.h>
 
 #include <test/test_bagicoin.h>
 
@@ -21,6 +24,10 @@
 
 #include <rpc/blockchain.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 UniValue CallRPC(std::string args)
 {
     std::vector<std::string> vArgs;
@@ -420,4 +427,118 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_stream)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("size", 225);
+    entry.pushKV("depends", UniValue(UniValue::VARR));
+    entry.pushKV("note", "\"quoted\"");
+
+    UniValue expected(UniValue::VOBJ);
+    std::string strStreamed;
+    JSONStreamWriter stream([&strStreamed](const std::string& chunk) { strStreamed += chunk; });
+    JSONObjectResult streamed(&stream), built(nullptr);
+    for (int i = 0; i < 2000; i++) {
+        expected.pushKV(strprintf("key%d", i), entry);
+        streamed.pushKV(strprintf("key%d", i), entry);
+        built.pushKV(strprintf("key%d", i), entry);
+    }
+    BOOST_CHECK(streamed.Finish().isNull());
+    BOOST_CHECK_EQUAL(built.Finish().write(), expected.write());
+    // Nothing reaches the sink before a chunk fills up or the writer is flushed
+    BOOST_CHECK(stream.IsUsed());
+    BOOST_CHECK(strStreamed.size() >= JSONStreamWriter::CHUNK_SIZE);
+    stream.Flush();
+    BOOST_CHECK_EQUAL(strStreamed, expected.write());
+
+    // Nested arrays and objects
+    std::string strNested;
+    JSONStreamWriter nested([&strNested](const std::string& chunk) { strNested += chunk; });
+    BOOST_CHECK(!nested.IsUsed());
+    nested.BeginObject();
+    nested.Key("tx");
+    nested.BeginArray();
+    nested.Value(entry);
+    nested.BeginArray();
+    nested.EndArray();
+    nested.EndArray();
+    nested.Key("height");
+    nested.Value(5);
+    nested.EndObject();
+    nested.Flush();
+    BOOST_CHECK_EQUAL(strNested, "{\"tx\":[" + entry.write() + ",[]],\"height\":5}");
+}
+
+BOOST_FIXTURE_TEST_CASE(rpc_json_stream_slow_reader, TestChain100Setup)
+{
+    // The entries are not spendable, keep the checks from looking at them
+    mempool.setSanityCheck(0);
+    {
+        LOCK2(cs_main, mempool.cs);
+        TestMemPoolEntryHelper entry;
+        for (int i = 0; i < 500; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = i + 1;
+            mempool.addUnchecked(entry.FromTx(tx));
+        }
+    }
+
+    // A client that stops reading after the first chunk
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool fStalled = false, fResume = false;
+    std::string strStreamed;
+    JSONStreamWriter stream([&](const std::string& chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStalled = true;
+        cond.notify_all();
+        cond.wait(lock, [&] { return fResume; });
+        strStreamed += chunk;
+    });
+    std::thread reader([&] {
+        mempoolToJSON(true, &stream);
+        stream.Flush();
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return fStalled; });
+    }
+
+    // Validation goes on while the client is stalled
+    bool fMainFree, fMempoolFree;
+    {
+        TRY_LOCK(cs_main, lockMain);
+        fMainFree = lockMain;
+    }
+    {
+        TRY_LOCK(mempool.cs, lockMempool);
+        fMempoolFree = lockMempool;
+    }
+    if (fMainFree && fMempoolFree) {
+        CreateAndProcessBlock({}, CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fResume = true;
+        cond.notify_all();
+    }
+    reader.join();
+
+    BOOST_CHECK(fMainFree);
+    BOOST_CHECK(fMempoolFree);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 101);
+    }
+    UniValue result;
+    BOOST_CHECK(result.read(strStreamed));
+    BOOST_CHECK_EQUAL(result.size(), 500U);
+
+    mempool.clear();
+    mempool.setSanityCheck(1.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -113,6 +113,31 @@ BOOST_AUTO_TEST_CASE(streams_vector_reader)
     BOOST_CHECK_THROW(new_reader >> d, std::ios_base::failure);
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+
+    SpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, Span<const unsigned char>(vch.data() + 1, vch.size() - 1));
+    BOOST_CHECK_EQUAL(reader.size(), 5);
+    BOOST_CHECK(!reader.empty());
+
+    // Read a single byte as a signed char.
+    signed char b;
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, -1);
+    BOOST_CHECK_EQUAL(reader.size(), 4);
+
+    // Read a 4 bytes as an unsigned int.
+    unsigned int c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 100992003); // 3,4,5,6 in little-endian base-256
+    BOOST_CHECK(reader.empty());
+
+    // Reading after end of the span throws an error.
+    unsigned char d;
+    BOOST_CHECK_THROW(reader >> d, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
 {
     CDataStream data(SER_NETWORK, INIT_PROTO_VERSION);
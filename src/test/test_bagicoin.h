@@ -8,6 +8,7 @@
 #include <chainparamsbase.h>
 #include <fs.h>
 #include <key.h>
+#include <net.h>
 #include <pubkey.h>
 #include <random.h>
 #include <scheduler.h>
@@ -83,6 +84,30 @@ struct TestingSetup : public BasicTestingSetup {
     ~TestingSetup();
 };
 
+struct CConnmanTest : public CConnman {
+    using CConnman::CConnman;
+    using CConnman::RegisterEvents;
+    using CConnman::SocketEventsEpoll;
+    void AddNode(CNode& node)
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(&node);
+    }
+    void ClearNodes()
+    {
+        LOCK(cs_vNodes);
+        for (CNode* node : vNodes) {
+            delete node;
+        }
+        vNodes.clear();
+    }
+    bool InitSocketEvents(SocketEventsMode mode)
+    {
+        socketEventsMode = mode;
+        return CConnman::InitSocketEvents();
+    }
+};
+
 class CBlock;
 struct CMutableTransaction;
 class CScript;
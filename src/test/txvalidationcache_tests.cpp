@@ -2,10 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <key.h>
 #include <validation.h>
 #include <miner.h>
+#include <pow.h>
 #include <pubkey.h>
 #include <txmempool.h>
 #include <random.h>
@@ -16,6 +18,9 @@
 #include <core_io.h>
 #include <keystore.h>
 #include <policy/policy.h>
+#include <checkqueue.h>
+#include <streams.h>
+#include <clientversion.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -33,6 +38,32 @@ ToMemPool(const CMutableTransaction& tx)
                               nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
 }
 
+/** A block template on the tip holding just txns, unlike CreateAndProcessBlock with a witness commitment that matches them */
+static CBlock TemplateWith(const std::vector<CMutableTransaction>& txns, const CScript& scriptPubKey)
+{
+    const CChainParams& chainparams = Params();
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    CBlock& block = pblocktemplate->block;
+    block.vtx.resize(1);
+    for (const CMutableTransaction& tx : txns) {
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    // Replace the witness commitment of the template's empty block
+    CMutableTransaction coinbase(*block.vtx[0]);
+    coinbase.vout.erase(std::remove_if(coinbase.vout.begin(), coinbase.vout.end(), [](const CTxOut& out) {
+        const CScript& script = out.scriptPubKey;
+        return script.size() >= 38 && script[0] == OP_RETURN && script[1] == 0x24 && script[2] == 0xaa && script[3] == 0x21 && script[4] == 0xa9 && script[5] == 0xed;
+    }), coinbase.vout.end());
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+
+    LOCK(cs_main);
+    GenerateCoinbaseCommitment(block, chainActive.Tip(), chainparams.GetConsensus());
+    unsigned int extraNonce = 0;
+    IncrementExtraNonce(&block, chainActive.Tip(), extraNonce);
+    return block;
+}
+
 BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
 {
     // Make sure skipping validation of transactions that were
@@ -91,6 +122,49 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0U);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_uncached_invalid_script_template, TestChain100Setup)
+{
+    // Make sure TestBlockValidity() still runs the scripts of transactions
+    // that aren't in the script execution cache, even though it skips the
+    // checks it has done itself already.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = m_coinbase_txns[0]->GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    // Sign:
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CMutableTransaction badSpend = spend;
+    badSpend.vout[0].nValue = 12*CENT; // no longer matches the signature
+
+    const CChainParams& chainparams = Params();
+    auto test_template = [&](const CMutableTransaction& tx, CValidationState& state) {
+        CBlock block = TemplateWith({tx}, scriptPubKey);
+        LOCK(cs_main);
+        return TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, true);
+    };
+
+    CValidationState state;
+    BOOST_CHECK(test_template(spend, state));
+    // Fails in the script checks, reported by ConnectBlock() itself or by the
+    // script check threads depending on how many there are
+    BOOST_CHECK(!test_template(badSpend, state));
+    BOOST_CHECK(state.IsInvalid());
+    BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0 || state.GetRejectReason() == "block-validation-failed");
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
@@ -367,4 +441,159 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+/** A spend of prevout, locked to prevScript and signed with key, into nOutputs equal outputs to scriptPubKey */
+static CMutableTransaction SignedSpend(const COutPoint& prevout, const CScript& prevScript, CAmount nValue, int nOutputs, const CKey& key, const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.nValue = (nValue - 10000) / nOutputs;
+        out.scriptPubKey = scriptPubKey;
+    }
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(prevScript, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+/** Write vtx to mempool.dat in the given order, the way DumpMempool does */
+static void WriteMempoolFile(const std::vector<CTransactionRef>& vtx)
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "wb");
+    BOOST_REQUIRE(filestr);
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    file << (uint64_t)1; // MEMPOOL_DUMP_VERSION
+    file << (uint64_t)vtx.size();
+    for (const CTransactionRef& tx : vtx) {
+        file << *tx;
+        file << (int64_t)GetTime();
+        file << (int64_t)0;
+    }
+    file << std::map<uint256, CAmount>();
+}
+
+static std::set<uint256> MempoolTxids()
+{
+    std::vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+    return std::set<uint256>(vtxid.begin(), vtxid.end());
+}
+
+/** Whether every transaction of vtx in setTxids passes the full script checks AcceptToMemoryPool caches, without running them */
+static bool InScriptExecutionCache(const std::vector<CTransactionRef>& vtx, const std::set<uint256>& setTxids)
+{
+    LOCK2(cs_main, mempool.cs);
+    // The flags GetBlockScriptFlags gives for the tip, which the mempool caches full checks under
+    const Consensus::Params& params = Params().GetConsensus();
+    const CBlockIndex* tip = chainActive.Tip();
+    unsigned int flags = SCRIPT_VERIFY_P2SH;
+    if (params.SegwitHeight != std::numeric_limits<int>::max()) flags |= SCRIPT_VERIFY_WITNESS;
+    if (tip->nHeight >= params.BIP66Height) flags |= SCRIPT_VERIFY_DERSIG;
+    if (tip->nHeight >= params.BIP65Height) flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    if (tip->nHeight >= params.CSVHeight) flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    if (IsWitnessEnabled(tip->pprev, params)) flags |= SCRIPT_VERIFY_NULLDUMMY;
+
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+    CCoinsViewCache view(&viewMemPool);
+    for (const CTransactionRef& tx : vtx) {
+        if (!setTxids.count(tx->GetHash())) continue;
+        CValidationState state;
+        PrecomputedTransactionData txdata(*tx);
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(*tx, state, view, true, flags, true, true, txdata, &vChecks) || !vChecks.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BOOST_FIXTURE_TEST_CASE(batched_readmission, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    // A parent with five outputs and a spend of each, the middle one signed
+    // with the wrong key, then a child of that one and of a good one
+    CMutableTransaction parent = SignedSpend(COutPoint(m_coinbase_txns[0]->GetHash(), 0), scriptPubKey, m_coinbase_txns[0]->vout[0].nValue, 5, coinbaseKey, scriptPubKey);
+    std::vector<CTransactionRef> vtx{MakeTransactionRef(parent)};
+    for (int i = 0; i < 5; i++) {
+        vtx.push_back(MakeTransactionRef(SignedSpend(COutPoint(parent.GetHash(), i), scriptPubKey, parent.vout[i].nValue, 1, i == 2 ? otherKey : coinbaseKey, scriptPubKey)));
+    }
+    const CTransactionRef txBad = vtx[3];
+    const CTransactionRef txBadChild = MakeTransactionRef(SignedSpend(COutPoint(txBad->GetHash(), 0), scriptPubKey, txBad->vout[0].nValue, 1, coinbaseKey, scriptPubKey));
+    vtx.insert(vtx.begin() + 4, txBadChild);
+    vtx.push_back(MakeTransactionRef(SignedSpend(COutPoint(vtx[1]->GetHash(), 0), scriptPubKey, vtx[1]->vout[0].nValue, 1, coinbaseKey, scriptPubKey)));
+
+    std::set<uint256> setExpected;
+    for (const CTransactionRef& tx : vtx) {
+        if (tx != txBad && tx != txBadChild) setExpected.insert(tx->GetHash());
+    }
+    BOOST_REQUIRE(nScriptCheckThreads > 0);
+    const int nScriptCheckThreadsSaved = nScriptCheckThreads;
+
+    // Loading mempool.dat with the script check threads: the inputs are all
+    // checked ahead, and when the batch fails the halves are run again, so
+    // the good transactions after the bad one are checked ahead too
+    WriteMempoolFile(vtx);
+    CCheckQueueStats stats = GetScriptCheckQueueStats();
+    BOOST_CHECK(LoadMempool());
+    const std::set<uint256> setBatched = MempoolTxids();
+    BOOST_CHECK(setBatched == setExpected);
+    BOOST_CHECK_GT(GetScriptCheckQueueStats().nBlocks, stats.nBlocks + 1);
+    BOOST_CHECK_GT(GetScriptCheckQueueStats().nChecks, stats.nChecks + vtx.size());
+    BOOST_CHECK(InScriptExecutionCache(vtx, setBatched));
+
+    // Without them, one at a time as before, the same transactions get in
+    mempool.clear();
+    nScriptCheckThreads = 0;
+    stats = GetScriptCheckQueueStats();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(MempoolTxids() == setBatched);
+    BOOST_CHECK_EQUAL(GetScriptCheckQueueStats().nChecks, stats.nChecks);
+    nScriptCheckThreads = nScriptCheckThreadsSaved;
+
+    // Mine the good ones, then disconnect the block, with and without the
+    // script check threads
+    mempool.clear();
+    std::vector<CMutableTransaction> vMine;
+    for (const CTransactionRef& tx : vtx) {
+        if (setExpected.count(tx->GetHash())) vMine.emplace_back(*tx);
+    }
+    const CChainParams& chainparams = Params();
+    CBlock block = TemplateWith(vMine, scriptPubKey);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+    BOOST_CHECK(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, nullptr));
+    CBlockIndex* pindex = LookupBlockIndexNoCsMain(block.GetHash());
+    BOOST_REQUIRE(pindex);
+    for (int nThreads : {nScriptCheckThreadsSaved, 0}) {
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(chainActive.Tip() == pindex);
+        }
+        BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+        nScriptCheckThreads = nThreads;
+        stats = GetScriptCheckQueueStats();
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainparams, pindex));
+        BOOST_CHECK(MempoolTxids() == setBatched);
+        BOOST_CHECK_EQUAL(GetScriptCheckQueueStats().nChecks > stats.nChecks, nThreads > 0);
+        nScriptCheckThreads = nScriptCheckThreadsSaved;
+
+        {
+            LOCK(cs_main);
+            ResetBlockFailureFlags(pindex);
+        }
+        BOOST_CHECK(ActivateBestChain(state, chainparams));
+    }
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -184,4 +184,135 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+BOOST_AUTO_TEST_CASE(hash_block_headers)
+{
+    // Enough headers to be spread over several threads, and a count that doesn't divide evenly
+    std::vector<CBlockHeader> headers(2001);
+    for (CBlockHeader& header : headers) {
+        header.nVersion = InsecureRand32();
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = InsecureRand32();
+        header.nBits = InsecureRand32();
+        header.nNonce = InsecureRand32();
+    }
+    std::vector<uint256> hashes;
+    HashBlockHeaders(headers, hashes);
+    BOOST_REQUIRE_EQUAL(hashes.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+    }
+
+    // Several message handlers hashing at once share the same workers
+    std::vector<std::vector<uint256>> vHashes(4);
+    std::vector<std::thread> threads;
+    for (std::vector<uint256>& hashesThread : vHashes) {
+        threads.emplace_back([&headers, &hashesThread] { HashBlockHeaders(headers, hashesThread); });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    for (const std::vector<uint256>& hashesThread : vHashes) {
+        BOOST_CHECK(hashesThread == hashes);
+    }
+
+    HashBlockHeaders(std::vector<CBlockHeader>(), hashes);
+    BOOST_CHECK(hashes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(published_chain_tip)
+{
+    const CChainParams& chainparams = Params();
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(GetPublishedChainTip() == chainActive.Tip());
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    // Each block connected by ActivateBestChain is published
+    for (int i = 0; i < 3; i++) {
+        std::shared_ptr<const CBlock> pblock = GoodBlock(hashTip);
+        BOOST_CHECK(ProcessNewBlock(chainparams, pblock, true, nullptr));
+        hashTip = pblock->GetHash();
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), hashTip);
+        BOOST_CHECK(GetPublishedChainTip() == chainActive.Tip());
+    }
+
+    // Invalidating the tip publishes its parent
+    CBlockIndex* pindexInvalid = LookupBlockIndexNoCsMain(hashTip);
+    BOOST_REQUIRE(pindexInvalid);
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, chainparams, pindexInvalid));
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip() == pindexInvalid->pprev);
+        BOOST_CHECK(GetPublishedChainTip() == chainActive.Tip());
+        ResetBlockFailureFlags(pindexInvalid);
+    }
+
+    // And reconsidering it publishes it again
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip() == pindexInvalid);
+    BOOST_CHECK(GetPublishedChainTip() == pindexInvalid);
+}
+
+BOOST_AUTO_TEST_CASE(lookup_block_index_no_cs_main)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<CBlockHeader> headers;
+    std::vector<uint256> hashes;
+    {
+        LOCK(cs_main);
+        hashes.push_back(chainActive.Tip()->GetBlockHash());
+    }
+    for (int i = 0; i < 50; i++) {
+        headers.push_back(GoodBlock(hashes.back())->GetBlockHeader());
+        hashes.push_back(headers.back().GetHash());
+    }
+    hashes.erase(hashes.begin());
+    BOOST_CHECK(LookupBlockIndexNoCsMain(hashes.front()) == nullptr);
+
+    // While the headers are added, whatever a lookup finds must already be
+    // linked into the index; checked off the main thread, counted here
+    std::atomic<bool> fDone{false};
+    std::atomic<int> nIncomplete{0};
+    std::atomic<int> nFound{0};
+    std::thread reader([&] {
+        std::vector<bool> vSeen(hashes.size());
+        while (true) {
+            // One more pass once the headers are all in, so none is missed
+            const bool fLast = fDone;
+            for (size_t i = 0; i < hashes.size(); i++) {
+                const CBlockIndex* pindex = LookupBlockIndexNoCsMain(hashes[i]);
+                if (!pindex) continue;
+                if (!pindex->phashBlock || *pindex->phashBlock != hashes[i] || !pindex->pprev ||
+                    pindex->nHeight != pindex->pprev->nHeight + 1 || pindex->nChainWork <= pindex->pprev->nChainWork) {
+                    nIncomplete++;
+                }
+                if (!vSeen[i]) {
+                    vSeen[i] = true;
+                    nFound++;
+                }
+            }
+            if (fLast) break;
+        }
+    });
+
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, chainparams));
+    fDone = true;
+    reader.join();
+
+    BOOST_CHECK_EQUAL(nIncomplete, 0);
+    BOOST_CHECK_EQUAL(nFound, (int)hashes.size());
+    for (const uint256& hash : hashes) {
+        const CBlockIndex* pindex = LookupBlockIndexNoCsMain(hash);
+        BOOST_CHECK(pindex && pindex->GetBlockHash() == hash);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <workqueue.h>
+
+#include <test/test_bagicoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(workqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(lockfreequeue_mpmc)
+{
+    static const int PRODUCERS = 4;
+    static const int CONSUMERS = 4;
+    static const uint64_t ITEMS = 50000;
+
+    LockFreeQueue<uint64_t> queue(4);
+    std::atomic<uint64_t> popped{0};
+    std::atomic<uint64_t> sum{0};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&] {
+            for (uint64_t i = 1; i <= ITEMS; i++) {
+                uint64_t item = i;
+                while (!queue.TryPush(item)) std::this_thread::yield();
+            }
+        });
+    }
+    for (int c = 0; c < CONSUMERS; c++) {
+        threads.emplace_back([&] {
+            uint64_t item;
+            while (popped < PRODUCERS * ITEMS) {
+                if (queue.TryPop(item)) {
+                    sum += item;
+                    popped++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    uint64_t item;
+    BOOST_CHECK(!queue.TryPop(item));
+    BOOST_CHECK_EQUAL(popped, PRODUCERS * ITEMS);
+    BOOST_CHECK_EQUAL(sum, PRODUCERS * ITEMS * (ITEMS + 1) / 2);
+}
+
+struct CountingItem
+{
+    std::atomic<uint64_t>& nRun;
+    explicit CountingItem(std::atomic<uint64_t>& n) : nRun(n) {}
+    void operator()() { nRun++; }
+};
+
+// More producers and workers than the queue has room for, so that
+// Enqueue keeps running into a full queue and workers still moving items out
+BOOST_AUTO_TEST_CASE(workqueue_full_queue_stress)
+{
+    static const int PRODUCERS = 8;
+    static const int WORKERS = 8;
+    static const uint64_t ITEMS = 20000;
+
+    WorkQueue<CountingItem> queue(2);
+    std::atomic<uint64_t> nRun{0};
+    std::atomic<uint64_t> nAccepted{0};
+    std::atomic<uint64_t> nRejected{0};
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < WORKERS; w++) {
+        workers.emplace_back([&] { queue.Run(); });
+    }
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&] {
+            for (uint64_t i = 0; i < ITEMS; i++) {
+                CountingItem* item = new CountingItem(nRun);
+                if (queue.Enqueue(item)) {
+                    nAccepted++;
+                } else {
+                    delete item; // still ours
+                    nRejected++;
+                }
+            }
+        });
+    }
+    for (auto& thread : producers) thread.join();
+
+    // Wait for the workers to drain the queue
+    for (int i = 0; i < 1000 && nRun < nAccepted; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    queue.Interrupt();
+    for (auto& thread : workers) thread.join();
+
+    BOOST_CHECK_EQUAL(nAccepted + nRejected, PRODUCERS * ITEMS);
+    BOOST_CHECK_EQUAL(nRun, nAccepted);
+    BOOST_CHECK_EQUAL(queue.Rejected(), nRejected);
+    BOOST_CHECK_EQUAL(queue.Depth(), 0U);
+    BOOST_CHECK(nAccepted > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include <txdb.h>
 
 #include <chainparams.h>
+#include <checkqueue.h>
 #include <hash.h>
 #include <random.h>
 #include <pow.h>
@@ -29,6 +30,11 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
+/** Number of block index records read from the database per batch while loading */
+static const size_t BLOCK_INDEX_LOAD_BATCH = 16384;
+/** Maximum number of threads hashing block index records while loading */
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
+
 namespace {
 
 struct CoinEntry {
@@ -246,43 +252,126 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+size_t CBlockTreeDB::EstimateBlockIndexEntries() const
+{
+    // Each record takes a little over 100 bytes on disk, so this errs on the high side
+    return EstimateSize(std::make_pair(DB_BLOCK_INDEX, uint256()), std::make_pair(char(DB_BLOCK_INDEX + 1), uint256())) / 100;
+}
+
+namespace {
+
+/** Hashes the headers of a range of index records, as a job on a CCheckQueue. */
+class CBlockIndexHashCheck
+{
+private:
+    const CDiskBlockIndex* m_begin{nullptr};
+    const CDiskBlockIndex* m_end{nullptr};
+    uint256* m_hashes{nullptr};
+
+public:
+    CBlockIndexHashCheck() {}
+    CBlockIndexHashCheck(const CDiskBlockIndex* begin, const CDiskBlockIndex* end, uint256* hashes) :
+        m_begin(begin), m_end(end), m_hashes(hashes) {}
+
+    bool operator()()
+    {
+        for (const CDiskBlockIndex* p = m_begin; p != m_end; ++p) {
+            m_hashes[p - m_begin] = p->GetBlockHash();
+        }
+        return true;
+    }
+
+    void swap(CBlockIndexHashCheck& check)
+    {
+        std::swap(m_begin, check.m_begin);
+        std::swap(m_end, check.m_end);
+        std::swap(m_hashes, check.m_hashes);
+    }
+};
+
+} // namespace
+
+/** Compute the block hashes of a batch of index records, spread over the workers of queue if there is one. */
+static void HashBlockIndexBatch(const std::vector<CDiskBlockIndex>& batch, std::vector<uint256>& hashes, CCheckQueue<CBlockIndexHashCheck>* queue, int nThreads)
+{
+    hashes.resize(batch.size());
+    if (!queue) {
+        CBlockIndexHashCheck(batch.data(), batch.data() + batch.size(), hashes.data())();
+        return;
+    }
+    CCheckQueueControl<CBlockIndexHashCheck> control(queue);
+    std::vector<CBlockIndexHashCheck> vChecks;
+    for (int i = 0; i < nThreads; i++) {
+        size_t nBegin = batch.size() * i / nThreads, nEnd = batch.size() * (i + 1) / nThreads;
+        vChecks.emplace_back(batch.data() + nBegin, batch.data() + nEnd, hashes.data() + nBegin);
+    }
+    control.Add(vChecks);
+    control.Wait();
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
+    // Hashing is spread over workers that live as long as the load, rather
+    // than over threads started anew for each batch
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    CCheckQueue<CBlockIndexHashCheck> hashqueue(1);
+    struct WorkerThreads {
+        boost::thread_group group;
+        ~WorkerThreads() { group.interrupt_all(); group.join_all(); }
+    } workers;
+    for (int i = 1; i < nThreads; i++) {
+        workers.group.create_thread([&hashqueue] { hashqueue.Thread(); });
+    }
+
+    std::vector<CDiskBlockIndex> batch;
+    std::vector<uint256> hashes;
+    batch.reserve(BLOCK_INDEX_LOAD_BATCH);
+
     // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
+    bool fDone = false;
+    while (!fDone) {
+        // The cursor can only be walked sequentially, so read a batch of
+        // records first and then hash their headers in parallel, which is
+        // where most of the time goes.
+        batch.clear();
+        while (batch.size() < BLOCK_INDEX_LOAD_BATCH) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                fDone = true;
+                break;
+            }
+            batch.emplace_back();
+            if (!pcursor->GetValue(batch.back())) {
                 return error("%s: failed to read value", __func__);
             }
-        } else {
-            break;
+            pcursor->Next();
+        }
+        HashBlockIndexBatch(batch, hashes, nThreads > 1 ? &hashqueue : nullptr, nThreads);
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            const CDiskBlockIndex& diskindex = batch[i];
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(hashes[i]);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
+                return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
         }
     }
 
@@ -96,6 +96,8 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Rough upper estimate of the number of block index records, for sizing the in-memory index */
+    size_t EstimateBlockIndexEntries() const;
 };
 
 #endif // BITCOIN_TXDB_H
@@ -18,6 +18,7 @@
 #include <crypto/siphash.h>
 #include <indirectmap.h>
 #include <policy/feerate.h>
+#include <prevector.h>
 #include <primitives/transaction.h>
 #include <sync.h>
 #include <random.h>
@@ -65,6 +66,11 @@ class CTxMemPool;
 
 class CTxMemPoolEntry
 {
+public:
+    /** In-mempool direct parents or children, sorted by txid. Most transactions
+     *  have only a couple of them, which are stored inline. */
+    typedef prevector<2, const CTxMemPoolEntry*> Links;
+
 private:
     const CTransactionRef tx;
     const CAmount nFee;             //!< Cached to avoid expensive parent-transaction lookups
@@ -90,6 +96,11 @@ private:
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    // Maintained by CTxMemPool; they are not part of any index of mapTx, so
+    // they can be updated in place
+    mutable Links m_parents;
+    mutable Links m_children;
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
@@ -129,6 +140,11 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
+    const Links& GetMemPoolParentsConst() const { return m_parents; }
+    const Links& GetMemPoolChildrenConst() const { return m_children; }
+    Links& GetMemPoolParents() const { return m_parents; }
+    Links& GetMemPoolChildren() const { return m_children; }
+
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
 };
 
@@ -394,7 +410,7 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the set of in-mempool direct parents and direct children in each entry.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -427,7 +443,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -534,20 +550,19 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-    const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    const CTxMemPoolEntry::Links & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    const CTxMemPoolEntry::Links & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    struct CompareEntryByHash {
+        bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
-
+    void UpdateLinks(CTxMemPoolEntry::Links& links, const CTxMemPoolEntry& link, bool add);
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -640,7 +655,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from their links. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -8,6 +8,8 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockcache.h>
+#include <blockfilemap.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -156,6 +158,9 @@ private:
      */
     CCriticalSection m_cs_chainstate;
 
+    /** Owns every CBlockIndex referenced by mapBlockIndex */
+    CBlockIndexArena m_block_index_arena GUARDED_BY(cs_main);
+
 public:
     CChain chainActive;
     BlockMap mapBlockIndex GUARDED_BY(cs_main);
@@ -170,7 +175,7 @@ public:
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to mapBlockIndex.
      */
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const uint256* pHash = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
@@ -198,7 +203,7 @@ private:
     bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-    CBlockIndex* AddToBlockIndex(const CBlockHeader& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256* pHash = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
     CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /**
@@ -232,6 +237,10 @@ RecursiveMutex cs_main;
 
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
 CChain& chainActive = g_chainstate.chainActive;
+/** Held while mapBlockIndex changes (besides cs_main), and by LookupBlockIndexNoCsMain */
+static Mutex g_block_index_map_mutex;
+//! chainActive.Tip() as of its last change, see GetPublishedChainTip()
+static std::atomic<const CBlockIndex*> g_published_tip{nullptr};
 CBlockIndex *pindexBestHeader = nullptr;
 Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
@@ -291,6 +300,18 @@ namespace {
     std::set<int> setDirtyFileInfo;
 } // anon namespace
 
+CBlockIndex* LookupBlockIndexNoCsMain(const uint256& hash)
+{
+    LOCK(g_block_index_map_mutex);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it == mapBlockIndex.end() ? nullptr : it->second;
+}
+
+const CBlockIndex* GetPublishedChainTip()
+{
+    return g_published_tip;
+}
+
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
 {
     AssertLockHeld(cs_main);
@@ -499,10 +520,19 @@ static bool IsCurrentForFeeEstimation() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
  * and instead just erase from the mempool as needed.
  */
 
+static void PrecheckSignatures(const std::vector<CTransactionRef>& vtx);
+
 static void UpdateMempoolForReorg(DisconnectedBlockTransactions &disconnectpool, bool fAddToMempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
     std::vector<uint256> vHashUpdate;
+    if (fAddToMempool) {
+        std::vector<CTransactionRef> vtx;
+        for (auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin(); it != disconnectpool.queuedTx.get<insertion_order>().rend(); ++it) {
+            vtx.push_back(*it);
+        }
+        PrecheckSignatures(vtx);
+    }
     // disconnectpool's insertion_order index sorts the entries from
     // oldest to newest, but the oldest entry will be the last tx from the
     // latest mined block that was disconnected.
@@ -1072,21 +1102,75 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+/** Mappings of recently read block files (see -blockmmap) */
+static CBlockFileMapCache g_block_file_maps;
+
+void SetBlockFileMapLimit(unsigned int nMaxFiles)
+{
+    g_block_file_maps.SetMaxFiles(nMaxFiles);
+}
+
+/**
+ * Locate the serialized block stored at pos in a mapped block file. The
+ * returned span is only valid while file is held. Returns false if block
+ * file mapping is disabled or the stored data doesn't look like a block,
+ * in which case the caller should fall back to reading the file.
+ */
+static bool FindMappedBlock(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                            std::shared_ptr<const CMappedBlockFile>& file, Span<const unsigned char>& block)
+{
+    if (pos.IsNull() || pos.nPos < 8 || !g_block_file_maps.IsEnabled())
+        return false;
+
+    const fs::path path = GetBlockPosFilename(pos, "blk");
+    file = g_block_file_maps.Get(pos.nFile, path, pos.nPos);
+    if (!file)
+        return false;
+
+    // The meta header (message start and size) precedes the block
+    const unsigned char* header = file->GetSpan().data() + pos.nPos - 8;
+    if (memcmp(header, message_start, CMessageHeader::MESSAGE_START_SIZE))
+        return false;
+    const uint32_t blk_size = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (blk_size > MAX_SIZE)
+        return false;
+    if ((size_t)pos.nPos + blk_size > file->size()) {
+        file = g_block_file_maps.Get(pos.nFile, path, (size_t)pos.nPos + blk_size);
+        if (!file)
+            return false;
+    }
+
+    block = file->GetSpan().subspan(pos.nPos, blk_size);
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedBlockFile> mapped_file;
+    Span<const unsigned char> mapped_block;
+    if (FindMappedBlock(pos, Params().MessageStart(), mapped_file, mapped_block)) {
+        // Deserialize straight from the mapped file
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, mapped_block) >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1114,6 +1198,13 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    std::shared_ptr<const CMappedBlockFile> mapped_file;
+    Span<const unsigned char> mapped_block;
+    if (FindMappedBlock(pos, message_start, mapped_file, mapped_block)) {
+        block.assign(mapped_block.begin(), mapped_block.end());
+        return true;
+    }
+
     CDiskBlockPos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1158,6 +1249,52 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+/** Recently connected blocks (see -blockcachesize) */
+static CRecentBlockCache g_recent_blocks;
+
+void SetRecentBlockCacheSize(unsigned int nMaxBlocks)
+{
+    g_recent_blocks.SetMaxBlocks(nMaxBlocks);
+}
+
+std::shared_ptr<const CBlock> ReadBlockCached(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    std::shared_ptr<const CBlock> pblock = g_recent_blocks.Get(pindex->GetBlockHash());
+    if (pblock) {
+        return pblock;
+    }
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+        return nullptr;
+    }
+    return pblockRead;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> GetCachedRawBlock(const uint256& hash)
+{
+    return g_recent_blocks.GetSerialized(hash);
+}
+
+std::shared_ptr<const std::vector<uint8_t>> ReadRawBlockCached(const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    std::shared_ptr<const std::vector<uint8_t>> block_data = g_recent_blocks.GetSerialized(pindex->GetBlockHash());
+    if (block_data) {
+        return block_data;
+    }
+    std::shared_ptr<std::vector<uint8_t>> block_read = std::make_shared<std::vector<uint8_t>>();
+    if (!ReadRawBlockFromDisk(*block_read, pindex, message_start)) {
+        return nullptr;
+    }
+    return block_read;
+}
+
+bool RawBlockMatchesSerialization(const CBlockIndex* pindex, int nSerFlags, const Consensus::Params& params)
+{
+    // Blocks are stored with witness data, which can't be present before
+    // segwit activation, so only later blocks would need it stripped.
+    return !(nSerFlags & SERIALIZE_TRANSACTION_NO_WITNESS) || !IsWitnessEnabled(pindex->pprev, params);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams, bool fSuperblockPartOnly)
 {
     int halvings = (nHeight - 1) / consensusParams.nSubsidyHalvingInterval;
@@ -1666,8 +1803,11 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            // Never keep a mapping that extends past the truncated end
+            g_block_file_maps.Erase(nLastBlockFile);
             status &= TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         status &= FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -1713,6 +1853,82 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+void EnableScriptCheckWorkStealing(int nThreads)
+{
+    scriptcheckqueue.EnableWorkStealing(std::max(nThreads, 1));
+}
+
+CCheckQueueStats GetScriptCheckQueueStats()
+{
+    return scriptcheckqueue.GetStats();
+}
+
+/**
+ * Run the checks of transactions [nBegin, nEnd) of a precheck, those of
+ * transaction i starting at vTxBegin[i]. The queue gives up on a session at
+ * the first failing check, so if one fails each half is run again, and a bad
+ * transaction only keeps its own signatures out of the cache.
+ */
+static void RunPrecheck(const std::vector<CScriptCheck>& vChecks, const std::vector<size_t>& vTxBegin, size_t nBegin, size_t nEnd)
+{
+    std::vector<CScriptCheck> vRun(vChecks.begin() + vTxBegin[nBegin], vChecks.begin() + vTxBegin[nEnd]);
+    bool fOk;
+    {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vRun);
+        fOk = control.Wait();
+    }
+    if (fOk || nEnd - nBegin < 2) {
+        return;
+    }
+    // Checks that passed are found in the cache when they are run again
+    const size_t nMid = nBegin + (nEnd - nBegin) / 2;
+    RunPrecheck(vChecks, vTxBegin, nBegin, nMid);
+    RunPrecheck(vChecks, vTxBegin, nMid, nEnd);
+}
+
+/**
+ * Run the script checks of transactions about to be accepted to the mempool
+ * one by one on the script check threads, so that their signatures are found
+ * in the signature cache then. Parents have to come before their children.
+ * Transactions with unknown inputs are left alone. Results are not kept,
+ * acceptance checks every transaction again.
+ */
+static void PrecheckSignatures(const std::vector<CTransactionRef>& vtx)
+{
+    if (!nScriptCheckThreads || vtx.size() < 2) {
+        return;
+    }
+
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    std::vector<CScriptCheck> vChecks;
+    std::vector<size_t> vTxBegin;
+    {
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+        CCoinsViewCache view(&viewMemPool);
+        for (const CTransactionRef& tx : vtx) {
+            if (tx->IsCoinBase() || !view.HaveInputs(*tx)) {
+                continue;
+            }
+            txdata.emplace_back(*tx);
+            vTxBegin.push_back(vChecks.size());
+            for (unsigned int i = 0; i < tx->vin.size(); i++) {
+                vChecks.emplace_back(view.AccessCoin(tx->vin[i].prevout).out, *tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+            }
+            // Later transactions of the batch may spend these
+            AddCoins(view, *tx, MEMPOOL_HEIGHT, true /* check */);
+        }
+    }
+    if (vTxBegin.empty()) {
+        return;
+    }
+    vTxBegin.push_back(vChecks.size());
+
+    RunPrecheck(vChecks, vTxBegin, 0, vTxBegin.size() - 1);
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -1817,7 +2033,8 @@ static int64_t nBlocksTotal = 0;
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  With fJustCheck, the context-independent checks are left to the caller. */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                   CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
 {
@@ -1839,7 +2056,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     // is enforced in ContextualCheckBlockHeader(); we wouldn't want to
     // re-enforce that rule here (at least until we make it impossible for
     // GetAdjustedTime() to go backward).
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck)) {
+    if (!fJustCheck && !CheckBlock(block, state, chainparams.GetConsensus())) {
         if (state.CorruptionPossible()) {
             // We don't write down blocks to disk if they may have been
             // corrupted, so this should be impossible unless we're having hardware
@@ -1855,7 +2072,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
-    if (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock) {
+    if (*pindex->phashBlock == chainparams.GetConsensus().hashGenesisBlock) {
         if (!fJustCheck)
             view.SetBestBlock(pindex->GetBlockHash());
         return true;
@@ -2179,6 +2396,7 @@ static void AppendWarning(std::string& res, const std::string& warn)
 /** Check warning conditions and do some notifications on new chain tip set. */
 void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainParams) {
     // New best block
+    g_published_tip = pindexNew;
     mempool.AddTransactionsUpdated(1);
 
     {
@@ -2407,6 +2625,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
+    g_recent_blocks.Insert(pindexNew->GetBlockHash(), pthisBlock);
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
@@ -2867,33 +3086,37 @@ void ResetBlockFailureFlags(CBlockIndex *pindex) {
     return g_chainstate.ResetBlockFailureFlags(pindex);
 }
 
-CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block, const uint256* pHash)
 {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = pHash ? *pHash : block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_block_index_arena.Allocate(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
-    if (miPrev != mapBlockIndex.end())
     {
-        pindexNew->pprev = (*miPrev).second;
-        pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
-        pindexNew->BuildSkip();
+        // The entry is complete by the time LookupBlockIndexNoCsMain can find it
+        LOCK(g_block_index_map_mutex);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
+        pindexNew->phashBlock = &((*mi).first);
+        BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+        if (miPrev != mapBlockIndex.end())
+        {
+            pindexNew->pprev = (*miPrev).second;
+            pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+            pindexNew->BuildSkip();
+        }
+        pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+        pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     }
-    pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
-    pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
@@ -3038,15 +3261,20 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     return true;
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const Consensus::Params& consensusParams)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (!CheckProofOfWork(hash, block.nBits, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
 }
 
+static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+{
+    return !fCheckPOW || CheckBlockHeader(block, block.GetHash(), state, consensusParams);
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3308,11 +3536,11 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const uint256* pHash)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = pHash ? *pHash : block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3326,7 +3554,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, hash, state, chainparams.GetConsensus()))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3379,7 +3607,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
         }
     }
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, &hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3393,15 +3621,87 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     return true;
 }
 
+/** Fewer headers than this per job aren't worth handing to another thread */
+static const size_t MIN_HEADERS_PER_HASH_THREAD = 250;
+
+namespace {
+
+/** Hashes a range of headers, a job for headerhashqueue */
+class CBlockHeaderHashCheck
+{
+private:
+    const CBlockHeader* m_begin{nullptr};
+    const CBlockHeader* m_end{nullptr};
+    uint256* m_hashes{nullptr};
+
+public:
+    CBlockHeaderHashCheck() {}
+    CBlockHeaderHashCheck(const CBlockHeader* begin, const CBlockHeader* end, uint256* hashes) :
+        m_begin(begin), m_end(end), m_hashes(hashes) {}
+
+    bool operator()()
+    {
+        for (const CBlockHeader* p = m_begin; p != m_end; ++p) {
+            m_hashes[p - m_begin] = p->GetHash();
+        }
+        return true;
+    }
+
+    void swap(CBlockHeaderHashCheck& check)
+    {
+        std::swap(m_begin, check.m_begin);
+        std::swap(m_end, check.m_end);
+        std::swap(m_hashes, check.m_hashes);
+    }
+};
+
+} // namespace
+
+/** Workers for header hashing, started once with the script check threads */
+static CCheckQueue<CBlockHeaderHashCheck> headerhashqueue(1);
+
+void ThreadHeaderHash() {
+    RenameThread("bagicoin-hdrhash");
+    headerhashqueue.Thread();
+}
+
+void HashBlockHeaders(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashesRet)
+{
+    hashesRet.resize(headers.size());
+    const int nJobs = std::min<int>(MAX_HEADER_HASH_THREADS, headers.size() / MIN_HEADERS_PER_HASH_THREAD);
+    if (nJobs <= 1) {
+        CBlockHeaderHashCheck(headers.data(), headers.data() + headers.size(), hashesRet.data())();
+        return;
+    }
+    // The calling thread hashes along with the workers, and does it all if none were started
+    CCheckQueueControl<CBlockHeaderHashCheck> control(&headerhashqueue);
+    std::vector<CBlockHeaderHashCheck> vChecks;
+    vChecks.reserve(nJobs);
+    for (int i = 0; i < nJobs; i++) {
+        size_t nBegin = headers.size() * i / nJobs, nEnd = headers.size() * (i + 1) / nJobs;
+        vChecks.emplace_back(headers.data() + nBegin, headers.data() + nEnd, hashesRet.data() + nBegin);
+    }
+    control.Add(vChecks);
+    control.Wait();
+}
+
 // Exposed wrapper for AcceptBlockHeader
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid, const std::vector<uint256>* pHashes)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // Hash the headers before taking cs_main, so the lock is only held to look them up and insert them
+    std::vector<uint256> hashes;
+    if (pHashes == nullptr || pHashes->size() != headers.size()) {
+        HashBlockHeaders(headers, hashes);
+        pHashes = &hashes;
+    }
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, &(*pHashes)[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3630,6 +3930,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_block_file_maps.Erase(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3800,7 +4101,8 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = m_block_index_arena.Allocate();
+    LOCK(g_block_index_map_mutex);
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3809,6 +4111,12 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
+    // Size the map for the whole index up front rather than rehashing it as it grows
+    const size_t nEstimatedEntries = blocktree.EstimateBlockIndexEntries();
+    {
+        LOCK(g_block_index_map_mutex);
+        mapBlockIndex.reserve(nEstimatedEntries);
+    }
     if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
         return false;
 
@@ -3933,6 +4241,7 @@ bool LoadChainTip(const CChainParams& chainparams)
         return false;
     }
     chainActive.SetTip(pindex);
+    g_published_tip = pindex;
 
     g_chainstate.PruneBlockIndexCandidates();
 
@@ -4296,6 +4605,7 @@ void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     m_failed_blocks.clear();
     setBlockIndexCandidates.clear();
+    m_block_index_arena.Clear();
 }
 
 // May NOT be used after any connections are up as much
@@ -4305,12 +4615,15 @@ void UnloadBlockIndex()
 {
     LOCK(cs_main);
     chainActive.SetTip(nullptr);
+    g_published_tip = nullptr;
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    g_block_file_maps.Clear();
+    g_recent_blocks.Clear();
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     versionbitscache.Clear();
@@ -4318,10 +4631,10 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (const BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
+    {
+        LOCK(g_block_index_map_mutex);
+        mapBlockIndex.clear();
     }
-    mapBlockIndex.clear();
     fHavePruned = false;
 
     g_chainstate.UnloadBlockIndex();
@@ -4716,6 +5029,8 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 }
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of transactions of mempool.dat whose signatures are checked in parallel at a time */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
 
 bool LoadMempool()
 {
@@ -4742,22 +5057,38 @@ bool LoadMempool()
         }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        while (num) {
+            std::vector<CTransactionRef> vtx;
+            std::vector<int64_t> vTime;
+            while (num && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                --num;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vTime.push_back(nTime);
+                } else {
+                    ++expired;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+
+            // The dump lists parents before their children
+            PrecheckSignatures(vtx);
+
+            for (size_t i = 0; i < vtx.size(); i++) {
+                const CTransactionRef& tx = vtx[i];
+                CValidationState state;
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, vTime[i],
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
                                            false /* test_accept */);
                 if (state.IsValid()) {
@@ -4773,11 +5104,11 @@ bool LoadMempool()
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
+                if (ShutdownRequested())
+                    return false;
             }
-             if (ShutdownRequested())
-                 return false;
+            if (ShutdownRequested())
+                return false;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -4865,16 +5196,3 @@ double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pin
 
     return pindex->nChainTx / fTxTotal;
 }
-
-class CMainCleanup
-{
-public:
-    CMainCleanup() {}
-    ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
-    }
-} instance_of_cmaincleanup;
@@ -41,6 +41,7 @@ class CCoinsViewDB;
 class CInv;
 class CConnman;
 class CScriptCheck;
+struct CCheckQueueStats;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
@@ -84,8 +85,19 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -blockcachesize default (number of recently connected blocks kept in memory) */
+static const unsigned int DEFAULT_RECENT_BLOCK_CACHE_SIZE = 8;
+/** -blockmmap default (number of block files kept memory-mapped for reads, 0 = disabled) */
+static const unsigned int DEFAULT_BLOCK_MMAP_FILES = 0;
+/** -parworkstealing default (use per-thread script check deques with work stealing) */
+static const bool DEFAULT_SCRIPTCHECK_WORKSTEALING = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the blocks requested at a time from a single peer when sized from its measured speed. */
+static const int MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 128;
+/** Minimum time (in microseconds) a block stalling the download window stays in flight before another peer is asked for it. */
+static const int64_t BLOCK_REASSIGN_MIN_AGE = 500000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -98,9 +110,13 @@ static const int MAX_CMPCTBLOCK_DEPTH = 5;
 static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
- *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
- *  want to make this a per-peer adaptive value at some point. */
+ *  degree of disordering of blocks on disk (which make reindexing and pruning harder). This is the
+ *  window used in prune mode, and the smallest one otherwise. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** With adaptive downloads, the window grows to the number of blocks our peers deliver in this many seconds... */
+static const unsigned int BLOCK_DOWNLOAD_WINDOW_TIME = 10;
+/** ...up to this many blocks. */
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 8192;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -244,8 +260,15 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  * @param[in]  chainparams The params for the chain we want to connect to
  * @param[out] ppindex If set, the pointer will be set to point to the last new block index object for the given headers
  * @param[out] first_invalid First header that fails validation, if one exists
+ * @param[in]  pHashes If set, the hashes of the headers, so they aren't computed again
  */
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr, CBlockHeader* first_invalid = nullptr) LOCKS_EXCLUDED(cs_main);
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr, CBlockHeader* first_invalid = nullptr, const std::vector<uint256>* pHashes = nullptr) LOCKS_EXCLUDED(cs_main);
+
+/** Most threads hashing the headers of one headers message, the calling thread included */
+static const int MAX_HEADER_HASH_THREADS = 8;
+
+/** Compute the hashes of block headers, spread over the header hash threads for long runs of headers */
+void HashBlockHeaders(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashesRet);
 
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0, bool blocks_dir = false);
@@ -266,6 +289,12 @@ bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_m
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header hashing thread */
+void ThreadHeaderHash();
+/** Switch the script check queue to work stealing; call before starting ThreadScriptCheck */
+void EnableScriptCheckWorkStealing(int nThreads);
+/** Return the timing counters of the script check queue */
+CCheckQueueStats GetScriptCheckQueueStats();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -398,6 +427,18 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Serve block reads from up to nMaxFiles memory-mapped block files (0 = read through stdio) */
+void SetBlockFileMapLimit(unsigned int nMaxFiles);
+/** Keep the last nMaxBlocks connected blocks in memory to serve repeated requests (0 = disable) */
+void SetRecentBlockCacheSize(unsigned int nMaxBlocks);
+/** Return a recently connected block from memory, or read it from disk. Returns nullptr on failure. */
+std::shared_ptr<const CBlock> ReadBlockCached(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Return the serialization (with witness data) of a recently connected block, or nullptr if not cached */
+std::shared_ptr<const std::vector<uint8_t>> GetCachedRawBlock(const uint256& hash);
+/** Return the stored serialization of a block from the recent block cache or disk. Returns nullptr on failure. */
+std::shared_ptr<const std::vector<uint8_t>> ReadRawBlockCached(const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Whether the stored bytes of a block equal its serialization with nSerFlags, so they can be sent as they are */
+bool RawBlockMatchesSerialization(const CBlockIndex* pindex, int nSerFlags, const Consensus::Params& params);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -438,6 +479,16 @@ inline CBlockIndex* LookupBlockIndex(const uint256& hash)
     return it == mapBlockIndex.end() ? nullptr : it->second;
 }
 
+/**
+ * Look up a block index entry without cs_main, for readers like RPC. Only what
+ * doesn't change once an entry is in the index may be read from it: the header
+ * fields, height, chain work and ancestors, but not its status or chain membership.
+ */
+CBlockIndex* LookupBlockIndexNoCsMain(const uint256& hash);
+
+/** chainActive.Tip() as of its last change, to be read like LookupBlockIndexNoCsMain's results */
+const CBlockIndex* GetPublishedChainTip();
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
@@ -31,6 +31,8 @@ struct ValidationInterfaceConnections {
     boost::signals2::scoped_connection ProcessModuleMessage;
     boost::signals2::scoped_connection NotifyGovernanceObject;
     boost::signals2::scoped_connection NotifyGovernanceVote;
+    boost::signals2::scoped_connection NotifyMasternodePaymentVote;
+    boost::signals2::scoped_connection NotifyMasternodeListChanged;
 };
 
 struct MainSignalsInstance {
@@ -46,6 +48,8 @@ struct MainSignalsInstance {
     boost::signals2::signal<void (CNode*, const NetMsgDest&, const std::string&, CDataStream&, CConnman*)> ProcessModuleMessage;
     boost::signals2::signal<void (const CGovernanceObject&)> NotifyGovernanceObject;
     boost::signals2::signal<void (const CGovernanceVote&)> NotifyGovernanceVote;
+    boost::signals2::signal<void (const CMasternodePaymentVote&)> NotifyMasternodePaymentVote;
+    boost::signals2::signal<void (const CMasternodeListDiff&)> NotifyMasternodeListChanged;
 
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
@@ -113,6 +117,8 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     conns.ProcessModuleMessage = g_signals.m_internals->ProcessModuleMessage.connect(std::bind(&CValidationInterface::ProcessModuleMessage, pwalletIn, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
     conns.NotifyGovernanceObject = g_signals.m_internals->NotifyGovernanceObject.connect(std::bind(&CValidationInterface::NotifyGovernanceObject, pwalletIn, std::placeholders::_1));
     conns.NotifyGovernanceVote = g_signals.m_internals->NotifyGovernanceVote.connect(std::bind(&CValidationInterface::NotifyGovernanceVote, pwalletIn, std::placeholders::_1));
+    conns.NotifyMasternodePaymentVote = g_signals.m_internals->NotifyMasternodePaymentVote.connect(std::bind(&CValidationInterface::NotifyMasternodePaymentVote, pwalletIn, std::placeholders::_1));
+    conns.NotifyMasternodeListChanged = g_signals.m_internals->NotifyMasternodeListChanged.connect(std::bind(&CValidationInterface::NotifyMasternodeListChanged, pwalletIn, std::placeholders::_1));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
@@ -197,6 +203,7 @@ void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared
 }
 
 void CMainSignals::ProcessModuleMessage(CNode* pfrom, const NetMsgDest& dest, const std::string& strCommand, CDataStream& vRecv, CConnman* connman) {
+    AssertLockNotHeld(cs_main);
     m_internals->ProcessModuleMessage(pfrom, dest, strCommand, vRecv, connman);
 }
 
@@ -207,3 +214,11 @@ void CMainSignals::NotifyGovernanceObject(const CGovernanceObject &gobject) {
 void CMainSignals::NotifyGovernanceVote(const CGovernanceVote &govote) {
     m_internals->NotifyGovernanceVote(govote);
 }
+
+void CMainSignals::NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote) {
+    m_internals->NotifyMasternodePaymentVote(vote);
+}
+
+void CMainSignals::NotifyMasternodeListChanged(const CMasternodeListDiff &diff) {
+    m_internals->NotifyMasternodeListChanged(diff);
+}
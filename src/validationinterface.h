@@ -24,6 +24,8 @@ class CValidationInterface;
 class CValidationState;
 class CGovernanceVote;
 class CGovernanceObject;
+class CMasternodePaymentVote;
+struct CMasternodeListDiff;
 class CNode;
 class uint256;
 class CScheduler;
@@ -152,10 +154,20 @@ protected:
      * has been received and connected to the headers tree, though not validated yet
      */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {}
+    /**
+     * Notifies listeners of a message for the modules. Called from any message
+     * handler thread, possibly for several messages at once, and never with
+     * cs_main held. Handlers guard their state with their own locks and may
+     * take cs_main before them.
+     */
     virtual void ProcessModuleMessage(CNode* pfrom, const NetMsgDest& dest, const std::string& strCommand, CDataStream& vRecv, CConnman* connman) {}
 
     virtual void NotifyGovernanceVote(const CGovernanceVote &vote) {}
     virtual void NotifyGovernanceObject(const CGovernanceObject &object) {}
+    /** Notifies listeners of a payment vote added for an upcoming block */
+    virtual void NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote) {}
+    /** Notifies listeners that masternodes joined or left the list or changed state */
+    virtual void NotifyMasternodeListChanged(const CMasternodeListDiff &diff) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -201,6 +213,8 @@ public:
     void ProcessModuleMessage(CNode*, const NetMsgDest&, const std::string&, CDataStream&, CConnman*);
     void NotifyGovernanceVote(const CGovernanceVote&);
     void NotifyGovernanceObject(const CGovernanceObject&);
+    void NotifyMasternodePaymentVote(const CMasternodePaymentVote&);
+    void NotifyMasternodeListChanged(const CMasternodeListDiff&);
 };
 
 CMainSignals& GetMainSignals();
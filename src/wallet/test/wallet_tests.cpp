@@ -4,6 +4,7 @@
 
 #include <wallet/wallet.h>
 
+#include <list>
 #include <memory>
 #include <set>
 #include <stdint.h>
@@ -272,7 +273,10 @@ static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64
     if (blockTime > 0) {
         LockAnnotation lock(::cs_main);
         auto locked_chain = wallet.chain().lock();
-        auto inserted = mapBlockIndex.emplace(GetRandHash(), new CBlockIndex);
+        // mapBlockIndex doesn't own entries added from outside validation
+        static std::list<CBlockIndex> test_block_indexes;
+        test_block_indexes.emplace_back();
+        auto inserted = mapBlockIndex.emplace(GetRandHash(), &test_block_indexes.back());
         assert(inserted.second);
         const uint256& hash = inserted.first->first;
         block = inserted.first->second;
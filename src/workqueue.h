@@ -0,0 +1,182 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WORKQUEUE_H
+#define BITCOIN_WORKQUEUE_H
+
+#include <sync.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <stdint.h>
+
+/** Bounded multi-producer multi-consumer queue that needs no lock.
+ * Each cell carries a sequence number telling whether it is ready to be
+ * written or read in the current round of the ring (after D. Vyukov).
+ */
+template <typename T>
+class LockFreeQueue
+{
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    std::atomic<size_t> enqueuePos{0};
+    std::atomic<size_t> dequeuePos{0};
+
+    static size_t RoundUpPow2(size_t n)
+    {
+        size_t size = 1;
+        while (size < n) size <<= 1;
+        return size;
+    }
+
+public:
+    /** Capacity is rounded up to a power of two */
+    explicit LockFreeQueue(size_t capacity) : mask(RoundUpPow2(capacity) - 1)
+    {
+        cells.reset(new Cell[mask + 1]);
+        for (size_t i = 0; i <= mask; i++) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    /** Move item into the queue, unless it is full */
+    bool TryPush(T& item)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(item);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    /** Move the oldest item out of the queue, unless it is empty */
+    bool TryPop(T& item)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = std::move(cell.data);
+                    cell.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+/** Work queue for distributing work over multiple threads.
+ * Work items are simply callable objects. Enqueueing and taking work takes
+ * no lock; the mutex is only used to put idle worker threads to sleep and
+ * wake them up again.
+ */
+template <typename WorkItem>
+class WorkQueue
+{
+private:
+    LockFreeQueue<std::unique_ptr<WorkItem>> queue;
+    std::atomic<size_t> depth{0};
+    const size_t maxDepth;
+    std::atomic<uint64_t> rejected{0};
+    /** Mutex protects running and the waiting on cond */
+    Mutex cs;
+    std::condition_variable cond;
+    std::atomic<bool> running{true};
+    //! Worker threads waiting on cond
+    std::atomic<int> idle{0};
+
+public:
+    //! The ring has spare cells, as workers release theirs only after
+    //! taking the item out, so a full ring rejects items only rarely
+    explicit WorkQueue(size_t _maxDepth) : queue(_maxDepth * 2),
+                                 maxDepth(_maxDepth)
+    {
+    }
+    /** Precondition: worker threads have all stopped (they have been joined).
+     */
+    ~WorkQueue()
+    {
+    }
+    /** Enqueue a work item. On failure the caller keeps ownership of it. */
+    bool Enqueue(WorkItem* item)
+    {
+        if (depth.fetch_add(1) >= maxDepth) {
+            depth--;
+            rejected++;
+            return false;
+        }
+        std::unique_ptr<WorkItem> i(item);
+        if (!queue.TryPush(i)) {
+            // depth is already down for an item a worker is still moving
+            // out of its cell, so the ring can be full below maxDepth
+            i.release(); // the caller keeps ownership
+            depth--;
+            rejected++;
+            return false;
+        }
+        // Pairs with the fence in Run: either a worker going to sleep finds
+        // the item, or we see it waiting and wake it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle.load() > 0) {
+            LOCK(cs);
+            cond.notify_one();
+        }
+        return true;
+    }
+    /** Thread function */
+    void Run()
+    {
+        while (true) {
+            std::unique_ptr<WorkItem> i;
+            if (!queue.TryPop(i)) {
+                WAIT_LOCK(cs, lock);
+                idle++;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (running && !queue.TryPop(i))
+                    cond.wait(lock);
+                idle--;
+            }
+            if (!running)
+                break;
+            depth--;
+            (*i)();
+        }
+    }
+    /** Interrupt and exit loops */
+    void Interrupt()
+    {
+        LOCK(cs);
+        running = false;
+        cond.notify_all();
+    }
+    size_t Depth() const { return depth; }
+    size_t MaxDepth() const { return maxDepth; }
+    uint64_t Rejected() const { return rejected; }
+    int Idle() const { return idle; }
+};
+
+#endif // BITCOIN_WORKQUEUE_H
@@ -3,21 +3,52 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <zmq/zmqabstractnotifier.h>
+#include <chainparams.h>
+#include <rpc/server.h>
+#include <streams.h>
 #include <util/system.h>
+#include <validation.h>
 
 const int CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM;
 
+const std::vector<unsigned char>& CZMQTransaction::GetRaw()
+{
+    if (!fRaw) {
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vRaw, 0, *tx);
+        fRaw = true;
+    }
+    return vRaw;
+}
+
+const std::vector<unsigned char>* CZMQBlock::GetRaw()
+{
+    if (!fRaw) {
+        if (!pblock) {
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            LOCK(cs_main);
+            if (!ReadBlockFromDisk(*pblockRead, pindex, Params().GetConsensus())) {
+                zmqError("Can't read block from disk");
+                return nullptr;
+            }
+            pblock = pblockRead;
+        }
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vRaw, 0, *pblock);
+        fRaw = true;
+    }
+    return &vRaw;
+}
+
 CZMQAbstractNotifier::~CZMQAbstractNotifier()
 {
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::NotifyBlock(CZMQBlock &/*block*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransaction(CZMQTransaction &/*transaction*/)
 {
     return true;
 }
@@ -31,3 +62,23 @@ bool CZMQAbstractNotifier::NotifyGovernanceObject(const CGovernanceObject& /*obj
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyMasternodePaymentVote(const CMasternodePaymentVote& /*vote*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeListChanged(const CMasternodeListDiff& /*diff*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::Flush()
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::SkipNotifications(ZMQNotification kind, uint32_t nCount)
+{
+    return true;
+}
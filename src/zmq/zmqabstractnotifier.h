@@ -7,13 +7,69 @@
 
 #include <zmq/zmqconfig.h>
 
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
 class CBlockIndex;
 class CGovernanceObject;
 class CGovernanceVote;
+class CMasternodePaymentVote;
 class CZMQAbstractNotifier;
+struct CMasternodeListDiff;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** The kinds of notification, one for each Notify method */
+enum class ZMQNotification
+{
+    BLOCK,
+    TRANSACTION,
+    GOVERNANCE_VOTE,
+    GOVERNANCE_OBJECT,
+    MASTERNODE_PAYMENT_VOTE,
+    MASTERNODE_LIST,
+};
+
+/**
+ * A transaction to notify. It is serialized when a notifier first needs
+ * the bytes, which are then shared by all notifiers.
+ */
+class CZMQTransaction
+{
+public:
+    explicit CZMQTransaction(const CTransactionRef& txIn) : tx(txIn) {}
+
+    const CTransaction& GetTx() const { return *tx; }
+    const std::vector<unsigned char>& GetRaw();
+
+private:
+    const CTransactionRef tx;
+    std::vector<unsigned char> vRaw;
+    bool fRaw{false};
+};
+
+/**
+ * A new chain tip to notify. The block is read from disk when a notifier
+ * first needs its bytes, unless it was passed along from validation.
+ */
+class CZMQBlock
+{
+public:
+    CZMQBlock(const CBlockIndex* pindexIn, const std::shared_ptr<const CBlock>& pblockIn) : pindex(pindexIn), pblock(pblockIn) {}
+
+    const CBlockIndex* GetIndex() const { return pindex; }
+    /** Returns nullptr if the block could not be read */
+    const std::vector<unsigned char>* GetRaw();
+
+private:
+    const CBlockIndex* const pindex;
+    std::shared_ptr<const CBlock> pblock;
+    std::vector<unsigned char> vRaw;
+    bool fRaw{false};
+};
+
 class CZMQAbstractNotifier
 {
 public:
@@ -42,10 +98,17 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
+    // Called on the sender thread of CZMQNotificationInterface only
+    virtual bool NotifyBlock(CZMQBlock &block);
+    virtual bool NotifyTransaction(CZMQTransaction &transaction);
     virtual bool NotifyGovernanceVote(const CGovernanceVote &vote);
     virtual bool NotifyGovernanceObject(const CGovernanceObject &object);
+    virtual bool NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote);
+    virtual bool NotifyMasternodeListChanged(const CMasternodeListDiff &diff);
+    /** Send anything held back, as there are no more notifications waiting */
+    virtual bool Flush();
+    /** Account for notifications of a kind that were dropped before reaching the notifier */
+    virtual bool SkipNotifications(ZMQNotification kind, uint32_t nCount);
 
 protected:
     void *psocket;
@@ -5,6 +5,8 @@
 #include <zmq/zmqnotificationinterface.h>
 #include <zmq/zmqpublishnotifier.h>
 
+#include <modules/masternode/masternode_man.h>
+#include <modules/masternode/masternode_payments.h>
 #include <version.h>
 #include <validation.h>
 #include <streams.h>
@@ -23,6 +25,7 @@ CZMQNotificationInterface::~CZMQNotificationInterface()
 {
     Shutdown();
 
+    LOCK(cs_notifiers);
     for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
     {
         delete *i;
@@ -31,6 +34,7 @@ CZMQNotificationInterface::~CZMQNotificationInterface()
 
 std::list<const CZMQAbstractNotifier*> CZMQNotificationInterface::GetActiveNotifiers() const
 {
+    LOCK(cs_notifiers);
     std::list<const CZMQAbstractNotifier*> result;
     for (const auto* n : notifiers) {
         result.push_back(n);
@@ -52,6 +56,10 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawgovernancevote"] = CZMQAbstractNotifier::Create<CZMQPublishRawGovernanceVoteNotifier>;
     factories["pubrawgovernanceobject"] = CZMQAbstractNotifier::Create<CZMQPublishRawGovernanceObjectNotifier>;
+    factories["pubbatchrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishBatchRawTransactionNotifier>;
+    factories["pubhashmasternodepaymentvote"] = CZMQAbstractNotifier::Create<CZMQPublishHashMasternodePaymentVoteNotifier>;
+    factories["pubrawmasternodepaymentvote"] = CZMQAbstractNotifier::Create<CZMQPublishRawMasternodePaymentVoteNotifier>;
+    factories["pubrawmasternodelistdiff"] = CZMQAbstractNotifier::Create<CZMQPublishRawMasternodeListDiffNotifier>;
 
     for (const auto& entry : factories)
     {
@@ -71,7 +79,10 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     if (!notifiers.empty())
     {
         notificationInterface = new CZMQNotificationInterface();
-        notificationInterface->notifiers = notifiers;
+        {
+            LOCK(notificationInterface->cs_notifiers);
+            notificationInterface->notifiers = notifiers;
+        }
 
         if (!notificationInterface->Initialize())
         {
@@ -101,6 +112,7 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    LOCK(cs_notifiers);
     std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin();
     for (; i!=notifiers.end(); ++i)
     {
@@ -121,6 +133,8 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    threadSend = std::thread(&TraceThread<std::function<void()> >, "zmqpub", std::function<void()>(std::bind(&CZMQNotificationInterface::ThreadSend, this)));
+
     return true;
 }
 
@@ -128,8 +142,19 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint(BCLog::ZMQ, "zmq: Shutdown notification interface\n");
+    if (threadSend.joinable())
+    {
+        // The sender thread publishes what is still queued before it exits
+        {
+            LOCK(cs_queue);
+            fStopSending = true;
+        }
+        condQueue.notify_one();
+        threadSend.join();
+    }
     if (pcontext)
     {
+        LOCK(cs_notifiers);
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
@@ -142,36 +167,57 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+void CZMQNotificationInterface::Enqueue(ZMQNotification kind, std::function<void()> func)
 {
-    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
-        return;
+    {
+        LOCK(cs_queue);
+        if (queue.size() >= MAX_ZMQ_QUEUE_SIZE)
+        {
+            LogPrint(BCLog::ZMQ, "zmq: Send queue full, dropping notification\n");
+            mapDropped[kind]++;
+            return;
+        }
+        queue.push_back(std::move(func));
+    }
+    condQueue.notify_one();
+}
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+void CZMQNotificationInterface::ThreadSend()
+{
+    while (true)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
+        std::deque<std::function<void()>> pending;
+        std::map<ZMQNotification, uint32_t> dropped;
         {
-            i++;
+            WAIT_LOCK(cs_queue, lock);
+            while (!fStopSending && queue.empty())
+                condQueue.wait(lock);
+            if (queue.empty())
+                break;
+            pending.swap(queue);
+            dropped.swap(mapDropped);
         }
-        else
+        for (const auto& func : pending)
+            func();
+        // Anything dropped came after the whole of pending, as the queue
+        // was full, so the gaps go right after it
+        for (const auto& entry : dropped)
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            LogPrintf("zmq: Dropped %u notifications, the send queue was full\n", entry.second);
+            ForEachNotifier([&entry](CZMQAbstractNotifier* notifier) { return notifier->SkipNotifications(entry.first, entry.second); });
         }
+        // Nothing else is waiting, so don't hold back batched messages
+        ForEachNotifier([](CZMQAbstractNotifier* notifier) { return notifier->Flush(); });
     }
 }
 
-void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef& ptx)
+void CZMQNotificationInterface::ForEachNotifier(const std::function<bool(CZMQAbstractNotifier*)>& func)
 {
-    // Used by BlockConnected and BlockDisconnected as well, because they're
-    // all the same external callback.
-    const CTransaction& tx = *ptx;
-
+    LOCK(cs_notifiers);
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        if (func(notifier))
         {
             i++;
         }
@@ -183,12 +229,41 @@ void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef&
     }
 }
 
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    std::shared_ptr<const CBlock> pblock = std::move(pblockLastConnected);
+    pblockLastConnected.reset();
+
+    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
+        return;
+
+    // Pass the block along if we have it, so it needn't be read back from disk
+    if (pblock && pblock->GetHash() != pindexNew->GetBlockHash())
+        pblock.reset();
+
+    Enqueue(ZMQNotification::BLOCK, [this, pindexNew, pblock] {
+        CZMQBlock block(pindexNew, pblock);
+        ForEachNotifier([&block](CZMQAbstractNotifier* notifier) { return notifier->NotifyBlock(block); });
+    });
+}
+
+void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    // Used by BlockConnected and BlockDisconnected as well, because they're
+    // all the same external callback.
+    Enqueue(ZMQNotification::TRANSACTION, [this, ptx] {
+        CZMQTransaction tx(ptx);
+        ForEachNotifier([&tx](CZMQAbstractNotifier* notifier) { return notifier->NotifyTransaction(tx); });
+    });
+}
+
 void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted)
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction added in the block
         TransactionAddedToMempool(ptx);
     }
+    pblockLastConnected = pblock;
 }
 
 void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock)
@@ -201,36 +276,31 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
 
 void CZMQNotificationInterface::NotifyGovernanceVote(const CGovernanceVote &vote)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyGovernanceVote(vote))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    Enqueue(ZMQNotification::GOVERNANCE_VOTE, [this, vote] {
+        ForEachNotifier([&vote](CZMQAbstractNotifier* notifier) { return notifier->NotifyGovernanceVote(vote); });
+    });
 }
 
 void CZMQNotificationInterface::NotifyGovernanceObject(const CGovernanceObject &object)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyGovernanceObject(object))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    std::shared_ptr<const CGovernanceObject> pobject = std::make_shared<CGovernanceObject>(object);
+    Enqueue(ZMQNotification::GOVERNANCE_OBJECT, [this, pobject] {
+        ForEachNotifier([&pobject](CZMQAbstractNotifier* notifier) { return notifier->NotifyGovernanceObject(*pobject); });
+    });
+}
+
+void CZMQNotificationInterface::NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote)
+{
+    Enqueue(ZMQNotification::MASTERNODE_PAYMENT_VOTE, [this, vote] {
+        ForEachNotifier([&vote](CZMQAbstractNotifier* notifier) { return notifier->NotifyMasternodePaymentVote(vote); });
+    });
+}
+
+void CZMQNotificationInterface::NotifyMasternodeListChanged(const CMasternodeListDiff &diff)
+{
+    Enqueue(ZMQNotification::MASTERNODE_LIST, [this, diff] {
+        ForEachNotifier([&diff](CZMQAbstractNotifier* notifier) { return notifier->NotifyMasternodeListChanged(diff); });
+    });
 }
 
 CZMQNotificationInterface* g_zmq_notification_interface = nullptr;
@@ -5,14 +5,23 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include <sync.h>
 #include <validationinterface.h>
+#include <zmq/zmqabstractnotifier.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <string>
 #include <map>
 #include <list>
+#include <thread>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+//! Notifications that may wait for the sender thread before new ones are dropped
+static const size_t MAX_ZMQ_QUEUE_SIZE = 100000;
+
 class CZMQNotificationInterface final : public CValidationInterface
 {
 public:
@@ -33,13 +42,35 @@ protected:
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
     void NotifyGovernanceVote(const CGovernanceVote& vote) override;
     void NotifyGovernanceObject(const CGovernanceObject& object) override;
+    void NotifyMasternodePaymentVote(const CMasternodePaymentVote& vote) override;
+    void NotifyMasternodeListChanged(const CMasternodeListDiff& diff) override;
 
 
 private:
     CZMQNotificationInterface();
 
+    /** Queue a notification for the sender thread, or count it as dropped if the queue is full */
+    void Enqueue(ZMQNotification kind, std::function<void()> func);
+    /** Sender thread: serializes and publishes queued notifications */
+    void ThreadSend();
+    /** Call func on each notifier, shutting down those that fail */
+    void ForEachNotifier(const std::function<bool(CZMQAbstractNotifier*)>& func);
+
     void *pcontext;
-    std::list<CZMQAbstractNotifier*> notifiers;
+    //! Guards the list itself; the notifiers are used by the sender thread only
+    mutable Mutex cs_notifiers;
+    std::list<CZMQAbstractNotifier*> notifiers GUARDED_BY(cs_notifiers);
+
+    Mutex cs_queue;
+    std::condition_variable condQueue;
+    std::deque<std::function<void()>> queue GUARDED_BY(cs_queue);
+    //! Notifications dropped since the queue was last taken, by kind
+    std::map<ZMQNotification, uint32_t> mapDropped GUARDED_BY(cs_queue);
+    bool fStopSending GUARDED_BY(cs_queue){false};
+    std::thread threadSend;
+
+    //! Block of the last BlockConnected, which is usually the next tip
+    std::shared_ptr<const CBlock> pblockLastConnected;
 };
 
 extern CZMQNotificationInterface* g_zmq_notification_interface;
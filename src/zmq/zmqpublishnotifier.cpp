@@ -3,12 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
-#include <chainparams.h>
+#include <modules/masternode/masternode_man.h>
+#include <modules/masternode/masternode_payments.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
-#include <validation.h>
 #include <util/system.h>
-#include <rpc/server.h>
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
@@ -20,6 +19,10 @@ static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWGVOTE   = "rawgovernancevote";
 static const char *MSG_RAWGOBJ    = "rawgovernanceobject";
+static const char *MSG_BATCHRAWTX = "batchrawtx";
+static const char *MSG_HASHMNPAYVOTE = "hashmasternodepaymentvote";
+static const char *MSG_RAWMNPAYVOTE  = "rawmasternodepaymentvote";
+static const char *MSG_RAWMNLISTDIFF = "rawmasternodelistdiff";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -161,9 +164,17 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQAbstractPublishNotifier::SkipNotifications(ZMQNotification kind, uint32_t nCount)
 {
-    uint256 hash = pindex->GetBlockHash();
+    if (kind == Kind()) {
+        SkipSequence(nCount);
+    }
+    return true;
+}
+
+bool CZMQPublishHashBlockNotifier::NotifyBlock(CZMQBlock &block)
+{
+    uint256 hash = block.GetIndex()->GetBlockHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashblock %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -171,9 +182,9 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(CZMQTransaction &transaction)
 {
-    uint256 hash = transaction.GetHash();
+    uint256 hash = transaction.GetTx().GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashtx %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -201,34 +212,68 @@ bool CZMQPublishHashGovernanceObjectNotifier::NotifyGovernanceObject(const CGove
     return SendMessage(MSG_HASHGOBJ, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(CZMQBlock &block)
 {
-    LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", block.GetIndex()->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+    const std::vector<unsigned char>* pvRaw = block.GetRaw();
+    if (!pvRaw) {
+        return false;
+    }
+    return SendMessage(MSG_RAWBLOCK, pvRaw->data(), pvRaw->size());
+}
 
-        ss << block;
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(CZMQTransaction &transaction)
+{
+    uint256 hash = transaction.GetTx().GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
+    const std::vector<unsigned char>& vRaw = transaction.GetRaw();
+    return SendMessage(MSG_RAWTX, vRaw.data(), vRaw.size());
+}
+
+CZMQPublishBatchRawTransactionNotifier::CZMQPublishBatchRawTransactionNotifier() :
+    nBatchSize(std::max(gArgs.GetArg("-zmqpubbatchrawtxsize", DEFAULT_ZMQ_BATCHRAWTX_SIZE), (int64_t)1))
+{
+}
+
+bool CZMQPublishBatchRawTransactionNotifier::NotifyTransaction(CZMQTransaction &transaction)
+{
+    const std::vector<unsigned char>& vRaw = transaction.GetRaw();
+    vBatch.insert(vBatch.end(), vRaw.begin(), vRaw.end());
+    if (++nBatchCount < nBatchSize) {
+        return true;
     }
+    return Flush();
+}
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+bool CZMQPublishBatchRawTransactionNotifier::Flush()
+{
+    if (nBatchCount == 0) {
+        return true;
+    }
+    LogPrint(BCLog::ZMQ, "zmq: Publish batchrawtx of %u transactions\n", nBatchCount);
+
+    std::vector<unsigned char> vMsg;
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, vMsg, 0);
+    WriteCompactSize(writer, nBatchCount);
+    vMsg.insert(vMsg.end(), vBatch.begin(), vBatch.end());
+    vBatch.clear();
+    nBatchCount = 0;
+    return SendMessage(MSG_BATCHRAWTX, vMsg.data(), vMsg.size());
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishBatchRawTransactionNotifier::SkipNotifications(ZMQNotification kind, uint32_t nCount)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    if (kind != Kind()) {
+        return true;
+    }
+    // The dropped transactions came after those batched so far and would have
+    // gone into later messages, so send this batch and then leave one gap
+    if (!Flush()) {
+        return false;
+    }
+    SkipSequence(1);
+    return true;
 }
 
 bool CZMQPublishRawGovernanceVoteNotifier::NotifyGovernanceVote(const CGovernanceVote &vote)
@@ -248,3 +293,29 @@ bool CZMQPublishRawGovernanceObjectNotifier::NotifyGovernanceObject(const CGover
     ss << govobj;
     return SendMessage(MSG_RAWGOBJ, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishHashMasternodePaymentVoteNotifier::NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote)
+{
+    uint256 hash = vote.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish hashmasternodepaymentvote %s\n", hash.GetHex());
+    char data[32];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return SendMessage(MSG_HASHMNPAYVOTE, data, 32);
+}
+
+bool CZMQPublishRawMasternodePaymentVoteNotifier::NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawmasternodepaymentvote %s\n", vote.GetHash().GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vote;
+    return SendMessage(MSG_RAWMNPAYVOTE, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishRawMasternodeListDiffNotifier::NotifyMasternodeListChanged(const CMasternodeListDiff &diff)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawmasternodelistdiff at height %d, %u updated, %u removed\n", diff.nHeight, diff.vUpdated.size(), diff.vRemoved.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << diff;
+    return SendMessage(MSG_RAWMNLISTDIFF, &(*ss.begin()), ss.size());
+}
@@ -11,11 +11,20 @@ class CBlockIndex;
 class CGovernanceVote;
 class CGovernanceObject;
 
+//! Default number of transactions per batchrawtx message
+static const int DEFAULT_ZMQ_BATCHRAWTX_SIZE = 100;
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence {0U}; //!< upcounting per message sequence number
 
+protected:
+    /** The kind of notification this notifier publishes */
+    virtual ZMQNotification Kind() const = 0;
+    /** Leave a gap in the sequence numbers for messages that were not sent */
+    void SkipSequence(uint32_t nCount) { nSequence += nCount; }
+
 public:
 
     /* send zmq multipart message
@@ -28,53 +37,126 @@ public:
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
+    bool SkipNotifications(ZMQNotification kind, uint32_t nCount) override;
 };
 
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::BLOCK; }
+
 public:
-    bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyBlock(CZMQBlock &block) override;
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::TRANSACTION; }
+
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(CZMQTransaction &transaction) override;
 };
 
 class CZMQPublishHashGovernanceVoteNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::GOVERNANCE_VOTE; }
+
 public:
     bool NotifyGovernanceVote(const CGovernanceVote &vote) override;
 };
 
 class CZMQPublishHashGovernanceObjectNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::GOVERNANCE_OBJECT; }
+
 public:
     bool NotifyGovernanceObject(const CGovernanceObject &object) override;
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::BLOCK; }
+
 public:
-    bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyBlock(CZMQBlock &block) override;
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::TRANSACTION; }
+
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(CZMQTransaction &transaction) override;
+};
+
+/** Publishes transactions several to a message: a compact size count, then
+ *  the raw transactions. A batch is sent once it is full, or when there are
+ *  no more notifications waiting. */
+class CZMQPublishBatchRawTransactionNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    const size_t nBatchSize;
+    std::vector<unsigned char> vBatch;
+    size_t nBatchCount{0};
+
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::TRANSACTION; }
+
+public:
+    CZMQPublishBatchRawTransactionNotifier();
+
+    bool NotifyTransaction(CZMQTransaction &transaction) override;
+    bool Flush() override;
+    bool SkipNotifications(ZMQNotification kind, uint32_t nCount) override;
 };
 
 class CZMQPublishRawGovernanceVoteNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::GOVERNANCE_VOTE; }
+
 public:
     bool NotifyGovernanceVote(const CGovernanceVote &vote) override;
 };
 
 class CZMQPublishRawGovernanceObjectNotifier : public CZMQAbstractPublishNotifier
 {
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::GOVERNANCE_OBJECT; }
+
 public:
     bool NotifyGovernanceObject(const CGovernanceObject &object) override;
 };
+
+class CZMQPublishHashMasternodePaymentVoteNotifier : public CZMQAbstractPublishNotifier
+{
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::MASTERNODE_PAYMENT_VOTE; }
+
+public:
+    bool NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote) override;
+};
+
+class CZMQPublishRawMasternodePaymentVoteNotifier : public CZMQAbstractPublishNotifier
+{
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::MASTERNODE_PAYMENT_VOTE; }
+
+public:
+    bool NotifyMasternodePaymentVote(const CMasternodePaymentVote &vote) override;
+};
+
+class CZMQPublishRawMasternodeListDiffNotifier : public CZMQAbstractPublishNotifier
+{
+protected:
+    ZMQNotification Kind() const override { return ZMQNotification::MASTERNODE_LIST; }
+
+public:
+    bool NotifyMasternodeListChanged(const CMasternodeListDiff &diff) override;
+};
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
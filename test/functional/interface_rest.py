@@ -280,6 +280,32 @@ class RESTTest (BitcoinTestFramework):
         json_obj = self.test_rest_request("/headers/5/{}".format(bb_hash))
         assert_equal(len(json_obj), 5)  # now we should have 5 header objects
 
+        self.log.info("Test the /headersbyheight and /blocksbyheight URIs")
+        height = block_json_obj['height']
+        json_obj = self.test_rest_request("/headersbyheight/{}/10".format(height))
+        assert_equal([h['hash'] for h in json_obj], [self.nodes[0].getblockhash(h) for h in range(height, height + 6)])
+        response_header_bytes = self.test_rest_request("/headersbyheight/{}/1".format(height), req_type=ReqType.BIN, ret_type=RetType.BYTES)
+        assert_equal(response_header_bytes, response_bytes[:BLOCK_HEADER_SIZE])
+
+        # Blocks are concatenated in their binary form
+        response_blocks = self.test_rest_request("/blocksbyheight/{}/3".format(height), req_type=ReqType.BIN, ret_type=RetType.BYTES)
+        assert_equal(response_blocks, b''.join(hex_str_to_bytes(self.nodes[0].getblock(self.nodes[0].getblockhash(h), 0)) for h in range(height, height + 3)))
+        response_blocks_hex = self.test_rest_request("/blocksbyheight/{}/3".format(height), req_type=ReqType.HEX, ret_type=RetType.BYTES)
+        assert_equal(response_blocks_hex.strip(b'\n'), binascii.hexlify(response_blocks))
+
+        # Check invalid ranges
+        self.test_rest_request("/blocksbyheight/{}/3".format(height), status=404, ret_type=RetType.OBJ)
+        self.test_rest_request("/blocksbyheight/{}/1001".format(height), req_type=ReqType.BIN, status=400, ret_type=RetType.OBJ)
+        self.test_rest_request("/headersbyheight/1000000/1", req_type=ReqType.BIN, status=404, ret_type=RetType.OBJ)
+        self.test_rest_request("/headersbyheight/{}".format(height), req_type=ReqType.BIN, status=400, ret_type=RetType.OBJ)
+
+        self.log.info("Test the /masternodes and /governance URIs")
+        assert_equal(self.test_rest_request("/masternodes", req_type=ReqType.BIN, ret_type=RetType.BYTES), b'\x00')
+        assert_equal(self.test_rest_request("/governance/objects", req_type=ReqType.HEX, ret_type=RetType.BYTES), b'00\n')
+        self.test_rest_request("/governance/votes/{}".format(bb_hash), req_type=ReqType.BIN, status=404, ret_type=RetType.OBJ)
+        self.test_rest_request("/masternodes/junk", req_type=ReqType.BIN, status=400, ret_type=RetType.OBJ)
+        self.test_rest_request("/governance/objectsjunk", req_type=ReqType.HEX, status=400, ret_type=RetType.OBJ)
+
         self.log.info("Test tx inclusion in the /mempool and /block URIs")
 
         # Make 3 tx and mine them on node 1
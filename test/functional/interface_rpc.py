@@ -22,6 +22,13 @@ class RPCInterfaceTest(BitcoinTestFramework):
         assert_equal(command['method'], 'getrpcinfo')
         assert_greater_than_or_equal(command['duration'], 0)
 
+        work_queue = info['work_queue']
+        assert_equal(work_queue['max_depth'], 64)
+        assert_equal(work_queue['rejected'], 0)
+        # Earlier requests have been handled, the current one is still running
+        assert_greater_than_or_equal(sum(work_queue['queue_time']), 1)
+        assert_greater_than_or_equal(sum(work_queue['service_time']), 1)
+
     def test_batch_request(self):
         self.log.info("Testing basic JSON-RPC batch request...")
 
@@ -48,6 +55,27 @@ class RPCInterfaceTest(BitcoinTestFramework):
         assert_equal(result_by_id[3]['error'], None)
         assert result_by_id[3]['result'] is not None
 
+        self.log.info("Testing JSON-RPC batch request with calls run in parallel...")
+
+        self.nodes[0].generate(10)
+        calls = []
+        for height in range(11):
+            calls.append({"method": "getblockhash", "params": [height], "id": len(calls)})
+            calls.append({"method": "getblockheader", "params": [self.nodes[0].getblockhash(height)], "id": len(calls)})
+            if height % 5 == 0:
+                # Not read-only, so it separates the calls around it
+                calls.append({"method": "uptime", "id": len(calls)})
+                calls.append({"method": "invalidmethod", "id": len(calls)})
+        results = self.nodes[0].batch(calls)
+        assert_equal([res["id"] for res in results], [call["id"] for call in calls])
+        for call, res in zip(calls, results):
+            if call["method"] == "getblockhash":
+                assert_equal(res["result"], self.nodes[0].getblockhash(call["params"][0]))
+            elif call["method"] == "getblockheader":
+                assert_equal(res["result"]["hash"], call["params"][0])
+            elif call["method"] == "invalidmethod":
+                assert_equal(res["error"]["code"], -32601)
+
     def run_test(self):
         self.test_getrpcinfo()
         self.test_batch_request()
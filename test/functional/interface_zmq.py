@@ -7,7 +7,7 @@ import struct
 
 from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.messages import CTransaction
+from test_framework.messages import CTransaction, deser_compact_size
 from test_framework.util import (
     assert_equal,
     bytes_to_hex_str,
@@ -65,8 +65,15 @@ class ZMQTest (BitcoinTestFramework):
         self.rawblock = ZMQSubscriber(socket, b"rawblock")
         self.rawtx = ZMQSubscriber(socket, b"rawtx")
 
+        # Batches are sent when the publisher runs out of notifications, so
+        # their place among the other messages varies: use a socket of their own.
+        batch_socket = self.zmq_context.socket(zmq.SUB)
+        batch_socket.set(zmq.RCVTIMEO, 60000)
+        batch_socket.connect(ADDRESS)
+        self.batchrawtx = ZMQSubscriber(batch_socket, b"batchrawtx")
+
         self.extra_args = [
-            ["-zmqpub%s=%s" % (sub.topic.decode(), ADDRESS) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]],
+            ["-zmqpub%s=%s" % (sub.topic.decode(), ADDRESS) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx, self.batchrawtx]],
             [],
         ]
         self.add_nodes(self.num_nodes, self.extra_args)
@@ -87,12 +94,14 @@ class ZMQTest (BitcoinTestFramework):
         genhashes = self.nodes[0].generatetoaddress(num_blocks, ADDRESS_BCRT1_UNSPENDABLE)
         self.sync_all()
 
+        rawtxs = []
         for x in range(num_blocks):
             # Should receive the coinbase txid.
             txid = self.hashtx.receive()
 
             # Should receive the coinbase raw transaction.
             hex = self.rawtx.receive()
+            rawtxs.append(hex)
             tx = CTransaction()
             tx.deserialize(BytesIO(hex))
             tx.calc_sha256()
@@ -108,6 +117,18 @@ class ZMQTest (BitcoinTestFramework):
             block = self.rawblock.receive()
             assert_equal(genhashes[x], bytes_to_hex_str(hash256(block[:80])))
 
+        self.log.info("Check the batched raw transactions")
+        batched = []
+        while len(batched) < len(rawtxs):
+            f = BytesIO(self.batchrawtx.receive())
+            for _ in range(deser_compact_size(f)):
+                start = f.tell()
+                CTransaction().deserialize(f)
+                batched.append(f.getvalue()[start:f.tell()])
+            # Nothing may follow the transactions
+            assert_equal(f.read(), b"")
+        assert_equal(batched, rawtxs)
+
         if self.is_wallet_compiled():
             self.log.info("Wait for tx from second node")
             payment_txid = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
@@ -124,6 +145,7 @@ class ZMQTest (BitcoinTestFramework):
 
         self.log.info("Test the getzmqnotifications RPC")
         assert_equal(self.nodes[0].getzmqnotifications(), [
+            {"type": "pubbatchrawtx", "address": ADDRESS, "hwm": 1000},
             {"type": "pubhashblock", "address": ADDRESS, "hwm": 1000},
             {"type": "pubhashtx", "address": ADDRESS, "hwm": 1000},
             {"type": "pubrawblock", "address": ADDRESS, "hwm": 1000},